@@ -7,26 +7,60 @@
 #include "C8051F350.h"		// SFR declarations
 #include "main.h"			// SYSCLK
 #include "F35x_ADC0.h"
+#include "trace.h"
+#include "kernels.h"
 
 //-----------------------------------------------------------------------------
 // Global CONSTANTS
 //-----------------------------------------------------------------------------
 
-#define MDCLK 2450000	// Modulator clock in Hz (ideal is
-						// (2.4576 MHz)
-#define AD_T 20.062e-3	// A/D acquisition period in s (assuming ADC0DEC=383)
-
-typedef union SHORTDATA
-{							// access SHORTDATA as a
-   unsigned short result; 	// short variable or
-   char Byte[2];			// 2 byte variables
-} SHORTDATA;
-
-#define Byte1 1
-#define Byte0 0
-
-volatile unsigned short adFiltValue[N_ADCHANNELS];	// acquired and filtered AI
-volatile unsigned short adPrevValue[2];				// previous AI for ch=0,1
+#ifndef ADC_HUM_REJECT
+// standard profile: ~240 Hz output word rate, 40 Hz sinusoidal excitation
+#define AD_DEC 79		// decimation register, MDCLK/(128*80) = 239.26 Hz
+#define AD_FW_A 32361L	// water channels (0,1) filter, 2 s time constant (see ADC0_Process)
+#define AD_FW_B 407L
+#define AD_FP_A 30783L	// pots (2,3) filter, 0.2 s time constant
+#define AD_FP_B 1985L
+#else
+// mains hum rejection profile: ~50 Hz output word rate, so the fast filter
+//   notches (at multiples of the output word rate) fall on 50 Hz and its
+//   harmonics. Same time constants, coefficients recomputed for the slower
+//   sampling: 2 s at 8.31 Hz (n=16.6), 0.2 s at 16.6 Hz (n=3.32)
+#define AD_DEC 383		// decimation register, MDCLK/(128*384) = 49.85 Hz
+#define AD_FW_A 30854L	// a=0.94159
+#define AD_FW_B 1914L
+#define AD_FP_A 24253L	// a=0.74013
+#define AD_FP_B 8515L
+#endif
+
+// raw samples queued by ADC0_ISR for ADC0_Process (single producer/consumer:
+//   head written by the ISR, tail by main)
+__idata unsigned short adRawVal[AD_RINGSIZE];
+__idata unsigned char adRawSlot[AD_RINGSIZE];		// da_counter of each sample
+volatile unsigned char adRawHead=0, adRawTail=0;
+volatile __bit bADOverrun = 0;						// samples are being dropped
+unsigned char adDaCounter = 0;						// slot of the conversion in progress
+
+unsigned short adFiltValue[N_ADCHANNELS];	// acquired and filtered AI
+unsigned short adPrevValue[2];				// previous AI for ch=0,1
+// coherent copy of adFiltValue, published once per DA_PERIOD cycle
+// adSnapSeq is incremented after each publish, readers retry if it changes
+volatile unsigned short adSnapValue[N_ADCHANNELS];
+volatile unsigned char adSnapSeq = 0;
+#ifdef RACECHECK
+__xdata unsigned short race_ad_retry = 0;	// getADSnapshot() retries
+#endif
+volatile __bit bADValid = 0;	// all filters seeded, snapshot can be used
+__bit bADRunning = 0;			// calibration done, conversions running
+// seeded filters (bit ch) and valid adPrevValue for ch 0,1 (bit 4+ch)
+unsigned char adSeeded = 0;
+// conversions to ignore after start, while excitation settles
+unsigned char adSkip = DA_PERIOD;
+__bit bADOff = 0;				// powered down (ADC0_Off), don't restart
+#ifdef ADC_DUTY
+__xdata unsigned char adDutyCnt = 0;	// seconds in current duty period
+__xdata unsigned long adOnSecs = 0, adTotSecs = 0;	// seconds with A/D running, total
+#endif
 // DAC output: constant around the A/D cycles 0 and 1 (ref and meas for water detector),
 //   intermediate in the single remaining cycle. The A/D cycle is slow (no sampling?)
 //   and uses a whole cycle, so we need a constant value one cycle before (for the
@@ -34,11 +68,18 @@ volatile unsigned short adPrevValue[2];				// previous AI for ch=0,1
 // min is set to 0, max is set to 0.3mA, to give 2.04V on 6.8k (0.5mA f.s.)
 //__code unsigned char da_val[DA_PERIOD] = { 154, 154, 77, 0, 0, 0, 77, 154 };
 
+#ifndef ADC_HUM_REJECT
 // DAC output: sinusoid of period 6 repeated two times (240/6 = 40 Hz)
 // A/D is sampled on maxima (+ and -) in separate cycles for ch 0 and 1, so we get
 //   the same timing for both channels (A/D acquisition lasts an entire cycle)
 __code unsigned char da_val[DA_PERIOD] = { 154, 103, 51, 0, 51, 103, 154, 103, 51, 0, 51, 103 };
+#else
+// DAC output: trapezoid of period 6 (50/6 = 8.3 Hz), with the same value in the
+//   cycle before each ch 0/1 sample, so the circuits are stable when sampled
+__code unsigned char da_val[DA_PERIOD] = { 154, 77, 0, 0, 77, 154, 154, 77, 0, 0, 77, 154 };
+#endif
 // this array defines the A/D channel currently acquired
+// same for both profiles: ch 0 on DAC max/min, then ch 1 on DAC max/min
 __code unsigned char ad_ch_arr[DA_PERIOD] = { 0, 2, 3, 0, 2, 3, 1, 2, 3, 1, 2, 3 };
 
 
@@ -57,38 +98,235 @@ void ADC0_Init (void)
    // Program decimation rate for desired OWR
    // since we use fast filter, the rate (register+1) must be a multiple of 8
    // to get 240Hz, nearest choice is 10*8=80 (79 in register), which gives
-   //   MDCLK/(128*80) = 239.26 Hz = 1/AD_T
-   ADC0DEC = 79;
+   //   MDCLK/(128*80) = 239.26 Hz
+   // for 50 Hz (ADC_HUM_REJECT) 48*8=384 (383 in register) gives 49.85 Hz (20.06 ms)
+   ADC0DEC = AD_DEC;
 
    ADC0BUF = 0x00;                     // turn off Input Buffers
    ADC0DAC = 0;						   // no DAC offset
 
    // calibrate range for g=1, single ended mode
+   // don't wait here: ADC0_Poll() starts conversions when calibration is complete
    ADC0CN = 0x00;
    ADC0MD = 0x81;                      // start internal calibration
-   while(AD0CALC != 1);                // wait until calibration is complete
+}
+
+
+// start conversions as soon as calibration is complete
+// called from main loop, so init doesn't have to wait for calibration
+// also restarts them after ADC0_On()
+void ADC0_Poll(void)
+{
+   if (bADRunning || bADOff || AD0CALC != 1)
+      return;
+   bADRunning = 1;
 
+   // start from slot 0, as after power on
+   adDaCounter = 0;
+   AD0INT = 0;
    EIE1   |= 0x08;                     // Enable ADC0 Interrupts
    ADC0MUX = 0x08;                     // Select AIN0-GND
    ADC0MD  = 0x82;                     // Enable the ADC0 (single conversion mode)
 
    // enable the DAC
+   IDA0 = da_val[0];
    IDA0CN = 0xF1;	// 0-5 mA f.s., enable IDA0, updates on write to register
 }
 
 
-// get data for one channel
-// channels are rescaled to short range according to their FS
-unsigned short getAD(unsigned char ch)
+//-----------------------------------------------------------------------------
+// ADC0_Off
+//-----------------------------------------------------------------------------
+//
+// Stop conversions, then turn off ADC and excitation (less current and no
+// electrolysis on the water sensor). The last snapshot is kept, but no
+// longer valid (bADValid=0). Queued samples are still filtered, then the
+// filters are seeded again on restart, so the first snapshot after
+// ADC0_On() is fresh.
+//
+void ADC0_Off(void)
+{
+	if (bADOff)
+		return;
+	bADOff = 1;
+
+	EIE1 &= ~0x08;
+	ADC0MD = 0x00;
+	IDA0 = 0;
+	IDA0CN = 0x00;
+	bADRunning = 0;
+
+	ADC0_Process();
+	adSkip = DA_PERIOD;
+	adSeeded = 0;
+	bADValid = 0;
+}
 
+
+// restart as after power on: the first cycle is skipped and the filters are
+//   seeded again, a new snapshot is published ~2 cycles later (100 ms,
+//   480 ms with ADC_HUM_REJECT)
+void ADC0_On(void)
 {
-	unsigned short val;
+	bADOff = 0;
+	ADC0_Poll();
+}
 
-	EA = 0;
-	val = adFiltValue[ch];
-	EA = 1;
 
-	return val;
+#ifdef ADC_DUTY
+//-----------------------------------------------------------------------------
+// ADC0_Duty
+//-----------------------------------------------------------------------------
+//
+// Power management of the acquisition, called every 1s by main with the
+// period chosen according to the controller state: 0 runs continuously,
+// otherwise A/D and excitation run for AD_BURST_SECS every <period> s and
+// are powered down in between (ADC0_Off). Each burst gives a fresh
+// filtered wd.
+//
+void ADC0_Duty(unsigned char period)
+{
+	adTotSecs++;
+	if (bADRunning)
+		adOnSecs++;
+
+	if (period == 0 || ++adDutyCnt >= period)
+		adDutyCnt = 0;
+
+	if (period == 0 || adDutyCnt < AD_BURST_SECS)
+		ADC0_On();
+	else
+		ADC0_Off();
+}
+#endif
+
+
+// get a coherent copy of all channels (same DA_PERIOD cycle)
+// channels are rescaled to short range according to their FS
+// blocks are published by ADC0_Process, in main context like us, so the first
+//   copy is always coherent; the check on adSnapSeq keeps this true if
+//   publishing is ever moved back to an IRQ
+void getADSnapshot(unsigned short *val)
+{
+	unsigned char seq, ch;
+
+	while (1)
+	{
+		seq = adSnapSeq;
+		for (ch=0; ch<N_ADCHANNELS; ch++)
+			val[ch] = adSnapValue[ch];
+		if (seq == adSnapSeq)
+			break;
+#ifdef RACECHECK
+		race_ad_retry++;
+#endif
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// ADC0_Process
+//-----------------------------------------------------------------------------
+//
+// Filter the raw samples queued by ADC0_ISR, called from main loop on each
+// wakeup. Publish all channels at the end of each DA_PERIOD cycle.
+//
+void ADC0_Process(void)
+{
+	unsigned char n, slot, ad_ch;
+	unsigned short raw;
+
+	for (n=0; n<AD_RINGSIZE && adRawTail != adRawHead; n++)
+	{
+		slot = adRawSlot[adRawTail];
+		raw = adRawVal[adRawTail];
+		adRawTail = (adRawTail+1) & (AD_RINGSIZE-1);
+
+		// after lost samples, differences on ch 0,1 must restart from a new pair
+		if (slot & AD_GAP)
+		{
+			slot &= ~AD_GAP;
+			adSeeded &= 0x0F;
+#ifdef TRACEMODE
+			bTraceGap = 1;
+#endif
+		}
+#ifdef TRACEMODE
+		TRACE_PUT(slot, raw);
+#endif
+
+		// get current A/D channel
+		ad_ch = ad_ch_arr[slot];
+		// skip the first cycle after start (excitation and circuits settling), then
+		//   seed each filter with its first reading instead of starting from 0, so
+		//   readings are valid after ~2 cycles and not after several time constants
+		if (adSkip)
+			adSkip--;
+		// for channels 0 and 1, compute 1st order difference and low-pass filter abs value
+		// this because we have opposite DAC output at each cycle
+		else if (ad_ch < 2)
+		{
+			unsigned short temp;
+			temp = adPrevValue[ad_ch];
+
+			// compute(abs(diff(val)))
+			if (raw > temp)
+				temp = raw-temp;
+			else
+				temp -= raw;
+
+			// use 32 bit math for filtering
+			// for each channel we are running at (average) 240/6 = 40 Hz
+			// (one 3/240 s cycle followed by 9/240 s -> 2 cycles in 12/240=1/20 s)
+			// We want a time constant of 2s, so prev values at 1/n after 40*2=80 cycles
+			// 1st order filter y(t)=a*y(t-1)+(1-a)*x(t); a=exp(-1/nCycles)
+			// for nCycles=80 a=0.98758
+			// we could use Q16, but we prefer Q15 to avoid problems with signed/unsigned long
+			// in Q15 a_q15=0.98758*32768=32361; (1-a) becomes 32768-a_q15=407
+			// the difference is meaningful only with a previous value from the
+			//   same run of samples (AD_GAP clears it), seed on the first one
+			if ((adSeeded & (0x11 << ad_ch)) == (0x11 << ad_ch))
+				adFiltValue[ad_ch] = K_FILT(adFiltValue[ad_ch], temp, AD_FW_A, AD_FW_B);
+			else if ((adSeeded & (0x11 << ad_ch)) == (0x10 << ad_ch))
+			{
+				adFiltValue[ad_ch] = temp;
+				adSeeded |= 1 << ad_ch;
+			}
+
+			// copy A/D value for next cycle
+			adPrevValue[ad_ch] = raw;
+			adSeeded |= 0x10 << ad_ch;
+		}
+		else
+		{
+			// filter pots with 0.2s time constant
+			// each measurement is taken every 3 cycles, or 80 Hz sampling
+			// We want a time constant of 0.2s, so prev values at 1/n after 16 cycles
+			// 1st order filter y(t)=a*y(t-1)+(1-a)*x(t); a=exp(-1/nCycles)
+			// for nCycles=16 a=0.93941
+			// in Q15 a_q15=0.92004*32768=30783; (1-a) becomes 32768-a_q15=1985
+			if (adSeeded & (1 << ad_ch))
+				adFiltValue[ad_ch] = K_FILT(adFiltValue[ad_ch], raw, AD_FP_A, AD_FP_B);
+			else
+			{
+				adFiltValue[ad_ch] = raw;
+				adSeeded |= 1 << ad_ch;
+			}
+		}
+
+		// a full excitation cycle is complete: publish all channels as one block
+		// only when all filters are seeded, so after a (re)start the snapshot
+		//   never mixes fresh and old channels
+		if (slot == DA_PERIOD-1 && (adSeeded & 0x0F) == 0x0F)
+		{
+			unsigned char ch;
+
+			for (ch=0; ch<N_ADCHANNELS; ch++)
+				adSnapValue[ch] = adFiltValue[ch];
+			adSnapSeq++;
+			bADValid = 1;
+		}
+	}
 }
 
 
@@ -97,73 +335,38 @@ unsigned short getAD(unsigned char ch)
 //-----------------------------------------------------------------------------
 //
 // The ISR is called after each ADC conversion.
+// Only queue the sample with its slot and sequence the excitation and
+// channel for the next conversion; filtering is done by ADC0_Process().
 //
 //-----------------------------------------------------------------------------
 void ADC0_ISR (void) __interrupt 10  __using 2
 {
-   static SHORTDATA rawValue;
-   static unsigned char da_counter=0;
-   unsigned char ad_ch;
+   unsigned char da_counter, ad_ch, head, hi;
 
    while(!AD0INT);                     // wait till conversion complete
    AD0INT = 0;                         // clear ADC0 conversion complete flag
 
    // copy the output value of the ADC, ignore LSB (keep 16 bits)
-   rawValue.Byte[Byte1] = (unsigned char)ADC0FH;
-   rawValue.Byte[Byte0] = (unsigned char)ADC0FM;
-/*
-	// code for 24 bits
-   rawValue.Byte[Byte0] = (unsigned char)ADC0FL;
-   // sign extend
-   if (rawValue.Byte[Byte2] >= 0)
-   		rawValue.Byte[Byte3] = 0;
+   // if the ring is full (main busy for too long), drop the sample and mark
+   //   the next one queued, so ADC0_Process knows there's a gap before it
+   da_counter = adDaCounter;
+   hi = ADC0FH;
+   head = (adRawHead+1) & (AD_RINGSIZE-1);
+   if (head != adRawTail)
+   {
+      adRawVal[adRawHead] = (hi << 8) | ADC0FM;
+      adRawSlot[adRawHead] = bADOverrun ? da_counter | AD_GAP : da_counter;
+      adRawHead = head;
+      bADOverrun = 0;
+   }
    else
-   		rawValue.Byte[Byte3] = 0xFF;
-*/
-	// get current A/D channel
-	ad_ch = ad_ch_arr[da_counter];
-	// for channels 0 and 1, compute 1st order difference and low-pass filter abs value
-	// this because we have opposite DAC output at each cycle
-	if (ad_ch < 2)
-	{
-		unsigned short temp;
-		temp = adPrevValue[ad_ch];
-
-		// compute(abs(diff(val)))
-		if (rawValue.result > temp)
-			temp = rawValue.result-temp;
-		else
-			temp -= rawValue.result;
-
-		// use 32 bit math for filtering
-		// for each channel we are running at (average) 240/6 = 40 Hz
-		// (one 3/240 s cycle followed by 9/240 s -> 2 cycles in 12/240=1/20 s)
-		// We want a time constant of 2s, so prev values at 1/n after 40*2=80 cycles
-		// 1st order filter y(t)=a*y(t-1)+(1-a)*x(t); a=exp(-1/nCycles)
-		// for nCycles=80 a=0.98758
-		// we could use Q16, but we prefer Q15 to avoid problems with signed/unsigned long
-		// in Q15 a_q15=0.98758*32768=32361; (1-a) becomes 32768-a_q15=407
-		adFiltValue[ad_ch] = (unsigned short)((adFiltValue[ad_ch]*32361L + temp*407L) >> 15);
-
-		// copy A/D value for next cycle
-		adPrevValue[ad_ch] = rawValue.result;
-	}
-	else
-	{
-		// filter pots with 0.2s time constant
-		// each measurement is taken every 3 cycles, or 80 Hz sampling
-		// We want a time constant of 0.2s, so prev values at 1/n after 16 cycles
-		// 1st order filter y(t)=a*y(t-1)+(1-a)*x(t); a=exp(-1/nCycles)
-		// for nCycles=16 a=0.93941
-		// in Q15 a_q15=0.92004*32768=30783; (1-a) becomes 32768-a_q15=1985
-		adFiltValue[ad_ch] = (unsigned short)((adFiltValue[ad_ch]*30783L + rawValue.result*1985L) >> 15);
-	}
-
+      bADOverrun = 1;
 
 	// prepare to acquire next channel
 	da_counter++;
 	if (da_counter == DA_PERIOD)
 		da_counter=0;
+	adDaCounter = da_counter;
 	ad_ch = ad_ch_arr[da_counter];
 
 	// always referred to AGND
@@ -9,21 +9,42 @@
 // Global CONSTANTS
 //-----------------------------------------------------------------------------
 
+#define MDCLK 2450000		// Modulator clock in Hz (ideal is 2.4576 MHz)
+						// SYSCLK/10, or SYSCLK/2/5 with CLKSCALE
 #define N_ADCHANNELS 4		// DACOUT, WDET, WINDSENS, RAINSENS
 #define DA_PERIOD 12
+#define AD_RINGSIZE 16		// raw samples queued between ADC0_ISR and main (power of 2)
+#define AD_GAP 0x80			// slot flag: samples were lost before this one
+#define AD_BURST_SECS 4		// ADC_DUTY: seconds of acquisition in each burst
 
 //-----------------------------------------------------------------------------
 // Global FUNCTIONS
 //-----------------------------------------------------------------------------
 
-void ADC0_Init(void);		// Initialize ADC0
-unsigned short getAD(unsigned char ch);
+void ADC0_Init(void);		// Initialize ADC0, start calibration
+void ADC0_Poll(void);		// start conversions when calibration is complete
+void ADC0_Process(void);	// filter queued samples, call on each wakeup
+void getADSnapshot(unsigned short *val);	// coherent read of all channels
+void ADC0_Off(void);		// power down ADC and excitation
+void ADC0_On(void);			// power up again, fresh snapshot after 2 cycles
+#ifdef ADC_DUTY
+void ADC0_Duty(unsigned char period);		// call every 1s, period 0 = continuous
+#endif
 
 //-----------------------------------------------------------------------------
 // Global VARIABLES
 //-----------------------------------------------------------------------------
 
-
-extern volatile unsigned short adValue[N_ADCHANNELS];	// acquired AI
+extern volatile unsigned short adSnapValue[N_ADCHANNELS];	// coherent copy of filtered AI
+extern volatile unsigned char adSnapSeq;					// incremented on each publish
+extern volatile __bit bADValid;								// all filters seeded, snapshot fresh
+extern __bit bADOff;										// powered down (ADC0_Off)
+extern __bit bADRunning;									// conversions running
+#ifdef ADC_DUTY
+extern __xdata unsigned long adOnSecs, adTotSecs;					// seconds with A/D running, total
+#endif
+#ifdef RACECHECK
+extern __xdata unsigned short race_ad_retry;						// getADSnapshot() retries
+#endif
 
 #endif // _ADC0_H_
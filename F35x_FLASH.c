@@ -0,0 +1,75 @@
+//-----------------------------------------------------------------------------
+// F35x_FLASH.c, from F35x_FlashPrimitives.c by SiLabs
+//-----------------------------------------------------------------------------
+// TENDONI V2
+// rev1 - RV110801
+// flash erase/write/read for persistent data
+//
+// Writes need the VDD monitor enabled as reset source (done by init()).
+// Interrupts are disabled around each MOVX with PSWE set, otherwise a MOVX
+//   in an IRQ would write flash. The CPU stalls during the operation, so the
+//   hardware watchdog is reloaded before each one (a page erase lasts ~20 ms,
+//   the watchdog ~32 ms). Don't use on the page with the lock byte.
+
+#include "C8051F350.h"		// SFR declarations
+#include "main.h"
+#include "F35x_FLASH.h"
+
+
+//-----------------------------------------------------------------------------
+// FLASH_PageErase
+//-----------------------------------------------------------------------------
+void FLASH_PageErase(unsigned short addr)
+{
+	__bit ea_save;
+
+	ea_save = EA;
+	EA = 0;
+	PCA0CPH2 = 0;					// reload watchdog
+	FLKEY = 0xA5;					// unlock for one operation
+	FLKEY = 0xF1;
+	PSCTL = PSEE | PSWE;			// MOVX erases a page
+	*(__xdata unsigned char *)addr = 0;
+	PSCTL = 0;
+	EA = ea_save;
+}
+
+
+//-----------------------------------------------------------------------------
+// FLASH_BufWrite
+//-----------------------------------------------------------------------------
+// destination must be erased
+void FLASH_BufWrite(unsigned short addr, unsigned char *buf, unsigned short len)
+{
+	__bit ea_save;
+	__xdata unsigned char *p;
+	unsigned char c;
+
+	p = (__xdata unsigned char *)addr;
+	while (len--)
+	{
+		c = *buf++;					// read source before enabling flash writes
+		ea_save = EA;
+		EA = 0;
+		PCA0CPH2 = 0;
+		FLKEY = 0xA5;
+		FLKEY = 0xF1;
+		PSCTL = PSWE;				// MOVX writes flash
+		*p++ = c;
+		PSCTL = 0;
+		EA = ea_save;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// FLASH_BufRead
+//-----------------------------------------------------------------------------
+void FLASH_BufRead(unsigned short addr, unsigned char *buf, unsigned short len)
+{
+	__code unsigned char *p;
+
+	p = (__code unsigned char *)addr;
+	while (len--)
+		*buf++ = *p++;
+}
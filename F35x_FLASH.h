@@ -0,0 +1,22 @@
+// F35x_FLASH.h
+// TENDONI V2
+// rev1 - RV110801
+
+#ifndef _FLASH_H_
+#define _FLASH_H_
+
+//-----------------------------------------------------------------------------
+// Global CONSTANTS
+//-----------------------------------------------------------------------------
+
+#define FLASH_PAGESIZE 512	// erase page size
+
+//-----------------------------------------------------------------------------
+// Global FUNCTIONS
+//-----------------------------------------------------------------------------
+
+void FLASH_PageErase(unsigned short addr);	// erase the page containing addr
+void FLASH_BufWrite(unsigned short addr, unsigned char *buf, unsigned short len);
+void FLASH_BufRead(unsigned short addr, unsigned char *buf, unsigned short len);
+
+#endif // _FLASH_H_
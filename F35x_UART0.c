@@ -0,0 +1,129 @@
+//-----------------------------------------------------------------------------
+// F35x_UART0.c
+//-----------------------------------------------------------------------------
+// TENDONI V2
+// rev1 - RV110615
+// interrupt driven UART0 with RX and TX ring buffers
+
+#include "C8051F350.h"		// SFR declarations
+#include "main.h"			// SYSCLK
+#include "F35x_UART0.h"
+
+//-----------------------------------------------------------------------------
+// Global VARIABLES
+//-----------------------------------------------------------------------------
+
+// ring buffers: each index is written by one side only (ISR or main), and
+//   single byte accesses are atomic, so we don't need to disable interrupts
+__xdata unsigned char rxBuf[UART_RXSIZE];
+__xdata unsigned char txBuf[UART_TXSIZE];
+volatile unsigned char rxHead=0, rxTail=0;	// head written by ISR, tail by main
+volatile unsigned char txHead=0, txTail=0;	// head written by main, tail by ISR
+volatile __bit bTxBusy = 0;					// ISR is sending from txBuf
+
+
+//-----------------------------------------------------------------------------
+// UART0_Init
+//-----------------------------------------------------------------------------
+//
+// UART0 in 8 bit mode, baud rate from Timer1 in 8-bit auto-reload mode.
+// TX/RX are on P0.4/P0.5, enabled on the crossbar by PORT_Init().
+//
+void UART0_Init (void)
+{
+	SCON0 = 0x10;						// 8 bit, ignore stop bit level, RX enabled
+
+	// Timer1 clocked by the prescaler: 24.5 MHz/12/2/9600 = 106 counts, 0.3% error
+	// Timer0 counts wind pulses on its pin, so it doesn't use the prescaler
+	TMOD = (TMOD & 0x0F) | 0x20;		// Timer1 mode 2, don't touch Timer0
+	CKCON = (CKCON & ~0x0B) | UART_SCA;	// T1M=0, SCA: Timer1 uses the prescaler
+	TH1 = UART_TH1(SYSCLK);
+	TL1 = TH1;							// init Timer1
+	TR1 = 1;							// start Timer1
+
+	ES0 = 1;							// enable UART0 interrupts
+}
+
+
+// get next received byte, or -1 if RX buffer is empty
+int UART0_GetChar(void)
+{
+	unsigned char c;
+
+	if (rxTail == rxHead)
+		return -1;
+
+	c = rxBuf[rxTail];
+	rxTail = (rxTail+1) & (UART_RXSIZE-1);
+	return c;
+}
+
+
+// queue len bytes for transmission
+// all or nothing: return -1 if they don't fit, 0 if queued
+char UART0_Write(unsigned char *buf, unsigned char len)
+{
+	unsigned char head;
+
+	if (((txTail-txHead-1) & (UART_TXSIZE-1)) < len)
+		return -1;
+
+	head = txHead;
+	while (len--)
+	{
+		txBuf[head] = *buf++;
+		head = (head+1) & (UART_TXSIZE-1);
+	}
+	// publish the new bytes with a single write
+	txHead = head;
+
+	// start transmission if idle: the ISR will send the first byte
+	if (!bTxBusy)
+	{
+		bTxBusy = 1;
+		TI0 = 1;
+	}
+	return 0;
+}
+
+
+// =1 until all queued bytes are sent (last one may still be shifting out)
+__bit UART0_Busy(void)
+{
+	return bTxBusy;
+}
+
+
+//-----------------------------------------------------------------------------
+// UART0_ISR
+//-----------------------------------------------------------------------------
+//
+// Store received bytes (drop them if RX buffer is full), send queued bytes.
+//
+void UART0_ISR (void) __interrupt 4 __using 3
+{
+	if (RI0)
+	{
+		unsigned char head;
+
+		RI0 = 0;
+		head = (rxHead+1) & (UART_RXSIZE-1);
+		if (head != rxTail)
+		{
+			rxBuf[rxHead] = SBUF0;
+			rxHead = head;
+		}
+	}
+
+	if (TI0)
+	{
+		TI0 = 0;
+		if (txTail != txHead)
+		{
+			SBUF0 = txBuf[txTail];
+			txTail = (txTail+1) & (UART_TXSIZE-1);
+		}
+		else
+			bTxBusy = 0;
+	}
+}
@@ -0,0 +1,32 @@
+// F35x_UART0.h
+// TENDONI V2
+// rev1 - RV110615
+
+#ifndef _UART0_H_
+#define _UART0_H_
+
+//-----------------------------------------------------------------------------
+// Global CONSTANTS
+//-----------------------------------------------------------------------------
+
+// Timer1 prescaler, chosen so the reload is exact to 0.3% both at SYSCLK
+//   and at SYSCLK/2 (CLKSCALE): 106 or 53 counts
+// the peer unit runs at the same rate, also in TRACEMODE (see trace.h)
+#define BAUDRATE 9600		// UART0 baud rate
+#define UART_PRESCALE 12
+#define UART_SCA 0x00		// CKCON.SCA for SYSCLK/12
+// Timer1 reload for BAUDRATE with Timer1 clocked by <clk>/UART_PRESCALE, rounded
+#define UART_TH1(clk) (-(((clk)/UART_PRESCALE/BAUDRATE+1)/2))
+#define UART_RXSIZE 16		// RX ring buffer size (power of 2)
+#define UART_TXSIZE 32		// TX ring buffer size (power of 2)
+
+//-----------------------------------------------------------------------------
+// Global FUNCTIONS
+//-----------------------------------------------------------------------------
+
+void UART0_Init(void);		// Initialize UART0 and Timer1 (baud rate)
+int UART0_GetChar(void);	// next received byte, -1 if none
+char UART0_Write(unsigned char *buf, unsigned char len);	// queue bytes, -1 if no room
+__bit UART0_Busy(void);		// =1 until all queued bytes are sent
+
+#endif // _UART0_H_
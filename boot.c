@@ -0,0 +1,362 @@
+//-----------------------------------------------------------------------------
+// boot.c
+// TENDONI V2
+// rev1 - RV110626
+// resident serial bootloader, built as a separate image (build.sh boot)
+//-----------------------------------------------------------------------------
+// Flash layout (C8051F350, 512 byte pages):
+//   0x0000-0x03FF  bootloader (this file)
+//   0x0400-0x1BFF  application, linked with --code-loc 0x0400
+//   0x1C00-0x1DFF  page of the security lock byte (0x1DFF): never erased nor
+//                  written, erasing it would clear the lock byte (or reset
+//                  the MCU with a flash error if the flash is locked)
+// Interrupt vectors are forwarded to the application (BOOT_APP+vector).
+//
+// The bootloader stays active after a software reset (requested by the
+//   application), when no application is present (first byte erased), or
+//   if BOOT_SYNC is received within BOOT_WAIT ms of reset. Otherwise it jumps
+//   to the application.
+//
+// Protocol on UART0 (P0.4/P0.5, BOOT_BAUD, 8N1, uploader in host/upload.c),
+//   all replies are one byte:
+//   BOOT_SYNC                                  -> BOOT_HELLO
+//   'W' addr_hi addr_lo len data[len] crc_hi crc_lo
+//                                              -> BOOT_ACK / BOOT_NAK
+//       len <= BOOT_BLOCK, CRC16-CCITT (0xFFFF) over addr_hi..data; a block
+//       starting on a page boundary erases the page first, a block must not
+//       cross into the next page. A timeout aborts the block with BOOT_NAK.
+//   'G'                                        -> BOOT_ACK, start application
+// The first application byte (BOOT_APP, the ljmp of its reset vector) is
+//   held back when its block is written and only programmed by 'G', after
+//   all other blocks: until then it stays erased, so an interrupted update
+//   is never started and the bootloader stays active after a reset.
+//
+// Relays are kept in their safe state (RL_AUTO=0, TRIAC_OFF=1) and the
+//   watchdog is serviced while waiting for bytes and before flash operations.
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include "C8051F350.H"			// SFR declarations
+
+//-----------------------------------------------------------------------------
+// Global CONSTANTS
+//-----------------------------------------------------------------------------
+
+#define SYSCLK (24500000)	// SYSCLK frequency in Hz (internal oscillator)
+#define BOOT_BAUD 57600		// UART0 baud rate
+#define BOOT_APP 0x0400		// application start
+#define BOOT_END 0x1C00		// first address not writable (lock byte page)
+#define BOOT_PAGE 512		// flash page size
+#define BOOT_BLOCK 64		// max data bytes per block
+#define BOOT_WAIT 50		// ms to wait for BOOT_SYNC after reset
+
+#define BOOT_SYNC 'U'
+#define BOOT_HELLO 'B'
+#define BOOT_ACK 'A'
+#define BOOT_NAK 'N'
+
+//-----------------------------------------------------------------------------
+// Function PROTOTYPES
+//-----------------------------------------------------------------------------
+void main(void);
+void boot_loop(void);
+int boot_getc(unsigned short timeout);
+void boot_putc(unsigned char c);
+unsigned short boot_crc(unsigned short crc, unsigned char c);
+void boot_flash(unsigned short addr, unsigned char *buf, unsigned char len);
+void boot_write(unsigned short addr, unsigned char c);
+void boot_flash_key(void);
+void boot_wd(void);
+void boot_run_app(void);
+
+//-----------------------------------------------------------------------------
+// Global VARIABLES
+//-----------------------------------------------------------------------------
+__xdata unsigned char block[BOOT_BLOCK];
+unsigned char app_first;		// byte for BOOT_APP, written by 'G'
+__bit bAppFirst = 0;			// app_first is pending
+
+//-----------------------------------------------------------------------------
+// Interrupt vectors, forwarded to the application
+//-----------------------------------------------------------------------------
+void boot_uart0(void) __interrupt 4 __naked
+{
+	__asm
+	ljmp	(0x0400+0x23)
+	__endasm;
+}
+
+void boot_timer2(void) __interrupt 5 __naked
+{
+	__asm
+	ljmp	(0x0400+0x2B)
+	__endasm;
+}
+
+void boot_adc0(void) __interrupt 10 __naked
+{
+	__asm
+	ljmp	(0x0400+0x53)
+	__endasm;
+}
+
+
+// keep the watchdog running (it's enabled at reset), but with the longest
+//   timeout, which is ~32 ms at 24.5 MHz
+unsigned char _sdcc_external_startup()
+{
+	PCA0MD &= ~0x40;					// WDTE = 0, required to change PCA0CPL2
+	PCA0CPL2 = 0xFF;
+	PCA0MD |= 0x40;						// WDTE = 1, not locked (application locks it)
+	PCA0CPH2 = 0;
+
+	return 0;
+}
+
+
+void main(void)
+{
+	__bit bStay;
+
+	// relays in safe state, as in PORT_Init(): RL_AUTO=0, TRIAC_OFF=1
+	P1MDOUT = 0x1F;
+	P1 = 0x0A;
+
+	// stay in bootloader if requested by application (software reset) or
+	//   if there's no application
+	bStay = (RSTSRC & SWRSF) || *(__code unsigned char *)BOOT_APP == 0xFF;
+
+	// 24.5 MHz, VDD monitor as reset source (required for flash writes)
+	OSCICN = 0x83;
+	VDM0CN = 0x80;
+	boot_wd();
+	{
+		unsigned short i;
+		for (i=0; i<350; i++);	// wait 100us for VDD monitor
+	}
+	RSTSRC = 0x02;
+
+	// UART0 on P0.4/P0.5, Timer1 mode 2 clocked by SYSCLK
+	P0MDOUT = 0x10;
+	XBR0 = 0x01;
+	XBR1 = 0x40;
+	SCON0 = 0x10;
+	TMOD = 0x20;
+	CKCON = 0x08;						// T1M=1
+	TH1 = -(SYSCLK/BOOT_BAUD/2);
+	TL1 = TH1;
+	TR1 = 1;
+
+	if (bStay || boot_getc(BOOT_WAIT) == BOOT_SYNC)
+	{
+		boot_putc(BOOT_HELLO);
+		boot_loop();
+	}
+
+	boot_run_app();
+}
+
+
+// handle commands until 'G'
+void boot_loop(void)
+{
+	int c;
+
+	while (1)
+	{
+		c = boot_getc(0);
+		if (c == BOOT_SYNC)
+			boot_putc(BOOT_HELLO);
+		else if (c == 'G')
+		{
+			if (bAppFirst)
+				boot_write(BOOT_APP, app_first);
+			boot_putc(BOOT_ACK);
+			// let the last byte go out
+			while (!TI0)
+				boot_wd();
+			return;
+		}
+		else if (c == 'W')
+		{
+			unsigned short addr, crc;
+			unsigned char hdr[3], len, i;
+			__bit bOk = 1;
+
+			// header: addr_hi, addr_lo, len, abort on timeout
+			crc = 0xFFFF;
+			for (i=0; i<3; i++)
+			{
+				c = boot_getc(1000);
+				if (c < 0)
+					break;
+				hdr[i] = c;
+				crc = boot_crc(crc, c);
+			}
+			if (i < 3 || hdr[2] > BOOT_BLOCK)
+			{
+				boot_putc(BOOT_NAK);
+				continue;
+			}
+			addr = (hdr[0] << 8) | hdr[1];
+			len = hdr[2];
+
+			// data and crc
+			for (i=0; i<len; i++)
+			{
+				c = boot_getc(1000);
+				if (c < 0)
+					bOk = 0;
+				block[i] = c;
+				crc = boot_crc(crc, c);
+			}
+			c = boot_getc(1000);
+			if (c < 0 || (unsigned char)c != (unsigned char)(crc >> 8))
+				bOk = 0;
+			c = boot_getc(1000);
+			if (c < 0 || (unsigned char)c != (unsigned char)crc)
+				bOk = 0;
+
+			// never touch the bootloader or the lock byte; stay in one page,
+			//   so only pages erased by their first block are written
+			if (addr < BOOT_APP || addr+len > BOOT_END ||
+				(addr & (BOOT_PAGE-1))+len > BOOT_PAGE)
+				bOk = 0;
+
+			if (bOk)
+			{
+				boot_flash(addr, block, len);
+				boot_putc(BOOT_ACK);
+			}
+			else
+				boot_putc(BOOT_NAK);
+		}
+	}
+}
+
+
+// get a byte, wait at most timeout ms (0: forever), return -1 on timeout
+// ms are counted by Timer0 overflows (SYSCLK/48, 0x10000-510 counts = 1 ms)
+int boot_getc(unsigned short timeout)
+{
+	TMOD = (TMOD & 0xF0) | 0x01;		// Timer0 mode 1
+	CKCON = (CKCON & ~0x07) | 0x02;		// SCA=10: SYSCLK/48
+	TMR0 = -(SYSCLK/48/1000);
+	TF0 = 0;
+	TR0 = 1;
+
+	while (!RI0)
+	{
+		boot_wd();
+		if (TF0)
+		{
+			TR0 = 0;
+			TMR0 = -(SYSCLK/48/1000);
+			TF0 = 0;
+			TR0 = 1;
+			if (timeout && --timeout == 0)
+			{
+				TR0 = 0;
+				return -1;
+			}
+		}
+	}
+	TR0 = 0;
+	RI0 = 0;
+	return (unsigned char)SBUF0;
+}
+
+
+void boot_putc(unsigned char c)
+{
+	TI0 = 0;
+	SBUF0 = c;
+	while (!TI0)
+		boot_wd();
+}
+
+
+// CRC16-CCITT, polynomial 0x1021
+unsigned short boot_crc(unsigned short crc, unsigned char c)
+{
+	unsigned char i;
+
+	crc ^= (unsigned short)c << 8;
+	for (i=0; i<8; i++)
+		crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	return crc;
+}
+
+
+// write a block, erasing the page first if the block starts on a page boundary
+// the byte at BOOT_APP is kept in app_first, see 'G'
+void boot_flash(unsigned short addr, unsigned char *buf, unsigned char len)
+{
+	if ((addr & (BOOT_PAGE-1)) == 0)
+	{
+		boot_wd();
+		boot_flash_key();
+		PSCTL = PSEE | PSWE;			// MOVX erases a page
+		*(__xdata unsigned char *)addr = 0;
+		PSCTL = 0;
+	}
+
+	if (addr == BOOT_APP && len)
+	{
+		app_first = *buf++;
+		bAppFirst = 1;
+		addr++;
+		len--;
+	}
+
+	while (len--)
+		boot_write(addr++, *buf++);
+}
+
+
+// write a byte to flash (erased before)
+void boot_write(unsigned short addr, unsigned char c)
+{
+	boot_wd();
+	boot_flash_key();
+	PSCTL = PSWE;						// MOVX writes flash
+	*(__xdata unsigned char *)addr = c;
+	PSCTL = 0;
+}
+
+
+// unlock flash for one write/erase
+void boot_flash_key(void)
+{
+	FLKEY = 0xA5;
+	FLKEY = 0xF1;
+}
+
+
+// reload watchdog
+void boot_wd(void)
+{
+	PCA0CPH2 = 0;
+}
+
+
+// restore reset state of the peripherals we used, then start the application
+void boot_run_app(void)
+{
+	SCON0 = 0;
+	TR1 = 0;
+	TMOD = 0;
+	CKCON = 0;
+	TH1 = 0;
+	TL1 = 0;
+	TMR0 = 0;
+	XBR1 = 0;
+	XBR0 = 0;
+	P0MDOUT = 0;
+	boot_wd();
+
+	__asm
+	ljmp	0x0400
+	__endasm;
+}
@@ -0,0 +1,126 @@
+#!/bin/sh
+# build.sh
+# TENDONI V2
+# rev1 - RV110816
+# command line build with SDCC, two separate images:
+#   app   BATMON.ihx, modules of the IDE project (CFiles of TENDONI V2.WSP),
+#         linked at 0x0400 behind the bootloader, then checked by memcheck.sh
+#   boot  boot.ihx, resident bootloader (boot.c) at 0x0000-0x03FF
+#   host  native build of both with the host compiler (HOSTCC, default cc)
+#         on the chip model host/hw.c, and the host tools, in host/out
+#   check host, then the regression checks of the host tools (for CI)
+# usage: build.sh [app|boot|all|host|check]   (default all)
+# SDCCFLAGS and HOSTFLAGS add options (-D of main.h) to the firmware sources
+#
+# flash: 0x0000-0x03FF boot, 0x0400-0x1BFF application (6144 bytes),
+#   0x1C00-0x1DFF page of the lock byte, left alone (see boot.c)
+
+SDCC=${SDCC:-sdcc}
+WSP="TENDONI V2.WSP"
+OUT=BATMON
+DIFFFLAGS="-DSIMWEATHER -DSTATEDUMP -DSIMNOAD"	# difftest, host/ucsim.sh
+
+cd "$(dirname "$0")" || exit 1
+
+build_app()
+{
+	FILES=$(awk '/^\[/ { f = /^\[WorkState_v1_1\.CFiles/ } f && sub(/^FileName=/, "") { print }' "$WSP")
+	RELS=""
+	for f in $FILES; do
+		$SDCC -c --opt-code-size --debug $SDCCFLAGS "$f" || exit 1
+		RELS="$RELS ${f%.c}.rel"
+	done
+	$SDCC --debug --code-loc 0x0400 --code-size 0x1800 --xram-size 512 -o $OUT.ihx $RELS || exit 1
+	# RAM and flash budgets, fails the build if exceeded
+	sh ./memcheck.sh $OUT.mem || exit 1
+}
+
+build_boot()
+{
+	$SDCC --opt-code-size --code-loc 0x0000 --code-size 0x0400 -o boot.ihx boot.c || exit 1
+}
+
+# same sources, seen through host/hw.h: SDCC-only syntax removed, flash
+#   pointers and PSCTL writes go through the model
+build_host()
+{
+	HOSTCC=${HOSTCC:-cc}
+	H=host/out
+	mkdir -p $H/src || exit 1
+	for f in *.c *.h; do
+		sed -e 's/__interrupt *[0-9]*//' -e 's/__using *[0-9]*//' -e '/__asm/,/__endasm/d' \
+			-e 's/(__xdata unsigned char \*)\([A-Za-z_][A-Za-z0-9_]*\)/HW_XWIN(\1)/g' \
+			-e 's/(__code unsigned char \*)\([A-Za-z_][A-Za-z0-9_]*\)/HW_CODE(\1)/g' \
+			-e 's/PSCTL = \([^;]*\);/hw_psctl(\1);/' "$f" > $H/src/$f || exit 1
+	done
+	echo '#include "hw.h"' > $H/src/C8051F350.h
+	echo '#include "hw.h"' > $H/src/C8051F350.H
+	FW="-O2 -g -w -fcommon -Ihost -Dmain=hw_main $HOSTFLAGS"
+	FILES=$(awk '/^\[/ { f = /^\[WorkState_v1_1\.CFiles/ } f && sub(/^FileName=/, "") { print }' "$WSP")
+	APP=""
+	for f in $FILES; do
+		$HOSTCC $FW -c $H/src/$f -o $H/${f%.c}.o || exit 1
+		APP="$APP $H/${f%.c}.o"
+	done
+	$HOSTCC $FW -DHW_POLL -c $H/src/boot.c -o $H/boot.o || exit 1
+	$HOSTCC -O2 -g -Wall -c host/hw.c -o $H/hw.o || exit 1
+	$HOSTCC -O2 -g -Wall -Ihost host/run.c $H/hw.o $APP -o $H/run || exit 1
+	$HOSTCC -O2 -g -Wall -Ihost host/tendonid.c $H/hw.o $APP -o $H/tendonid || exit 1
+	$HOSTCC -O3 -g -Wall -pthread host/kverify.c -o $H/kverify || exit 1
+	$HOSTCC -O2 -g -Wall -Ihost host/latbench.c $H/hw.o $APP -o $H/latbench || exit 1
+	# explore: the same objects with a call before each memory access
+	XAPP=""
+	mkdir -p $H/x || exit 1
+	for f in $FILES; do
+		$HOSTCC $FW -fsanitize=thread -c $H/src/$f -o $H/x/${f%.c}.o || exit 1
+		XAPP="$XAPP $H/x/${f%.c}.o"
+	done
+	$HOSTCC -O2 -g -Wall -no-pie -Ihost host/explore.c $H/hw.o $XAPP -o $H/explore || exit 1
+	$HOSTCC -O2 -g -Wall -Ihost host/startup.c $H/hw.o $APP -o $H/startup || exit 1
+	# difftest: the build compared with the .ihx in ucsim (host/ucsim.sh)
+	DAPP=""
+	mkdir -p $H/d || exit 1
+	for f in $FILES; do
+		$HOSTCC $FW $DIFFFLAGS -c $H/src/$f -o $H/d/${f%.c}.o || exit 1
+		DAPP="$DAPP $H/d/${f%.c}.o"
+	done
+	$HOSTCC -O2 -g -Wall -Ihost host/difftest.c $H/hw.o $DAPP -o $H/difftest || exit 1
+	# mc: fleet Monte Carlo, validated (-v) on the same objects
+	$HOSTCC -O3 -march=native -g -Wall -pthread -Ihost -Wl,--wrap=link_send host/mc.c $H/hw.o $DAPP -o $H/mc || exit 1
+	# trc: trace recorder and replay, on a TRACEMODE build
+	TAPP=""
+	mkdir -p $H/t || exit 1
+	for f in $FILES; do
+		$HOSTCC $FW -DTRACEMODE -c $H/src/$f -o $H/t/${f%.c}.o || exit 1
+		TAPP="$TAPP $H/t/${f%.c}.o"
+	done
+	$HOSTCC -O2 -g -Wall -Ihost host/trc.c $H/hw.o $TAPP -o $H/trc || exit 1
+	$HOSTCC -O2 -g -Wall -Ihost host/upload.c $H/hw.o $H/boot.o -o $H/upload || exit 1
+	$HOSTCC -O2 -g -Wall -Ihost host/soak.c host/weather.c $H/hw.o $APP -lm -o $H/soak || exit 1
+}
+
+# kernels on a subset (kverify without -s for the full sweep), latencies
+#   against the reference (latbench -w host/latbench.ref after an intended change),
+#   IRQ interleavings of a dry pass and of one with the tents up on rain, the
+#   Monte Carlo model against the firmware, a trace recorded and replayed
+#   back into the firmware, a full update cut by a power loss then redone
+check_host()
+{
+	host/out/kverify -s 64 || exit 1
+	host/out/latbench -c host/latbench.ref || exit 1
+	host/out/explore || exit 1
+	host/out/explore -t 100 -r 8000 || exit 1
+	host/out/mc -n 256 -d 0.25 -v 4 || exit 1
+	host/out/trc -o host/out/check.trc -t 600 -w 137 -r 20000 || exit 1
+	host/out/trc -p -c host/out/check.trc || exit 1
+	host/out/upload -s -k 40 -z 6144 || exit 1
+}
+
+case "${1:-all}" in
+app)	build_app ;;
+boot)	build_boot ;;
+all)	build_boot; build_app ;;
+host)	build_host ;;
+check)	build_host; check_host ;;
+*)		echo "usage: $0 [app|boot|all|host|check]"; exit 1 ;;
+esac
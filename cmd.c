@@ -0,0 +1,296 @@
+//-----------------------------------------------------------------------------
+// cmd.c
+// TENDONI V2
+// rev1 - RV110702
+// command/query protocol on the serial link
+//-----------------------------------------------------------------------------
+// Requests arrive as link frames and are parsed incrementally by link_poll()
+//   in the main loop, so they never delay the 1s loop or the watchdog.
+// A move is only recorded here and executed by main(), since it blocks; so is
+//   the return to automatic mode, which restarts the hold before automatic down.
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include "C8051F350.h"		// SFR declarations
+#include "main.h"
+#include "F35x_ADC0.h"
+#include "F35x_UART0.h"
+#include "link.h"
+#include "cmd.h"
+#include "sim.h"
+#include "lat.h"
+#include "hist.h"
+#include "detect.h"
+#include "hold.h"
+
+//-----------------------------------------------------------------------------
+// Function PROTOTYPES
+//-----------------------------------------------------------------------------
+void cmd_status(void);
+void cmd_unit(unsigned char type, unsigned char *payload, unsigned char len);
+void cmd_ack(unsigned char type, unsigned char result);
+unsigned char cmd_set(unsigned char id, unsigned short val);
+
+//-----------------------------------------------------------------------------
+// Global VARIABLES
+//-----------------------------------------------------------------------------
+char cmd_move = -1;
+__bit bCmdAuto = 0;
+
+
+// handle a request
+// replies (type | CMD_REPLY) are never handled, so two units on the link
+//   don't answer each other; all requests carry the target unit first and
+//   are ignored by the other units, so only one of them replies
+void cmd_frame(unsigned char type, unsigned char *payload, unsigned char len)
+{
+	if (type & CMD_REPLY)
+		return;
+	if (len == 0 || payload[0] != LINK_UNIT_ID)
+		return;
+	payload++;
+	len--;
+
+	switch (type)
+	{
+	case CMD_T_MOVE:
+	case CMD_T_AUTO:
+	case CMD_T_SET:
+	case CMD_T_BOOT:
+		cmd_unit(type, payload, len);
+		return;
+	}
+
+	// queries
+	switch (type)
+	{
+	case CMD_T_STATUS:
+		if (len != 0)
+			break;
+		cmd_status();
+		return;
+
+	case CMD_T_HOLD:
+		if (len != 0)
+			break;
+		hold_stats();
+		return;
+
+#ifdef SIMWEATHER
+	case CMD_T_SIMSTATS:
+		if (len != 0)
+			break;
+		sim_stats();
+		return;
+#endif
+
+#ifdef LATSTATS
+	case CMD_T_LATSTATS:
+		if (len != 1)
+			break;
+		lat_stats(payload[0]);
+		return;
+#endif
+
+#ifdef HISTSTATS
+	case CMD_T_HIST:
+		if (len != 2)
+			break;
+		hist_request(payload[0], payload[1]);
+		return;
+#endif
+
+#ifdef ADC_DUTY
+	case CMD_T_ADDUTY:
+		if (len != 0)
+			break;
+		{
+			unsigned char buf[8], i;
+			unsigned long on = adOnSecs, tot = adTotSecs;
+
+			for (i=0; i<4; i++)
+			{
+				buf[i] = (unsigned char)on;
+				buf[4+i] = (unsigned char)tot;
+				on >>= 8;
+				tot >>= 8;
+			}
+			link_send(CMD_REPLY | CMD_T_ADDUTY, buf, 8);
+		}
+		return;
+#endif
+
+#ifdef RACECHECK
+	case CMD_T_RACE:
+		if (len != 0)
+			break;
+		{
+			unsigned char buf[4];
+
+			buf[0] = (unsigned char)race_ad_retry;
+			buf[1] = (unsigned char)(race_ad_retry >> 8);
+			buf[2] = (unsigned char)race_tm0_retry;
+			buf[3] = (unsigned char)(race_tm0_retry >> 8);
+			link_send(CMD_REPLY | CMD_T_RACE, buf, 4);
+		}
+		return;
+#endif
+
+	default:
+		// not a command (e.g. broadcasts of the other unit)
+		return;
+	}
+
+	// malformed query
+	cmd_ack(type, 1);
+}
+
+
+// handle a command addressed to this unit, payload after the unit id
+// while a move is running (link_keepalive() from wait_seconds()) another move
+//   or a reset would act with the relays energized: both are refused
+void cmd_unit(unsigned char type, unsigned char *payload, unsigned char len)
+{
+	switch (type)
+	{
+	case CMD_T_MOVE:
+		if (len != 1 || payload[0] > 1 || bMoving)
+			cmd_ack(type, 1);
+		else
+		{
+			cmd_move = payload[0];
+			cmd_ack(type, 0);
+		}
+		break;
+
+	case CMD_T_AUTO:
+		if (len != 0)
+		{
+			cmd_ack(type, 1);
+			break;
+		}
+		// as after power on: automatic down allowed after the hold time,
+		//   main restarts the hold (see bCmdAuto)
+		bCmdAuto = 1;
+		cmd_ack(type, 0);
+		break;
+
+	case CMD_T_SET:
+		cmd_ack(type, len == 3 ? cmd_set(payload[0], payload[1] | (payload[2] << 8)) : 1);
+		break;
+
+	case CMD_T_BOOT:
+		if (len != 0 || bMoving)
+		{
+			cmd_ack(type, 1);
+			break;
+		}
+		cmd_ack(type, 0);
+		// wait for the reply to go out, then software reset: boot.c stays active
+		while (UART0_Busy())
+		{
+			WDcnt = SOFT_WD_COUNTS;
+			PCON = PCON_IDLE;	// woken by UART0 (TX done) or Timer2
+		}
+		RSTSRC = 0x16;
+		break;
+	}
+}
+
+
+// reply with status:
+//   flags (bit0 bDown, bit1 bAutoDown, bit2 A/D valid, bit3 peer alarm),
+//   auto_down_timer, water_threshold, wd, wd_th (lo, hi), dc_th
+void cmd_status(void)
+{
+	unsigned char buf[10];
+
+	buf[0] = (bDown ? 0x01:0) | (bAutoDown ? 0x02:0) | (bADValid ? 0x04:0) |
+		(link_peer_alarm() ? 0x08:0);
+	buf[1] = (unsigned char)auto_down_timer;
+	buf[2] = (unsigned char)(auto_down_timer >> 8);
+	buf[3] = (unsigned char)water_threshold;
+	buf[4] = (unsigned char)(water_threshold >> 8);
+	buf[5] = (unsigned char)last_wd;
+	buf[6] = (unsigned char)(last_wd >> 8);
+	buf[7] = (unsigned char)last_wd_th;
+	buf[8] = (unsigned char)(last_wd_th >> 8);
+	buf[9] = last_dc_th;
+	link_send(CMD_REPLY | CMD_T_STATUS, buf, 10);
+}
+
+
+void cmd_ack(unsigned char type, unsigned char result)
+{
+	unsigned char buf[2];
+
+	buf[0] = type;
+	buf[1] = result;
+	link_send(CMD_T_ACK, buf, 2);
+}
+
+
+// set a runtime override, return 0 if ok, 1 if id or value are not valid
+unsigned char cmd_set(unsigned char id, unsigned short val)
+{
+	switch (id)
+	{
+	case CMD_SET_WIND_GUST_TIME:
+		if (val < 1 || val > 255)
+			return 1;
+		wind_gust_time = val;
+		break;
+
+	case CMD_SET_WIND_GUST_EVENTS:
+		if (val < 2 || val > WIND_GUST_EVENTS_MAX)
+			return 1;
+		wind_gust_events = val;
+		break;
+
+	case CMD_SET_WATER_ALM_TIME:
+		if (val < 1 || val > 255)
+			return 1;
+		water_alm_time = val;
+		break;
+
+#ifdef SIMWEATHER
+	case CMD_SET_SIM_SEED:
+		return sim_seed(val);
+#endif
+
+	case CMD_SET_HOLD_WIND_MIN:
+		if (val > hold_wind_max)
+			return 1;
+		hold_wind_min = val;
+		break;
+
+	case CMD_SET_HOLD_WIND_MAX:
+		if (val < hold_wind_min)
+			return 1;
+		hold_wind_max = val;
+		break;
+
+	case CMD_SET_HOLD_RAIN_MIN:
+		if (val > hold_rain_max)
+			return 1;
+		hold_rain_min = val;
+		break;
+
+	case CMD_SET_HOLD_RAIN_MAX:
+		if (val < hold_rain_min)
+			return 1;
+		hold_rain_max = val;
+		break;
+
+	case CMD_SET_HOLD_CALM_TIME:
+		if (val < 1)
+			return 1;
+		hold_calm_time = val;
+		break;
+
+	default:
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,58 @@
+// cmd.h
+// TENDONI V2
+// rev1 - RV110702
+// command/query protocol on the serial link
+
+#ifndef _CMD_H_
+#define _CMD_H_
+
+//-----------------------------------------------------------------------------
+// Global CONSTANTS
+//-----------------------------------------------------------------------------
+
+// requests (link frames, see link.h), each one is answered with type | CMD_REPLY
+//   (lowercase), or CMD_T_ACK with result 1 if malformed; replies are never
+//   handled as requests
+// all requests start with the target unit (LINK_UNIT_ID), other units ignore
+//   them without reply; payloads below are after the unit
+// M and X are refused (result 1) while the tents are moving
+#define CMD_REPLY 0x20
+#define CMD_T_STATUS 'S'	// no payload -> reply, see cmd_status()
+#define CMD_T_MOVE 'M'		// 1=up/0=down -> CMD_T_ACK
+#define CMD_T_AUTO 'A'		// re-enable automatic mode -> CMD_T_ACK
+#define CMD_T_SET 'O'		// id, value lo, value hi: runtime override -> CMD_T_ACK
+#define CMD_T_BOOT 'X'		// restart in bootloader (boot.c) -> CMD_T_ACK
+// CMD_T_SIMSTATS 'Z' in sim.h (SIMWEATHER only)
+// CMD_T_LATSTATS 'L' in lat.h (LATSTATS only)
+// CMD_T_HIST 'G' in hist.h (HISTSTATS only)
+// CMD_T_HOLD 'P' in hold.h
+#define CMD_T_ADDUTY 'D'	// ADC_DUTY only: no payload -> A/D on s, total s (4 bytes each, lo first)
+#define CMD_T_RACE 'R'		// RACECHECK only: no payload -> A/D and tm0 retries (lo, hi)
+// reply to commands: command type, result (0=ok)
+#define CMD_T_ACK (CMD_REPLY | 'K')
+
+// override ids for CMD_T_SET
+#define CMD_SET_WIND_GUST_TIME 0	// 1-255 s
+#define CMD_SET_WIND_GUST_EVENTS 1	// 2-WIND_GUST_EVENTS_MAX
+#define CMD_SET_WATER_ALM_TIME 2	// 1-255 s
+#define CMD_SET_SIM_SEED 3			// SIMWEATHER only: 1-65535, restarts weather and stats
+#define CMD_SET_HOLD_WIND_MIN 4		// 0-max s, used from the next hold
+#define CMD_SET_HOLD_WIND_MAX 5		// min-65535 s
+#define CMD_SET_HOLD_RAIN_MIN 6		// 0-max s
+#define CMD_SET_HOLD_RAIN_MAX 7		// min-65535 s
+#define CMD_SET_HOLD_CALM_TIME 8	// 1-65535 s
+
+//-----------------------------------------------------------------------------
+// Global FUNCTIONS
+//-----------------------------------------------------------------------------
+
+void cmd_frame(unsigned char type, unsigned char *payload, unsigned char len);
+
+//-----------------------------------------------------------------------------
+// Global VARIABLES
+//-----------------------------------------------------------------------------
+
+extern char cmd_move;		// move requested: -1 none, 0 down, 1 up
+extern __bit bCmdAuto;		// automatic mode requested
+
+#endif // _CMD_H_
@@ -0,0 +1,171 @@
+//-----------------------------------------------------------------------------
+// det_water.c
+// TENDONI V2
+// rev1 - RV110808
+// water detector: sensor ratio against an adaptive threshold
+//-----------------------------------------------------------------------------
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include "C8051F350.h"		// SFR declarations
+#include "main.h"
+#include "F35x_ADC0.h"
+#include "detect.h"
+#include "kernels.h"
+#include "hist.h"
+#include "lat.h"
+
+//-----------------------------------------------------------------------------
+// Function PROTOTYPES
+//-----------------------------------------------------------------------------
+void det_water_adapt(unsigned short wd, unsigned short wd_th);
+
+//-----------------------------------------------------------------------------
+// Global VARIABLES
+//-----------------------------------------------------------------------------
+__idata unsigned short water_threshold=0, wd_th_prev1=0, wd_th_prev2=0, water_min=65535;
+__idata unsigned char water_cnt=0;
+__idata unsigned short last_wd=0, last_wd_th=0;
+
+
+void det_water_init(void)
+{
+}
+
+
+// check water: ratio of p-p measurement after and before R29
+// use dynamic threshold to allow reduced sensitivity after an alarm or
+//   after manual command down in case of sensor not completely dry
+// alarm after water_alm_time s of consecutive pre-alarms
+unsigned char det_water_second(void)
+{
+	unsigned short wd, wd_th, wd_a, wd_b;
+	short wd_th_delta;
+	__bit water_pre;
+
+	wd_b = ad[0];
+	wd_a = ad[1];
+	// wd_a*65536L/wd_b, shift instead of 32 bit multiply
+	wd = K_WD_RATIO(wd_a, wd_b);
+	water_pre = wd < water_threshold;
+#ifdef HISTSTATS
+	hist_water(wd, water_threshold);
+#endif
+
+	// update threshold according to status
+	// with R29=22k we have for wd:
+	// short:5800, open:50447, 1k:8800, 10k:23700, 100k:35200
+	// a good value seems to be around 14k, so we allow a range 8192-40960
+	// wd_th is the user setpoint
+	wd_th = K_WD_TH(ad[3]);
+	last_wd = wd;
+	last_wd_th = wd_th;
+
+	// check if manually changed by rotating the pot: in this case align
+	//   water_threshold with setpoint, otherwise calibration becomes difficult
+	// compare with value 2s before, to be reasonably sure to catch trimmer rotation
+	// (we monitor variation over last 2 cycles, but we repeat check on each cycle)
+	wd_th_delta = (short)(wd_th-wd_th_prev2);
+	if ((wd_th_delta > 1000) || (wd_th_delta < -1000))
+	{
+		// reset threshold
+		water_threshold = wd_th;
+	}
+	wd_th_prev2 = wd_th_prev1;
+	wd_th_prev1 = wd_th;
+
+	det_water_adapt(wd, wd_th);
+
+	// WATER_ALM_TIME s consecutive (runtime value water_alm_time)
+	water_cnt = water_pre ? water_cnt+1 : 0;
+#ifdef LATSTATS
+	if (water_cnt == 1)
+		lat_start(LAT_WATER);
+	else if (water_cnt == 0)
+		lat_cancel(LAT_WATER);
+#endif
+	if (!water_pre)
+		return 0;
+	return water_cnt >= water_alm_time ? DET_F_PRE | DET_F_ALM : DET_F_PRE;
+}
+
+
+// threshold adaptation algorithm
+void det_water_adapt(unsigned short wd, unsigned short wd_th)
+{
+	if (bDown)
+	{
+		// if we are in manual mode with button down just pressed,
+		//   set a threshold that allows the tent to remain down
+		if (bButtonDown)	// manual mode is implicit
+		{
+			// force a threshold lower than current measure,
+			//   so if commanded down it will stay there if conditions
+			//   don't get worse
+			water_threshold = wd-1000;
+			// however, not higher than setpoint
+			if (water_threshold > wd_th)
+				water_threshold = wd_th;
+		}
+		else
+		{
+			// normal or automatic mode, but button not pressed
+			// tent is down, threshold should gradually reach wd_th to restore
+			//   maximum sensitivity
+			if (water_threshold < wd_th)
+			{
+				// we have a lower threshold, due to a previous alarm or
+				//   to manual command down with wet sensor
+				// if actual measure has gone higher than user setpoint wd_th, restore it
+				//   (sensor is finally dry), otherwise keep reduced threshold
+				// keep some margin, to avoid getting an alarm on
+				//   following cycles due to noise
+				if (wd > wd_th+WD_DRY_MARGIN)
+					// final update
+					water_threshold = wd_th;
+				else if (wd > water_threshold+5000)
+					// gradually increase threshold while sensor dries
+					water_threshold += 1000;
+			}
+			else
+				// wd_th probably changed by rotating pot, straight copy
+				water_threshold = wd_th;
+
+			// reset sensor minimum reading
+			water_min = 65535;
+		}
+
+	}
+	else
+	{
+		// tent is up
+		// different water threshold for manual and automatic modes
+		if (bAutoDown)
+		{
+			// update minimum reading and threshold
+			if (wd < water_min)
+			{
+				water_min = wd;
+				// put threshold at mid between user setpoint and minimum reached
+				// divide before add to avoid integer overflow
+				water_threshold = (wd_th>>1)+(water_min>>1);
+			}
+		}
+		else
+			// manual mode, threshold doesn't matter, because it will be
+			//   reset when button down is pressed.
+			// reset it to setpoint to simplify tuning of pot looking at LEDR
+			water_threshold = wd_th;
+	}
+}
+
+
+// don't touch water thresholds
+void det_water_reset(void)
+{
+	water_cnt = 0;
+#ifdef LATSTATS
+	lat_cancel(LAT_WATER);
+#endif
+}
@@ -0,0 +1,101 @@
+//-----------------------------------------------------------------------------
+// det_wind.c
+// TENDONI V2
+// rev1 - RV110808
+// wind detector: anemometer pulses against pot 2 threshold
+//-----------------------------------------------------------------------------
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include "C8051F350.h"		// SFR declarations
+#include "main.h"
+#include "F35x_ADC0.h"
+#include "detect.h"
+#include "timers.h"
+#include "kernels.h"
+#include "hist.h"
+#include "lat.h"
+
+//-----------------------------------------------------------------------------
+// Global VARIABLES
+//-----------------------------------------------------------------------------
+__idata unsigned char last_dc_th=0;
+__idata unsigned char wind_events=0;
+
+
+void det_wind_init(void)
+{
+}
+
+
+// pre-alarm when the pulses in the last second pass the threshold, alarm
+//   on pre-alarm #wind_gust_events in wind_gust_time s: each pre-alarm
+//   loads one free TMR_WIND timer, expired ones are removed by tmr_poll
+unsigned char det_wind_second(void)
+{
+	unsigned char dc_th, i, nWindEvents, iFreeSlot, f;
+	__bit wind_pre;
+
+#ifdef HISTSTATS
+	hist_wind(wind_ticks > 255 ? 255 : (unsigned char)wind_ticks);
+#endif
+
+	// read threshold from pot and compare: pre-alarm if threshold passed
+	// set monitored range to 8-39 ticks per second (full CW: max sensitivity)
+	dc_th = K_DC_TH(ad[2]);
+	wind_pre = wind_ticks > dc_th;
+	last_dc_th = dc_th;
+
+	// count active wind timers
+	nWindEvents = 0;
+	for (i=0; i<WIND_GUST_EVENTS_MAX-1; i++)
+		if (tmr_is_armed(TMR_WIND0+i))
+			nWindEvents++;
+		else
+			// copy index of free slot (we'll get the last one)
+			iFreeSlot = i;
+
+#ifdef LATSTATS
+	// measure from first pre-alarm of a gust window
+	if (nWindEvents == 0)
+	{
+		if (wind_pre)
+			lat_start(LAT_WIND);
+		else
+			lat_cancel(LAT_WIND);
+	}
+#endif
+
+	f = 0;
+	if (wind_pre)
+	{
+		f = DET_F_PRE;
+		if (nWindEvents >= wind_gust_events-1)
+			// this was pre-alarm #WIND_GUST_EVENTS in WIND_GUST_TIME s -> WIND ALARM
+			f |= DET_F_ALM;
+		else
+		{
+			// load one free timer with WIND_GUST_TIME s timeout: tmr_poll runs
+			// before det_second and expires on deadline == uptime, so arm one
+			// second more to keep this pre-alarm for the whole window
+			tmr_arm(TMR_WIND0+iFreeSlot, wind_gust_time+1);
+			nWindEvents++;
+		}
+	}
+	wind_events = nWindEvents;
+	return f;
+}
+
+
+void det_wind_reset(void)
+{
+	unsigned char i;
+
+	for (i=0; i<WIND_GUST_EVENTS_MAX-1; i++)
+		tmr_cancel(TMR_WIND0+i);
+	wind_events = 0;
+#ifdef LATSTATS
+	lat_cancel(LAT_WIND);
+#endif
+}
@@ -0,0 +1,49 @@
+//-----------------------------------------------------------------------------
+// detect.c
+// TENDONI V2
+// rev1 - RV110808
+// run the detectors listed in DETECTORS (detect.h)
+//-----------------------------------------------------------------------------
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include "C8051F350.h"		// SFR declarations
+#include "main.h"
+#include "F35x_ADC0.h"
+#include "detect.h"
+
+//-----------------------------------------------------------------------------
+// Global VARIABLES
+//-----------------------------------------------------------------------------
+unsigned char det_pre = 0, det_alm = 0;
+
+
+#define DET_INIT(n) det_##n##_init();
+void det_init(void)
+{
+	DETECTORS(DET_INIT)
+}
+
+
+#define DET_RUN(n) \
+	{ \
+		unsigned char f = det_##n##_second(); \
+		if (f & DET_F_PRE) \
+			det_pre |= DET_BIT(n); \
+		if (f & DET_F_ALM) \
+			det_alm |= DET_BIT(n); \
+	}
+void det_second(void)
+{
+	det_pre = 0;
+	det_alm = 0;
+	DETECTORS(DET_RUN)
+}
+
+
+#define DET_RESET(n) det_##n##_reset();
+void det_reset(void)
+{
+	DETECTORS(DET_RESET)
+}
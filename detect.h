@@ -0,0 +1,66 @@
+// detect.h
+// TENDONI V2
+// rev1 - RV110808
+// alarm detectors, chosen at build time
+
+#ifndef _DETECT_H_
+#define _DETECT_H_
+
+//-----------------------------------------------------------------------------
+// Global CONSTANTS
+//-----------------------------------------------------------------------------
+
+// Active detectors, in evaluation order. Each one <n> provides (det_<n>.c):
+//   void det_<n>_init(void)			at power on
+//   unsigned char det_<n>_second(void)	every 1s, returns DET_F_PRE/DET_F_ALM
+//   void det_<n>_reset(void)			clear events memory (after moves, button)
+// The list is expanded with direct calls, so there are no function pointers
+//   (costly with SDCC: no reentrancy, parameters in fixed memory). Adding a
+//   detector adds one call and doesn't change the others.
+#define DETECTORS(X) \
+	X(wind) \
+	X(water)
+
+// water detector: wd over the setpoint by this margin means dry sensor
+#define WD_DRY_MARGIN 5000
+
+#define DET_F_PRE 0x01		// pre-alarm this second
+#define DET_F_ALM 0x02		// alarm this second
+
+// detector ids and bits in det_pre, det_alm
+#define DET_ENUM(n) DET_##n,
+enum { DETECTORS(DET_ENUM) N_DET };
+#define DET_BIT(n) (1 << DET_##n)
+
+//-----------------------------------------------------------------------------
+// Global FUNCTIONS
+//-----------------------------------------------------------------------------
+
+#define DET_PROTO(n) \
+	void det_##n##_init(void); \
+	unsigned char det_##n##_second(void); \
+	void det_##n##_reset(void);
+DETECTORS(DET_PROTO)
+
+void det_init(void);		// init all detectors
+void det_second(void);		// run all detectors, set det_pre and det_alm
+void det_reset(void);		// reset all detectors
+
+//-----------------------------------------------------------------------------
+// Global VARIABLES
+//-----------------------------------------------------------------------------
+
+// inputs, set by main before det_second()
+extern __idata unsigned short ad[N_ADCHANNELS];	// coherent A/D snapshot
+extern __idata unsigned short wind_ticks;	// anemometer pulses per second since last 1s loop
+extern __bit bButtonDown;				// down button pressed since last loop
+
+// outputs of det_second(), bit DET_BIT(n) for detector n
+extern unsigned char det_pre, det_alm;
+
+// wind detector: gust windows open (pre-alarms in the last wind_gust_time s)
+extern __idata unsigned char wind_events;
+// water detector: consecutive seconds of pre-alarm
+extern __idata unsigned char water_cnt;
+
+#endif // _DETECT_H_
@@ -0,0 +1,180 @@
+//-----------------------------------------------------------------------------
+// hist.c
+// TENDONI V2
+// rev1 - RV110801
+// site statistics histograms, compiled only with HISTSTATS
+//-----------------------------------------------------------------------------
+// Wind counts, water ratio and its margin to the threshold are binned every
+//   1s, so the trimmers on channels 2/3 can be set looking at how the site
+//   behaves, also where the trace can't be recorded. Each update is a few
+//   shifts and one increment. With HIST_FLASH the counts are saved in flash
+//   every HIST_SAVE_SECS s and restored at power on.
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include "C8051F350.h"		// SFR declarations
+#include "main.h"
+#include "link.h"
+#include "cmd.h"
+#include "hist.h"
+#include "F35x_FLASH.h"
+
+#ifdef HISTSTATS
+
+//-----------------------------------------------------------------------------
+// Function PROTOTYPES
+//-----------------------------------------------------------------------------
+unsigned char hist_log(unsigned short v);
+void hist_add(unsigned char bin);
+void hist_save(void);
+
+//-----------------------------------------------------------------------------
+// Global VARIABLES
+//-----------------------------------------------------------------------------
+// first bin of each histogram in hist_bin
+__code unsigned char hist_ofs[N_HIST+1] = { 0, 16, 48, 80, HIST_BINS };
+
+__xdata unsigned short hist_bin[HIST_BINS];
+__bit bHistWater = 0, bHistWind = 0;		// pre-alarm episode in progress
+__bit bHistWaterAlm = 0, bHistWindAlm = 0;	// episode ended in alarm
+
+#ifdef HIST_FLASH
+__xdata unsigned short hist_save_cnt = HIST_SAVE_SECS;
+// reserve the flash page: defaults force allocation, so the linker respects
+//   the area (the magic is not valid, so a new image starts from zero)
+__code __at(FLASH_HIST) unsigned char hist_flash[FLASH_PAGESIZE] = { 0xFF };
+#endif
+
+
+void hist_init(void)
+{
+#ifdef HIST_FLASH
+	unsigned short magic;
+
+	FLASH_BufRead(FLASH_HIST, (unsigned char *)&magic, 2);
+	if (magic == HIST_MAGIC)
+		FLASH_BufRead(FLASH_HIST+2, (unsigned char *)hist_bin, sizeof(hist_bin));
+#endif
+}
+
+
+// half-octave bin of v, 0-31
+unsigned char hist_log(unsigned short v)
+{
+	unsigned char e;
+
+	if (v < 2)
+		return v;
+	for (e=1; v >= 4; e++)
+		v >>= 1;
+	// v is now 2 or 3: its low bit selects the half octave
+	return 2*e + (v & 1);
+}
+
+
+void hist_add(unsigned char bin)
+{
+	if (hist_bin[bin] < 65535)
+		hist_bin[bin]++;
+}
+
+
+void hist_wind(unsigned char delta_counter)
+{
+	hist_add(hist_ofs[HIST_WIND] + hist_log(delta_counter));
+}
+
+
+// wd and the threshold it was compared with
+void hist_water(unsigned short wd, unsigned short th)
+{
+	hist_add(hist_ofs[HIST_WD] + hist_log(wd));
+	if (wd >= th)
+		hist_add(hist_ofs[HIST_MARGIN] + 16 + hist_log((wd-th) >> 8));
+	else
+		hist_add(hist_ofs[HIST_MARGIN] + 15 - hist_log((th-wd) >> 8));
+}
+
+
+// track pre-alarm episodes (water: consecutive pre-alarms, wind: gust window
+//   open) and count those that ended without an alarm
+// also checkpoint, since this is called once per 1s
+void hist_prealarm(__bit water_pre, __bit wind_act, __bit alarm)
+{
+	if (bHistWater && alarm)
+		bHistWaterAlm = 1;
+	if (bHistWind && alarm)
+		bHistWindAlm = 1;
+
+	if (bHistWater && !water_pre && !bHistWaterAlm)
+		hist_add(hist_ofs[HIST_PRE]);
+	if (bHistWind && !wind_act && !bHistWindAlm)
+		hist_add(hist_ofs[HIST_PRE]+1);
+
+	if (!water_pre)
+		bHistWaterAlm = 0;
+	if (!wind_act)
+		bHistWindAlm = 0;
+	bHistWater = water_pre;
+	bHistWind = wind_act;
+
+#ifdef HIST_FLASH
+	if (--hist_save_cnt == 0)
+	{
+		hist_save_cnt = HIST_SAVE_SECS;
+		hist_save();
+	}
+#endif
+}
+
+
+void hist_request(unsigned char id, unsigned char first)
+{
+	unsigned char buf[2+2*HIST_REPLY_BINS], n, k, i;
+
+	if (id == 0xFF)
+	{
+		for (k=0; k<HIST_BINS; k++)
+			hist_bin[k] = 0;
+		buf[0] = CMD_T_HIST;
+		buf[1] = 0;
+		link_send(CMD_T_ACK, buf, 2);
+		return;
+	}
+	if (id >= N_HIST)
+		return;
+
+	n = hist_ofs[id+1]-hist_ofs[id];
+	if (first > n)
+		first = n;
+	n -= first;
+	if (n > HIST_REPLY_BINS)
+		n = HIST_REPLY_BINS;
+
+	buf[0] = id;
+	buf[1] = first;
+	for (i=0, k=hist_ofs[id]+first; i<n; i++, k++)
+	{
+		buf[2+2*i] = (unsigned char)hist_bin[k];
+		buf[3+2*i] = (unsigned char)(hist_bin[k] >> 8);
+	}
+	link_send(CMD_REPLY | CMD_T_HIST, buf, 2+2*n);
+}
+
+
+#ifdef HIST_FLASH
+// erase and rewrite the checkpoint page, ~30 ms with the CPU stalled:
+//   Timer2 ticks are delayed, not lost
+void hist_save(void)
+{
+	unsigned short magic = HIST_MAGIC;
+
+	FLASH_PageErase(FLASH_HIST);
+	FLASH_BufWrite(FLASH_HIST+2, (unsigned char *)hist_bin, sizeof(hist_bin));
+	// magic last: an interrupted save leaves no valid checkpoint
+	FLASH_BufWrite(FLASH_HIST, (unsigned char *)&magic, 2);
+}
+#endif
+
+#endif // HISTSTATS
@@ -0,0 +1,43 @@
+// hist.h
+// TENDONI V2
+// rev1 - RV110801
+// site statistics histograms (HISTSTATS only)
+
+#ifndef _HIST_H_
+#define _HIST_H_
+
+//-----------------------------------------------------------------------------
+// Global CONSTANTS
+//-----------------------------------------------------------------------------
+
+// histograms of the 1s readings, half-octave bins (see hist_log):
+//   bin 0: 0, bin 1: 1, then 2 bins per power of 2: [2,3) [3,4) [4,6) [6,8) ...
+#define HIST_WIND 0			// delta_counter, 16 bins (0-255)
+#define HIST_WD 1			// wd, 32 bins (0-65535)
+#define HIST_MARGIN 2		// wd-water_threshold, 32 bins: 16+bin of (margin>>8) if >=0,
+							//   15-bin of (-margin>>8) if <0
+#define HIST_PRE 3			// pre-alarms that did not become alarms: 0 water, 1 wind
+#define N_HIST 4
+#define HIST_BINS 82		// all bins
+
+#define HIST_REPLY_BINS 7	// bins per reply, (LINK_MAX_PAYLOAD-2)/2
+
+// request: id, first bin -> reply: id, first bin, up to HIST_REPLY_BINS
+//   counts (lo, hi, saturated). Id 0xFF clears all -> CMD_T_ACK
+#define CMD_T_HIST 'G'
+
+// checkpoint in flash (HIST_FLASH), restored at power on
+#define HIST_SAVE_SECS 21600	// s between checkpoints, 4/day for 20k erase cycles
+#define HIST_MAGIC 0x4853
+
+//-----------------------------------------------------------------------------
+// Global FUNCTIONS
+//-----------------------------------------------------------------------------
+
+void hist_init(void);				// restore checkpoint, if any
+void hist_wind(unsigned char delta_counter);
+void hist_water(unsigned short wd, unsigned short th);
+void hist_prealarm(__bit water_pre, __bit wind_act, __bit alarm);	// once per 1s
+void hist_request(unsigned char id, unsigned char first);
+
+#endif // _HIST_H_
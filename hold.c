@@ -0,0 +1,150 @@
+//-----------------------------------------------------------------------------
+// hold.c
+// TENDONI V2
+// rev1 - RV110815
+// hold time after an alarm before automatic down (re-deploy policy)
+//-----------------------------------------------------------------------------
+// A hold is armed with the max bound of its causes (wind, rain), so with
+//   no information the tents stay up as long as before. It ends early when
+//   the min bound has passed and all causes have been gone for
+//   hold_calm_time s in a row:
+//   - rain: sensor dry, wd > wd_th+WD_DRY_MARGIN (as det_water_adapt does
+//     to restore water_threshold)
+//   - wind: no gust windows open and mean wind under half the threshold
+// A new alarm restarts the hold, adding its cause. Moves from the link and
+//   alarms of the other unit have no cause here: fixed FOUR_HOURS.
+// Setting min=max for a cause gives back the fixed hold.
+// Statistics (CMD_T_HOLD): early downs, seconds saved on the max hold (the
+//   shade recovered), relapses (alarm within hold_calm_time s of an early
+//   down). With SIMWEATHER they can be compared with the sim_stats counters.
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include "C8051F350.h"		// SFR declarations
+#include "main.h"
+#include "F35x_ADC0.h"
+#include "detect.h"
+#include "timers.h"
+#include "link.h"
+#include "cmd.h"
+#include "hold.h"
+
+//-----------------------------------------------------------------------------
+// Global VARIABLES
+//-----------------------------------------------------------------------------
+__xdata unsigned short hold_wind_min=HOLD_WIND_MIN, hold_wind_max=HOLD_WIND_MAX;
+__xdata unsigned short hold_rain_min=HOLD_RAIN_MIN, hold_rain_max=HOLD_RAIN_MAX;
+__xdata unsigned short hold_calm_time=HOLD_CALM_TIME;
+
+// running hold
+__xdata unsigned short hold_len=0, hold_min=0;
+__xdata unsigned char hold_cause=0;
+__xdata unsigned short hold_calm=0;		// consecutive s with all causes gone
+__xdata unsigned short hold_wind_avg=0;	// mean of wind_ticks x32, ~32 s time constant
+
+// statistics
+__xdata unsigned short hold_early=0, hold_relapse=0;
+__xdata unsigned long hold_saved=0;
+__xdata unsigned long hold_early_at=0;	// uptime of the last early down
+__bit bHoldEarly=0;
+
+
+// start or restart a hold for <cause> (HOLD_WIND, HOLD_RAIN), 0 for a fixed
+//   FOUR_HOURS; returns the max length, to arm TMR_AUTODOWN
+unsigned short hold_arm(unsigned char cause)
+{
+	// alarm soon after an early down: the policy was too optimistic
+	if (bHoldEarly && cause)
+	{
+		if (uptime_get()-hold_early_at < hold_calm_time)
+			hold_relapse++;
+		bHoldEarly = 0;
+	}
+
+	// alarm during a hold: all causes must be gone
+	if (cause && tmr_is_armed(TMR_AUTODOWN))
+		cause |= hold_cause;
+	hold_cause = cause;
+	hold_calm = 0;
+
+	if (!cause)
+	{
+		hold_min = FOUR_HOURS;
+		hold_len = FOUR_HOURS;
+		return FOUR_HOURS;
+	}
+
+	// longest bounds of the causes
+	hold_min = 0;
+	hold_len = 0;
+	if (cause & HOLD_WIND)
+	{
+		hold_min = hold_wind_min;
+		hold_len = hold_wind_max;
+	}
+	if (cause & HOLD_RAIN)
+	{
+		if (hold_rain_min > hold_min)
+			hold_min = hold_rain_min;
+		if (hold_rain_max > hold_len)
+			hold_len = hold_rain_max;
+	}
+	return hold_len;
+}
+
+
+// update the wind mean, then end the hold if its causes are gone
+// readings between ADC_DUTY bursts are the last ones: fine at this pace
+void hold_second(void)
+{
+	unsigned short left;
+	unsigned char t;
+
+	// always, so the mean is settled when a hold starts
+	t = wind_ticks > 255 ? 255 : (unsigned char)wind_ticks;
+	hold_wind_avg = hold_wind_avg - (hold_wind_avg >> 5) + t;
+
+	if (bDown || !bAutoDown || !hold_cause || !tmr_is_armed(TMR_AUTODOWN))
+		return;
+
+	if (((hold_cause & HOLD_RAIN) && last_wd <= last_wd_th+WD_DRY_MARGIN) ||
+		((hold_cause & HOLD_WIND) && (wind_events || hold_wind_avg >= (unsigned short)last_dc_th << 4)))
+	{
+		hold_calm = 0;
+		return;
+	}
+	if (hold_calm < 65535)
+		hold_calm++;
+
+	left = tmr_left(TMR_AUTODOWN);
+	if (hold_calm >= hold_calm_time && hold_len-left >= hold_min)
+	{
+		// early down: main sees the timer not armed in this same 1s loop
+		tmr_cancel(TMR_AUTODOWN);
+		hold_saved += left;
+		hold_early++;
+		hold_early_at = uptime_get();
+		bHoldEarly = 1;
+	}
+}
+
+
+void hold_stats(void)
+{
+	unsigned char buf[10], i;
+	unsigned long saved = hold_saved;
+
+	buf[0] = (unsigned char)hold_early;
+	buf[1] = (unsigned char)(hold_early >> 8);
+	buf[2] = (unsigned char)hold_relapse;
+	buf[3] = (unsigned char)(hold_relapse >> 8);
+	for (i=0; i<4; i++)
+	{
+		buf[4+i] = (unsigned char)saved;
+		saved >>= 8;
+	}
+	buf[8] = (unsigned char)hold_len;
+	buf[9] = (unsigned char)(hold_len >> 8);
+	link_send(CMD_REPLY | CMD_T_HOLD, buf, 10);
+}
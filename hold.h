@@ -0,0 +1,39 @@
+// hold.h
+// TENDONI V2
+// rev1 - RV110815
+// hold time after an alarm before automatic down (re-deploy policy)
+
+#ifndef _HOLD_H_
+#define _HOLD_H_
+
+//-----------------------------------------------------------------------------
+// Global CONSTANTS
+//-----------------------------------------------------------------------------
+
+// causes of a hold, bits as det_alm (DET_BIT), 0 for moves from the link
+#define HOLD_WIND DET_BIT(wind)
+#define HOLD_RAIN DET_BIT(water)
+
+// reply: early downs, relapses (lo, hi), s saved on the max hold (32 bit, lo first),
+//   max length of the last hold in s (lo, hi)
+#define CMD_T_HOLD 'P'
+
+//-----------------------------------------------------------------------------
+// Global FUNCTIONS
+//-----------------------------------------------------------------------------
+
+unsigned short hold_arm(unsigned char cause);	// start/restart a hold, returns its max length
+void hold_second(void);			// every 1s after det_second(): may end the hold early
+void hold_stats(void);			// send CMD_T_HOLD reply
+
+//-----------------------------------------------------------------------------
+// Global VARIABLES
+//-----------------------------------------------------------------------------
+
+// runtime overrides of HOLD_WIND_MIN/MAX, HOLD_RAIN_MIN/MAX, HOLD_CALM_TIME
+extern __xdata unsigned short hold_wind_min, hold_wind_max;
+extern __xdata unsigned short hold_rain_min, hold_rain_max;
+extern __xdata unsigned short hold_calm_time;
+extern __xdata unsigned short hold_len;		// max length of the running hold
+
+#endif // _HOLD_H_
@@ -0,0 +1,267 @@
+//-----------------------------------------------------------------------------
+// difftest.c
+// TENDONI V2
+// rev1 - RV110905
+// differential test of the native build against the .ihx in a simulator
+//-----------------------------------------------------------------------------
+// usage: difftest [-t s] [-w trace] [-c trace | -r capture] [-q capture]
+//   -t  seconds to run the native build (default 3600)
+//   -w  write the native trace, one line per state frame
+//   -c  compare with a trace written by -w (another port, compiler, -O)
+//   -r  compare with a raw UART0 capture of the .ihx (host/ucsim.sh)
+//   -q  print the last uptime of a raw capture and exit (ucsim.sh polls it)
+// Both sides are built with SIMWEATHER STATEDUMP SIMNOAD (build.sh host
+//   links difftest with those objects): the synthetic weather is generated
+//   by the firmware itself, so the inputs are the same on any target, and
+//   the state frame (LINK_T_STATE, state_dump in main.c) of every 1s loop is
+//   the output compared. Frames are matched by uptime (unwrapped at 16 bit);
+//   the first frames that differ are printed field by field.
+// Seconds with a frame on one side only are counted, not an error: the
+//   1s loop doesn't run during moves, a full TX buffer drops frames. Fails
+//   if any matched frame differs, or nothing matched.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hw.h"
+#include "../link.h"
+
+#define N_FIELDS 11
+#define MAX_SHOW 5			// mismatches printed in full
+
+struct rec
+{
+	unsigned long t;		// uptime, unwrapped
+	unsigned f[N_FIELDS];
+};
+
+// state_dump() payload: offset and size of each field, uptime first
+static const struct field
+{
+	const char *name;
+	int off, size;
+	const char *fmt;
+} fld[N_FIELDS] =
+{
+	{ "uptime", 0, 2, "%5u" }, { "P1", 2, 1, "%02X" }, { "flags", 3, 1, "%X" },
+	{ "det_pre", 4, 1, "%02X" }, { "det_alm", 5, 1, "%02X" }, { "water_th", 6, 2, "%5u" },
+	{ "last_wd", 8, 2, "%5u" }, { "water_cnt", 10, 1, "%3u" }, { "dc_th", 11, 1, "%3u" },
+	{ "wind", 12, 2, "%5u" }, { "auto_down", 14, 2, "%5u" },
+};
+
+struct trace
+{
+	struct rec *r;
+	unsigned long n, max;
+	unsigned char frame[3+LINK_MAX_PAYLOAD+1];
+	int flen;
+};
+
+static struct trace nat, other;
+static unsigned long secs = 3600;
+
+
+static void add(struct trace *tr, const unsigned char *p)
+{
+	struct rec r;
+	unsigned long prev;
+	int i;
+
+	for (i=0; i<N_FIELDS; i++)
+		r.f[i] = fld[i].size == 2 ? p[fld[i].off] | p[fld[i].off+1] << 8 : p[fld[i].off];
+	prev = tr->n ? tr->r[tr->n-1].t : 0;
+	r.t = (prev & ~0xFFFFUL) | r.f[0];
+	if (r.t < prev)
+		r.t += 0x10000;
+	if (tr->n == tr->max)
+	{
+		tr->max = tr->max ? 2*tr->max : 4096;
+		if (!(tr->r = realloc(tr->r, tr->max*sizeof(*tr->r))))
+		{
+			perror("difftest");
+			exit(1);
+		}
+	}
+	tr->r[tr->n++] = r;
+}
+
+
+// link frame decoder: SOF, type, len, payload, checksum; state frames to tr
+static void byte(struct trace *tr, unsigned char c)
+{
+	unsigned char sum = 0;
+	int i;
+
+	if (tr->flen == 0 && c != LINK_SOF)
+		return;
+	tr->frame[tr->flen++] = c;
+	if (tr->flen == 3 && tr->frame[2] > LINK_MAX_PAYLOAD)
+		tr->flen = 0;
+	if (tr->flen < 3 || tr->flen < 4 + tr->frame[2])
+		return;
+	for (i=1; i<tr->flen; i++)
+		sum += tr->frame[i];
+	if (sum == 0 && tr->frame[1] == LINK_T_STATE && tr->frame[2] == 16)
+		add(tr, tr->frame+3);
+	tr->flen = 0;
+}
+
+
+static void tx(unsigned char c)
+{
+	byte(&nat, c);
+}
+
+
+static int read_trace(struct trace *tr, const char *name, int raw)
+{
+	FILE *f = fopen(name, "rb");
+	unsigned char p[16];
+	int c, i;
+
+	if (!f)
+	{
+		perror(name);
+		return 1;
+	}
+	if (raw)
+		while ((c = getc(f)) != EOF)
+			byte(tr, c);
+	else
+		for (;;)
+		{
+			unsigned v[N_FIELDS];
+
+			for (i=0; i<N_FIELDS; i++)
+				if (fscanf(f, strchr(fld[i].fmt, 'X') ? "%x" : "%u", &v[i]) != 1)
+					break;
+			if (i < N_FIELDS)
+				break;
+			for (i=0; i<N_FIELDS; i++)
+			{
+				p[fld[i].off] = (unsigned char)v[i];
+				if (fld[i].size == 2)
+					p[fld[i].off+1] = (unsigned char)(v[i] >> 8);
+			}
+			add(tr, p);
+		}
+	fclose(f);
+	return 0;
+}
+
+
+static void print(FILE *f, const struct rec *r)
+{
+	int i;
+
+	for (i=0; i<N_FIELDS; i++)
+	{
+		if (i)
+			putc(' ', f);
+		fprintf(f, fld[i].fmt, r->f[i]);
+	}
+	fprintf(f, "\n");
+}
+
+
+static int compare(const struct trace *a, const struct trace *b, const char *name)
+{
+	unsigned long i = 0, j = 0, same = 0, bad = 0, only_a = 0, only_b = 0;
+	int k;
+
+	while (i < a->n || j < b->n)
+	{
+		const struct rec *x = &a->r[i], *y = &b->r[j];
+
+		if (j == b->n || (i < a->n && x->t < y->t))
+		{
+			only_a++;
+			i++;
+			continue;
+		}
+		if (i == a->n || y->t < x->t)
+		{
+			only_b++;
+			j++;
+			continue;
+		}
+		if (memcmp(x->f, y->f, sizeof(x->f)) == 0)
+			same++;
+		else if (++bad <= MAX_SHOW)
+		{
+			printf("second %lu differs:", x->t);
+			for (k=1; k<N_FIELDS; k++)
+				if (x->f[k] != y->f[k])
+					printf(" %s %u/%u", fld[k].name, x->f[k], y->f[k]);
+			printf("\n  native ");
+			print(stdout, x);
+			printf("  %-6.6s ", name);
+			print(stdout, y);
+		}
+		i++;
+		j++;
+	}
+	printf("%lu seconds compared, %lu equal, %lu differ; %lu native only, %lu %s only\n",
+		same+bad, same, bad, only_a, only_b, name);
+	return bad || !same;
+}
+
+
+int main(int argc, char **argv)
+{
+	static const struct hw_env env = { 0, 0, 0, tx, 0, 0 };
+	const char *wname = 0, *cname = 0;
+	int c, raw = 0, r;
+
+	while ((c = getopt(argc, argv, "t:w:c:r:q:")) != -1)
+		switch (c)
+		{
+		case 't': secs = strtoul(optarg, 0, 0); break;
+		case 'w': wname = optarg; break;
+		case 'c': cname = optarg; raw = 0; break;
+		case 'r': cname = optarg; raw = 1; break;
+		case 'q':
+			if (read_trace(&other, optarg, 1))
+				return 1;
+			printf("%lu\n", other.n ? other.r[other.n-1].t : 0);
+			return 0;
+		default:
+			fprintf(stderr, "usage: difftest [-t s] [-w trace] [-c trace | -r capture] [-q capture]\n");
+			return 2;
+		}
+
+	r = hw_run(&env, (hw_time)secs*HW_CLK);
+	if (r != HW_END)
+	{
+		printf("native build stopped (%d) at %.3f s\n", r, (double)hw_now/HW_CLK);
+		return 1;
+	}
+	if (!nat.n)
+	{
+		printf("no state frames in %lu s\n", secs);
+		return 1;
+	}
+	if (wname)
+	{
+		FILE *f = fopen(wname, "w");
+		unsigned long i;
+
+		if (!f)
+		{
+			perror(wname);
+			return 1;
+		}
+		for (i=0; i<nat.n; i++)
+			print(f, &nat.r[i]);
+		fclose(f);
+	}
+	if (!cname)
+	{
+		printf("%lu state frames in %lu s\n", nat.n, secs);
+		return 0;
+	}
+	if (read_trace(&other, cname, raw))
+		return 1;
+	return compare(&nat, &other, raw ? "ucsim" : "trace");
+}
@@ -0,0 +1,649 @@
+//-----------------------------------------------------------------------------
+// explore.c
+// TENDONI V2
+// rev1 - RV110905
+// IRQ interleavings of one 1s pass of the native firmware
+//-----------------------------------------------------------------------------
+// usage: explore [-t s] [-w pulses/s] [-r wd] [-j jobs] [-v]
+//   -t  explore the 1s pass of this second (default 12)
+//   -w  wind pulses per second, -r water ratio (default 10, 32768), as run.c
+//   -j  runs in parallel (default: all cores)
+//   -v  list all the inconsistent runs, not only the first 20
+// The firmware objects are compiled with -fsanitize=thread, without its
+//   runtime: the compiler calls __tsan_readN/__tsan_writeN before each memory
+//   access, and these calls are the injection points. An IRQ between two
+//   accesses of main looks to main like an IRQ just before the second one,
+//   so the points give all the interleavings main can tell apart.
+// Up to the pass, the accesses made inside the ISRs mark the bytes each IRQ
+//   reads and writes. At the first access of the pass the process forks a
+//   run without injection, which counts the points, then one run per point
+//   and variant; each one goes on to the end of the pass, the next idle of
+//   main (in move_updown, if the pass moves the tents).
+//   Variants at each point:
+//   tick    the next Timer2 IRQ (hw_preempt: main stalled until then, the
+//           A/D IRQs due meanwhile are served too)
+//   second  the same up to the next change of seconds_cnt (main stalled up
+//           to 1 s, WDcnt kept), as if the pass had started just before a
+//           second boundary
+//   adc     the next ADC0 IRQ (end of the conversion running)
+//   and for each of them the torn accesses, where the 8051 needs more than
+//   one instruction (SDCC moves the low byte first): a read of 2 to 4 bytes
+//   that the IRQ writes gets the low bytes from before the IRQ and the others
+//   from after, a write of 2 to 4 bytes the IRQ uses is seen half done by
+//   the IRQ. Byte read-modify-writes (inc, orl, anl) are not split. Masked
+//   IRQs (EA, ET2, EIE1) are not injected: they would come at a later point.
+// The decisions of the pass (ad[], wind_ticks, detector state, bDown,
+//   bAutoDown, auto_down_timer, wind totals, P1 without LEDG) must match the
+//   run without injection or the one with the injection at point 0: the IRQ
+//   as if it came after or before the pass. Exit status 1 if a run is
+//   inconsistent or dies.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "hw.h"
+#include "../main.h"
+#include "../F35x_ADC0.h"
+#include "../detect.h"
+
+#define MAX_POINTS (1 << 20)
+#define MAX_TEAR 8			// bytes split in a range access (struct copies)
+#define MAX_LIST 20			// inconsistent runs listed without -v
+#define P1_OUT 0x1B			// P1 outputs but LEDG (Timer2_ISR)
+
+extern unsigned long prev_uptime, prev_total;
+extern char __data_start[], _end[];		// firmware and model data
+
+// variants of each point
+enum { V_TICK, V_SECOND, V_ADC, N_V };
+static const char *const v_name[N_V] = { "tick", "second", "adc" };
+
+// map of the data: bit 2*irq read by the IRQ, 2*irq+1 written
+enum { I_T2, I_ADC, I_UART };
+
+enum { R_LEARN, R_COUNT, R_RUN };
+
+struct point
+{
+	void *pc;
+	unsigned char *addr;
+	unsigned size;
+	unsigned char write;
+	unsigned char n[N_V];	// variants: 0 none, else 1 + torn accesses
+};
+
+struct obs
+{
+	int status;				// 0 died, 1 pass ended, 2 masked, 16+HW_... stopped
+	int torn;				// a torn value was seen
+	unsigned char data[64];
+};
+
+static const struct
+{
+	const char *name;
+	void *p;
+	unsigned size;
+	unsigned tol;			// time readings: a second in the middle changes them
+} var[] =
+{
+	{ "ad", ad, sizeof(ad) },
+	{ "wind_ticks", &wind_ticks, sizeof(wind_ticks) },
+	{ "det_pre", &det_pre, sizeof(det_pre) },
+	{ "det_alm", &det_alm, sizeof(det_alm) },
+	{ "wind_events", &wind_events, sizeof(wind_events) },
+	{ "water_cnt", &water_cnt, sizeof(water_cnt) },
+	{ "last_wd", &last_wd, sizeof(last_wd) },
+	{ "bDown", (void *)&bDown, sizeof(bDown) },
+	{ "bAutoDown", (void *)&bAutoDown, sizeof(bAutoDown) },
+	{ "auto_down_timer", &auto_down_timer, sizeof(auto_down_timer), 1 },
+	{ "prev_uptime", &prev_uptime, sizeof(prev_uptime) },
+	{ "prev_total", &prev_total, sizeof(prev_total) },
+};
+#define N_VAR (sizeof(var)/sizeof(var[0]))
+
+static unsigned long wind = 10, ratio = 32768;
+static hw_time t_start;
+static long jobs;
+static int verbose;
+
+// hooks state
+static unsigned char *map;
+static int role = R_LEARN, depth, isr_depth = -1, isr_irq, idle_sec = -1, in_pass;
+static long pt;						// points of the pass so far
+static unsigned char *last_addr;	// previous access of main
+static unsigned last_size, last_write;
+// this run
+static long target = -1;
+static int t_v, t_k;
+static struct obs *result;
+// torn access in progress: a read to restore, or a write to split
+static struct
+{
+	unsigned char *addr;
+	unsigned n, k, write;
+	unsigned char old[MAX_TEAR], val[MAX_TEAR];
+} tear;
+// shared with the runs
+static struct point *points;
+static long *n_points;
+static struct obs *ref;				// run without injection
+
+
+//-----------------------------------------------------------------------------
+// Injection
+//-----------------------------------------------------------------------------
+
+static int in_map(const unsigned char *a, unsigned size)
+{
+	return a >= (unsigned char *)__data_start && a + size <= (unsigned char *)_end;
+}
+
+
+// torn accesses of a main access for this variant
+static int tears(int v, unsigned char *a, unsigned size, int write, int range)
+{
+	unsigned i, n = range ? MAX_TEAR : 4;
+	unsigned char mask = (write ? 3 : 2) << 2*(v == V_ADC ? I_ADC : I_T2);
+
+	if (size < n)
+		n = size;
+	if (n < 2 || !in_map(a, size))
+		return 0;
+	for (i=0; i<size; i++)
+		if (map[a + i - (unsigned char *)__data_start] & mask)
+			return n-1;
+	return 0;
+}
+
+
+// the IRQ of variant v now, 0 if masked
+static int irq(int v)
+{
+	unsigned char s = seconds_cnt, wd = WDcnt;
+	int n;
+
+	if (v != V_SECOND)
+		return hw_preempt(v == V_TICK ? 5 : 10);
+	for (n=0; n<80 && s == seconds_cnt; n++)
+	{
+		WDcnt = wd;
+		if (!hw_preempt(5))
+			return 0;
+	}
+	WDcnt = wd;
+	return 1;
+}
+
+
+static void masked(void)
+{
+	result->status = 2;
+	_exit(0);
+}
+
+
+static void inject(unsigned char *a, unsigned size, int write)
+{
+	unsigned i;
+
+	if (!t_k)
+	{
+		if (!irq(t_v))
+			masked();
+		return;
+	}
+	tear.addr = a;
+	tear.n = size < MAX_TEAR ? size : MAX_TEAR;
+	tear.k = t_k;
+	tear.write = write;
+	memcpy(tear.old, a, tear.n);
+	if (write)
+		return;		// split at the next access, when the value is known
+	if (!irq(t_v))
+		masked();
+	// low bytes as before the IRQ, the load below sees them
+	memcpy(tear.val, a, tear.n);
+	for (i=0; i<tear.k; i++)
+		a[i] = tear.old[i];
+	result->torn |= memcmp(a, tear.val, tear.n) != 0;
+}
+
+
+// at the next access of main after a torn one
+static void tear_end(void)
+{
+	unsigned char *a = tear.addr;
+	unsigned i;
+
+	tear.addr = 0;
+	if (!tear.write)
+	{
+		memcpy(a, tear.val, tear.n);
+		return;
+	}
+	// the IRQ sees the low bytes written, then main writes the others
+	memcpy(tear.val, a, tear.n);
+	for (i=tear.k; i<tear.n; i++)
+		a[i] = tear.old[i];
+	result->torn |= memcmp(a, tear.val, tear.n) != 0;
+	if (!irq(t_v))
+		masked();
+	for (i=tear.k; i<tear.n; i++)
+		a[i] = tear.val[i];
+}
+
+
+//-----------------------------------------------------------------------------
+// Runs
+//-----------------------------------------------------------------------------
+
+static void capture(struct obs *o)
+{
+	unsigned i, off = 0;
+
+	for (i=0; i<N_VAR; i++)
+	{
+		memcpy(o->data + off, var[i].p, var[i].size);
+		off += var[i].size;
+	}
+	o->data[off] = P1 & P1_OUT;
+	o->status = 1;
+}
+
+
+// names of the decisions that differ, 0 if none
+static const char *diff(const struct obs *a, const struct obs *b)
+{
+	static char s[256];
+	unsigned i, off = 0;
+
+	s[0] = 0;
+	for (i=0; i<N_VAR; i++)
+	{
+		unsigned short x, y;
+
+		memcpy(&x, a->data + off, sizeof(x));
+		memcpy(&y, b->data + off, sizeof(y));
+		if (var[i].tol ? (x > y ? x - y : y - x) > var[i].tol
+			: memcmp(a->data + off, b->data + off, var[i].size) != 0)
+			snprintf(s + strlen(s), sizeof(s) - strlen(s), " %s", var[i].name);
+		off += var[i].size;
+	}
+	if (a->data[off] != b->data[off])
+		snprintf(s + strlen(s), sizeof(s) - strlen(s), " P1");
+	return s[0] ? s : 0;
+}
+
+
+static void fork_run(struct obs *r, long i, int v, int k, long *running)
+{
+	if (*running == jobs)
+	{
+		wait(0);
+		(*running)--;
+	}
+	if (fork() == 0)
+	{
+		role = R_RUN;
+		result = r;
+		target = i;
+		t_v = v;
+		t_k = k;
+		return;
+	}
+	(*running)++;
+}
+
+
+// file:line of the points, with addr2line
+static void where(long *pts, int n, char (*loc)[200])
+{
+	char cmd[512 + 20*MAX_LIST], exe[256];
+	FILE *f;
+	int i, len;
+
+	len = readlink("/proc/self/exe", exe, sizeof(exe)-1);
+	exe[len < 0 ? 0 : len] = 0;
+	for (i=0; i<n; i++)
+		strcpy(loc[i], "?");
+	while (n > 0)
+	{
+		int m = n < MAX_LIST ? n : MAX_LIST;
+
+		snprintf(cmd, sizeof(cmd), "addr2line -f -s -e %s", exe);
+		for (i=0; i<m; i++)
+			snprintf(cmd + strlen(cmd), sizeof(cmd) - strlen(cmd), " %p",
+				(char *)points[pts[i]].pc - 1);
+		if (!(f = popen(cmd, "r")))
+			return;
+		for (i=0; i<m; i++)
+		{
+			char fn[96], fl[96];
+
+			if (!fgets(fn, sizeof(fn), f) || !fgets(fl, sizeof(fl), f))
+				break;
+			fn[strcspn(fn, "\n")] = 0;
+			fl[strcspn(fl, "\n")] = 0;
+			snprintf(loc[i], sizeof(loc[i]), "%s (%s)", fl, fn);
+		}
+		pclose(f);
+		pts += m;
+		loc += m;
+		n -= m;
+	}
+}
+
+
+// in the learning process, at the first access of the pass: never returns
+//   there, only in the forked runs
+static void start_pass(void)
+{
+	struct timespec t0, t1;
+	struct obs *res, *r0[N_V];
+	long i, n, runs = 0, running = 0, bad = 0, listed = 0, *bad_pt;
+	long cnt[N_V][4] = {{0}};	// runs, masked, inconsistent or died, torn
+	int v, k, *bad_v, *bad_k;
+	char (*loc)[200];
+	const char **bad_why;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	in_pass = 1;
+	points = mmap(0, MAX_POINTS*sizeof(*points) + sizeof(*n_points) + sizeof(*ref),
+		PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (points == MAP_FAILED)
+		exit(1);
+	n_points = (long *)(points + MAX_POINTS);
+	ref = (struct obs *)(n_points + 1);
+	fflush(stdout);
+
+	// run without injection: points and reference
+	if (fork() == 0)
+	{
+		role = R_COUNT;
+		result = ref;
+		return;
+	}
+	wait(0);
+	n = *n_points;
+	if (ref->status != 1 || n >= MAX_POINTS)
+	{
+		printf("pass at %.3f s: the run without injection %s\n", (double)hw_now/HW_CLK,
+			n >= MAX_POINTS ? "has too many points" : "didn't end");
+		exit(1);
+	}
+	for (i=0; i<n; i++)
+		for (v=0; v<N_V; v++)
+			runs += points[i].n[v];
+	res = mmap(0, runs*sizeof(*res), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (res == MAP_FAILED)
+		exit(1);
+
+	// a run per point and variant, in the same order as the results
+	runs = 0;
+	for (v=0; v<N_V; v++)
+		for (i=0; i<n; i++)
+			for (k=0; k<points[i].n[v]; k++)
+			{
+				fork_run(&res[runs++], i, v, k, &running);
+				if (role == R_RUN)
+					return;
+			}
+	while (wait(0) > 0)
+		;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	// references: injection at point 0, unless masked there
+	runs = 0;
+	for (v=0; v<N_V; v++)
+	{
+		r0[v] = points[0].n[v] && res[runs].status == 1 ? &res[runs] : ref;
+		for (i=0; i<n; i++)
+			runs += points[i].n[v];
+	}
+
+	bad_pt = malloc(runs*sizeof(*bad_pt));
+	bad_v = malloc(runs*sizeof(*bad_v));
+	bad_k = malloc(runs*sizeof(*bad_k));
+	bad_why = malloc(runs*sizeof(*bad_why));
+	runs = 0;
+	for (v=0; v<N_V; v++)
+		for (i=0; i<n; i++)
+			for (k=0; k<points[i].n[v]; k++)
+			{
+				struct obs *r = &res[runs++];
+				const char *why = 0;
+
+				cnt[v][0]++;
+				cnt[v][3] += r->torn;
+				if (r->status == 2)
+				{
+					cnt[v][1]++;
+					continue;
+				}
+				if (r->status != 1)
+					why = r->status == 16+HW_RST_WD ? " watchdog reset" : " died";
+				else if ((why = diff(r, ref)))
+				{
+					why = strdup(why);
+					if (!diff(r, r0[v]))
+						why = 0;
+				}
+				if (!why)
+					continue;
+				cnt[v][2]++;
+				bad_pt[bad] = i;
+				bad_v[bad] = v;
+				bad_k[bad] = k;
+				bad_why[bad++] = why;
+			}
+
+	printf("pass at %.3f s: %ld points, %ld runs in %.1f s\n", (double)hw_now/HW_CLK, n, runs,
+		(t1.tv_sec-t0.tv_sec) + (t1.tv_nsec-t0.tv_nsec)*1e-9);
+	printf("%-7s %8s %8s %8s %13s\n", "irq", "runs", "masked", "torn", "inconsistent");
+	for (v=0; v<N_V; v++)
+		printf("%-7s %8ld %8ld %8ld %13ld\n", v_name[v], cnt[v][0], cnt[v][1], cnt[v][3], cnt[v][2]);
+
+	listed = verbose || bad < MAX_LIST ? bad : MAX_LIST;
+	loc = malloc((listed+1)*sizeof(*loc));
+	where(bad_pt, listed, loc);
+	for (i=0; i<listed; i++)
+	{
+		struct point *p = &points[bad_pt[i]];
+
+		printf("point %ld %s", bad_pt[i], v_name[bad_v[i]]);
+		if (bad_k[i])
+			printf(" torn after byte %d", bad_k[i]);
+		printf(" %s %u bytes: %s, differs:%s\n", p->write ? "write" : "read", p->size,
+			loc[i], bad_why[i]);
+	}
+	if (listed < bad)
+		printf("... %ld more (-v)\n", bad - listed);
+	exit(bad != 0);
+}
+
+
+//-----------------------------------------------------------------------------
+// Hooks
+//-----------------------------------------------------------------------------
+
+static void mem_access(void *addr, unsigned size, int write, int range, void *pc)
+{
+	unsigned char *a = addr;
+	int v, rmw;
+
+	if (!map)
+		return;
+	// inside an ISR: learn what it touches
+	if (isr_depth >= 0)
+	{
+		if (!in_pass && in_map(a, size))
+			while (size--)
+				map[a++ - (unsigned char *)__data_start] |= (1 + write) << 2*isr_irq;
+		return;
+	}
+	if (tear.addr)
+		tear_end();
+	if (!in_pass)
+	{
+		if (role != R_LEARN || hw_now < t_start || seconds_cnt == idle_sec)
+			return;
+		start_pass();
+	}
+
+	// the 8051 does a byte read-modify-write in one instruction
+	rmw = write && size == 1 && !last_write && last_size == 1 && last_addr == a;
+	if (role == R_COUNT && pt < MAX_POINTS)
+	{
+		struct point *p = &points[pt];
+
+		p->pc = pc;
+		p->addr = a;
+		p->size = size;
+		p->write = write;
+		for (v=0; v<N_V; v++)
+			p->n[v] = rmw ? 0 : 1 + tears(v, a, size, write, range);
+	}
+	else if (role == R_RUN && pt == target)
+		inject(a, size, write);
+	pt++;
+	last_addr = a;
+	last_size = size;
+	last_write = write;
+}
+
+
+#define HOOKS(n) \
+	void __tsan_read##n(void *a) { mem_access(a, n, 0, 0, __builtin_return_address(0)); } \
+	void __tsan_write##n(void *a) { mem_access(a, n, 1, 0, __builtin_return_address(0)); } \
+	void __tsan_unaligned_read##n(void *a) { mem_access(a, n, 0, 0, __builtin_return_address(0)); } \
+	void __tsan_unaligned_write##n(void *a) { mem_access(a, n, 1, 0, __builtin_return_address(0)); }
+HOOKS(1)
+HOOKS(2)
+HOOKS(4)
+HOOKS(8)
+HOOKS(16)
+
+
+void __tsan_read_range(void *a, unsigned long size)
+{
+	mem_access(a, size, 0, 1, __builtin_return_address(0));
+}
+
+
+void __tsan_write_range(void *a, unsigned long size)
+{
+	mem_access(a, size, 1, 1, __builtin_return_address(0));
+}
+
+
+void __tsan_func_entry(void *pc)
+{
+	depth++;
+}
+
+
+void __tsan_func_exit(void)
+{
+	if (--depth == isr_depth)
+		isr_depth = -1;
+	else if (isr_depth < 0 && tear.addr)
+		tear_end();
+}
+
+
+void __tsan_init(void)
+{
+}
+
+
+//-----------------------------------------------------------------------------
+// Chip environment
+//-----------------------------------------------------------------------------
+
+// main idle: the pass ends
+static hw_time wait_ev(hw_time t, int t2)
+{
+	if (in_pass && role != R_LEARN)
+	{
+		if (tear.addr)
+			tear_end();
+		capture(result);
+		if (role == R_COUNT)
+			*n_points = pt;
+		_exit(0);
+	}
+	idle_sec = seconds_cnt;
+	return t;
+}
+
+
+static void step(void)
+{
+	hw_t0_pulses = hw_now * wind / HW_CLK;
+}
+
+
+static unsigned short adc(unsigned char ch, unsigned char ida)
+{
+	long swing = (long)ida - 77;
+
+	switch (ch)
+	{
+	case 0:
+		return 0x8000 + swing*100;
+	case 1:
+		return 0x8000 + swing*100*(long)ratio/65536;
+	default:
+		return 0x8000;
+	}
+}
+
+
+static void on_irq(int vector)
+{
+	isr_depth = depth;
+	isr_irq = vector == 5 ? I_T2 : vector == 10 ? I_ADC : I_UART;
+}
+
+
+int main(int argc, char **argv)
+{
+	static const struct hw_env env = { wait_ev, step, 0, 0, adc, on_irq };
+	double t = 12;
+	int c, r;
+
+	jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((c = getopt(argc, argv, "t:w:r:j:v")) != -1)
+		switch (c)
+		{
+		case 't': t = atof(optarg); break;
+		case 'w': wind = strtoul(optarg, 0, 0); break;
+		case 'r': ratio = strtoul(optarg, 0, 0); break;
+		case 'j': jobs = atol(optarg); break;
+		case 'v': verbose = 1; break;
+		default:
+			fprintf(stderr, "usage: explore [-t s] [-w pulses/s] [-r wd] [-j jobs] [-v]\n");
+			return 2;
+		}
+	if (jobs < 1)
+		jobs = 1;
+
+	map = calloc(_end - __data_start, 1);
+	if (!map)
+		return 1;
+	t_start = (hw_time)(t*HW_CLK);
+	r = hw_run(&env, t_start + 60*HW_CLK);
+	// a run stopped by the model, or no pass found
+	if (role != R_LEARN)
+	{
+		result->status = 16 + r;
+		_exit(0);
+	}
+	printf("no pass: stopped at %.3f s (%d)\n", (double)hw_now/HW_CLK, r);
+	return 1;
+}
@@ -0,0 +1,575 @@
+//-----------------------------------------------------------------------------
+// hw.c
+// TENDONI V2
+// rev1 - RV110905
+// chip model for the native build: Timer0 (wind pulses, or timer in boot.c),
+//   Timer1 (baud rate), Timer2, UART0, ADC0 with IDA0, PCA watchdog, flash
+//-----------------------------------------------------------------------------
+// The firmware runs on the host CPU in zero time between two calls into the
+//   model. In hw_idle() (PCON idle) the model advances to the next event
+//   (Timer2 overflow, end of a conversion or of a UART byte, ...), sets the
+//   flags, and calls the enabled IRQs by priority (PT2), then by vector, as
+//   the 8051 does. So IRQs preempt main only at idle points (explore.c
+//   covers the others). SFR writes are picked up by hw_sync() at the next
+//   entry into the model.
+// Time is counted in cycles of the internal oscillator (HW_CLK), clocks are
+//   divided as set in OSCICN (CLKSCALE).
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+#include "hw.h"
+
+#undef PCON
+
+#define HW_POLL_CYC 16		// cycles per busy-wait iteration (hw_poll)
+#define HW_IRQ_MAX 100		// IRQs served back to back before a flag is stuck
+
+//-----------------------------------------------------------------------------
+// Firmware entry points (main is renamed hw_main), no IRQs in boot.c
+//-----------------------------------------------------------------------------
+void hw_main(void);
+unsigned char _sdcc_external_startup(void);
+void Timer2_ISR(void) __attribute__((weak));
+void ADC0_ISR(void) __attribute__((weak));
+void UART0_ISR(void) __attribute__((weak));
+
+//-----------------------------------------------------------------------------
+// SFRs
+//-----------------------------------------------------------------------------
+hw_port_t hw_p0, hw_p1;
+unsigned char PCON, TCON, TMOD, TH1, TL1, CKCON, PSCTL, FLKEY, OSCICN;
+unsigned char P0MDIN, P0MDOUT, P0SKIP, P1MDIN, P1MDOUT, P1SKIP, XBR0, XBR1;
+unsigned char SCON0, IE, IP, EIE1, VDM0CN, REF0CN, PCA0MD, PCA0CPL2;
+unsigned char IDA0, IDA0CN, TMR2CN;
+unsigned char ADC0CN, ADC0CF, ADC0MD, ADC0CLK, ADC0MUX, ADC0BUF, ADC0DAC;
+unsigned char ADC0FH, ADC0FM, ADC0FL;
+unsigned short TMR0, TMR2, TMR2RL, ADC0DEC;
+unsigned short SBUF0, PCA0CPH2, RSTSRC;
+_Bool EA, ES0, ET2, PT2, TR0, TR1, TF0, RI0, TI0;
+_Bool TR2, TF2H, T2XCLK, AD0INT, AD0CALC;
+
+//-----------------------------------------------------------------------------
+// Global VARIABLES
+//-----------------------------------------------------------------------------
+hw_time hw_now;
+unsigned char hw_flash[HW_FLASH_SIZE] = { [0 ... HW_FLASH_SIZE-1] = 0xFF };
+unsigned char hw_xwin[HW_FLASH_SIZE];
+unsigned long hw_t0_pulses;
+unsigned char hw_rst_flags;
+// not from the datasheet: calibration assumed as long as 4 conversions
+unsigned long hw_ad_cal = 4;
+// CPU stall of flash operations, F35x_FLASH.c: page erase ~20 ms, byte ~40 us
+hw_time hw_flash_erase = HW_MS(20), hw_flash_write = HW_CLK/25000;
+unsigned long hw_wakeups;
+
+static const struct hw_env *env;
+static hw_time end;
+static jmp_buf stop;
+
+// peripheral state
+static hw_time t0_last;			// Timer0 timer mode: time TMR0 was valid
+static unsigned short t0_seen;	// TMR0 as left to the firmware
+static unsigned long t0_pulses;	// hw_t0_pulses counted so far
+static hw_time t2_next;			// next Timer2 overflow, 0: stopped
+static unsigned short t2_seen;	// TMR2 as left to the firmware
+static hw_time wd_last;			// last watchdog reload
+static hw_time tx_end;			// end of the byte being sent, 0: idle
+static unsigned char tx_byte;
+static unsigned char rx_buf[256], rx_head, rx_tail;
+static hw_time rx_next;			// end of the byte being received, 0: none
+static unsigned char rx_last;	// last byte received, read in SBUF0
+static hw_time ad_end;			// end of calibration or conversion, 0: idle
+static unsigned char ad_md;		// ADC0MD as last seen
+static unsigned char ad_ch, ad_ida;
+static unsigned char p1_seen;
+static unsigned char xwin_ref[HW_FLASH_SIZE];	// hw_xwin before the MOVX
+
+
+//-----------------------------------------------------------------------------
+// Clocks, in HW_CLK cycles
+//-----------------------------------------------------------------------------
+
+// SYSCLK divider (OSCICN.IFCN)
+static hw_time sys_div(void)
+{
+	return 1 << (3 - (OSCICN & 3));
+}
+
+
+// Timer0/1 prescaler (CKCON.SCA)
+static hw_time sca(void)
+{
+	static const unsigned char div[4] = { 12, 4, 48, 8 };
+
+	return div[CKCON & 3] * sys_div();
+}
+
+
+static hw_time t0_cyc(void)
+{
+	return (CKCON & 0x04) ? sys_div() : sca();
+}
+
+
+static hw_time t2_cyc(void)
+{
+	return 12 * sys_div();
+}
+
+
+// one byte (start, 8 data, stop) at the Timer1 mode 2 rate, 2 overflows per bit
+static hw_time uart_byte(void)
+{
+	return 10 * 2 * (256 - TH1) * ((CKCON & T1M) ? sys_div() : sca());
+}
+
+
+// one conversion of the fast filter: DEC+1 words of 128 MDCLK
+static hw_time ad_conv(void)
+{
+	return (hw_time)(ADC0DEC+1) * 128 * (ADC0CLK+1) * sys_div();
+}
+
+
+static hw_time wd_end(void)
+{
+	return wd_last + 256 * (hw_time)(PCA0CPL2+1) * 12 * sys_div();
+}
+
+
+//-----------------------------------------------------------------------------
+// Model
+//-----------------------------------------------------------------------------
+
+void hw_stop(int reason)
+{
+	longjmp(stop, reason);
+}
+
+
+void hw_fault(const char *fmt, ...)
+{
+	va_list ap;
+
+	fprintf(stderr, "hw: %.6f s: ", (double)hw_now/HW_CLK);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+	hw_stop(HW_FAULT);
+}
+
+
+// pick up the SFR writes of the firmware since the last call
+static void hw_sync(void)
+{
+	if (PCA0CPH2 < HW_NOWRITE)
+	{
+		PCA0CPH2 = HW_NOWRITE;
+		wd_last = hw_now;
+	}
+	if (RSTSRC < HW_NOWRITE)
+	{
+		if (RSTSRC & SWRSF)
+			hw_stop(HW_RST_SW);
+		RSTSRC = HW_NOWRITE | hw_rst_flags;
+	}
+
+	if (SBUF0 < HW_NOWRITE)
+	{
+		tx_byte = SBUF0;
+		tx_end = hw_now + uart_byte();
+		SBUF0 = HW_NOWRITE | rx_last;
+	}
+
+	// Timer0 count written, Timer2 started, stopped or count written (clk_set)
+	if (TMR0 != t0_seen)
+		t0_last = hw_now;
+	if (!TR2)
+		t2_next = 0;
+	else if (!t2_next || TMR2 != t2_seen)
+		t2_next = hw_now + (0x10000 - TMR2) * t2_cyc();
+
+	// ADC0MD: calibration, single conversion, or stop
+	if (ADC0MD != ad_md)
+	{
+		ad_md = ADC0MD;
+		ad_end = 0;
+		if ((ad_md & 0x87) == 0x81)
+		{
+			AD0CALC = 0;
+			ad_end = hw_now + hw_ad_cal * ad_conv();
+		}
+		else if ((ad_md & 0x87) == 0x82)
+		{
+			ad_ch = (ADC0MUX >> 4) & 0x0F;
+			ad_ida = IDA0;
+			ad_end = hw_now + ad_conv();
+		}
+	}
+
+	if (P1 != p1_seen)
+	{
+		if (env->out)
+			env->out(P1, P1 ^ p1_seen);
+		p1_seen = P1;
+	}
+}
+
+
+// counts left in the running timers, as the firmware would read them
+static void hw_leave(void)
+{
+	if (t2_next)
+	{
+		hw_time cyc = t2_cyc();
+
+		TMR2 = 0x10000 - (t2_next-hw_now+cyc-1)/cyc;
+	}
+	t2_seen = TMR2;
+	t0_seen = TMR0;
+}
+
+
+static hw_time hw_next(int *t2)
+{
+	hw_time t = end;
+
+	*t2 = 0;
+	if (t2_next && t2_next <= t)
+	{
+		t = t2_next;
+		*t2 = 1;
+	}
+	if (tx_end && tx_end < t)
+		t = tx_end;
+	if (rx_next && rx_next < t)
+		t = rx_next;
+	if (ad_end && ad_end < t)
+		t = ad_end;
+	if ((PCA0MD & 0x40) && wd_end() < t)
+		t = wd_end();
+	if (!(TMOD & 0x04) && TR0)
+	{
+		hw_time t0 = t0_last + (0x10000 - TMR0) * t0_cyc();
+
+		if (t0 < t)
+			t = t0;
+	}
+	if (t < hw_now)
+		t = hw_now;
+	if (t != t2_next)
+		*t2 = 0;
+	return t;
+}
+
+
+// run the peripherals up to hw_now
+static void hw_update(void)
+{
+	if (hw_now >= end)
+		hw_stop(HW_END);
+	if ((PCA0MD & 0x40) && hw_now >= wd_end())
+		hw_stop(HW_RST_WD);
+	if (env->step)
+		env->step();
+
+	// Timer0: wind pulses on T0 (counter mode), or SYSCLK (boot.c)
+	if (TMOD & 0x04)
+	{
+		if (TR0)
+			TMR0 += (unsigned short)(hw_t0_pulses-t0_pulses);
+		t0_pulses = hw_t0_pulses;
+	}
+	else if (TR0)
+	{
+		hw_time n = (hw_now-t0_last)/t0_cyc();
+
+		if (TMR0 + n >= 0x10000)
+			TF0 = 1;
+		TMR0 += n;
+		t0_last += n*t0_cyc();
+	}
+	else
+		t0_last = hw_now;
+
+	while (t2_next && hw_now >= t2_next)
+	{
+		TF2H = 1;
+		TMR2 = TMR2RL;
+		t2_next += (0x10000 - TMR2RL) * t2_cyc();
+	}
+
+	if (tx_end && hw_now >= tx_end)
+	{
+		tx_end = 0;
+		TI0 = 1;
+		if (env->tx)
+			env->tx(tx_byte);
+	}
+
+	// RX: a byte arriving while RI0 is still set is lost
+	if (rx_next && hw_now >= rx_next)
+	{
+		if ((SCON0 & 0x10) && !RI0)
+		{
+			rx_last = rx_buf[rx_tail];
+			SBUF0 = HW_NOWRITE | rx_last;
+			RI0 = 1;
+		}
+		rx_tail++;
+		rx_next = rx_tail != rx_head ? rx_next + uart_byte() : 0;
+	}
+
+	if (ad_end && hw_now >= ad_end)
+	{
+		ad_end = 0;
+		if ((ad_md & 7) == 1)
+			AD0CALC = 1;
+		else
+		{
+			unsigned short raw = env->adc ? env->adc(ad_ch, ad_ida) : 0x8000;
+
+			ADC0FH = raw >> 8;
+			ADC0FM = (unsigned char)raw;
+			ADC0FL = 0;
+			AD0INT = 1;
+		}
+		// back to idle mode
+		ADC0MD = ad_md = ad_md & 0xF8;
+	}
+}
+
+
+// wait for the next event and run the peripherals there
+static void hw_event(void)
+{
+	hw_time t;
+	int t2;
+
+	t = hw_next(&t2);
+	if (env->wait)
+		t = env->wait(t, t2);
+	if (t > hw_now)
+		hw_now = t;
+	hw_update();
+}
+
+
+// run the peripherals for cyc cycles, without IRQs (CPU busy or stalled)
+static void hw_stall(hw_time cyc)
+{
+	hw_time t, to;
+	int t2;
+
+	to = hw_now + cyc;
+	while ((t = hw_next(&t2)) < to)
+	{
+		hw_now = t;
+		hw_update();
+	}
+	hw_now = to;
+	hw_update();
+}
+
+
+// serve the pending IRQs, return how many
+static int hw_irq(void)
+{
+	int n, vector;
+	void (*isr)(void);
+
+	for (n=0; EA; n++)
+	{
+		_Bool uart = ES0 && (RI0 || TI0);
+		_Bool t2 = ET2 && TF2H;
+		_Bool adc = (EIE1 & 0x08) && AD0INT;
+
+		if (t2 && (PT2 || !uart))
+		{
+			vector = 5;
+			isr = Timer2_ISR;
+		}
+		else if (uart)
+		{
+			vector = 4;
+			isr = UART0_ISR;
+		}
+		else if (adc)
+		{
+			vector = 10;
+			isr = ADC0_ISR;
+		}
+		else
+			break;
+
+		if (!isr)
+			hw_fault("IRQ %d enabled without ISR", vector);
+		if (n == HW_IRQ_MAX)
+			hw_fault("IRQ %d flag never cleared", vector);
+		hw_leave();
+		if (env->irq)
+			env->irq(vector);
+		isr();
+		hw_sync();
+	}
+	return n;
+}
+
+
+// PCON idle: serve the IRQs already pending (on the chip they would have
+//   preempted main before this point), then sleep until the next one
+unsigned char *hw_idle(unsigned char *pcon)
+{
+	hw_sync();
+	if (!EA)
+		hw_fault("idle with EA=0");
+	hw_irq();
+	do
+		hw_event();
+	while (!hw_irq());
+	hw_wakeups++;
+	hw_leave();
+	return pcon;
+}
+
+
+_Bool *hw_poll(_Bool *flag)
+{
+	hw_sync();
+	if (!*flag)
+	{
+		hw_stall(HW_POLL_CYC);
+		hw_irq();
+	}
+	hw_leave();
+	return flag;
+}
+
+
+// explore.c: main is preempted here by the next IRQ of this vector (5 or
+//   10), as if the code before had run until then: the peripherals run up to
+//   its flag, then the pending IRQs are served. 0 if it is masked or none is
+//   coming (no conversion running)
+int hw_preempt(int vector)
+{
+	_Bool *flag = vector == 5 ? &TF2H : &AD0INT;
+	int t2, r = 0;
+
+	hw_sync();
+	if (EA && (vector == 5 ? ET2 : (EIE1 & 0x08) != 0))
+	{
+		while (!*flag && (vector == 5 ? t2_next : ad_end))
+		{
+			hw_now = hw_next(&t2);
+			hw_update();
+		}
+		if (*flag)
+		{
+			hw_irq();
+			r = 1;
+		}
+	}
+	hw_leave();
+	return r;
+}
+
+
+// PSCTL write: the MOVX done with PSWE set (found in hw_xwin) erases or
+//   writes the flash, then hw_xwin is prepared for the next operation
+void hw_psctl(unsigned char val)
+{
+	unsigned short a;
+
+	hw_sync();
+	if (PSCTL & PSWE)
+		for (a=0; a<HW_FLASH_SIZE; a++)
+		{
+			if (hw_xwin[a] == xwin_ref[a])
+				continue;
+			if ((a & ~(HW_FLASH_PAGE-1)) >= HW_LOCK_PAGE)
+				hw_fault("flash %s at 0x%04X, page of the lock byte",
+					(PSCTL & PSEE) ? "erase" : "write", a);
+			if (PSCTL & PSEE)
+			{
+				memset(hw_flash + (a & ~(HW_FLASH_PAGE-1)), 0xFF, HW_FLASH_PAGE);
+				hw_stall(hw_flash_erase);
+			}
+			else
+			{
+				hw_flash[a] &= hw_xwin[a];
+				hw_stall(hw_flash_write);
+			}
+		}
+
+	PSCTL = val;
+	if (val & PSWE)
+	{
+		// erase writes any value, look for a change from 0xFF; a write
+		//   equal to the flash content wouldn't change it anyway
+		if (val & PSEE)
+			memset(hw_xwin, 0xFF, HW_FLASH_SIZE);
+		else
+			memcpy(hw_xwin, hw_flash, HW_FLASH_SIZE);
+		memcpy(xwin_ref, hw_xwin, HW_FLASH_SIZE);
+	}
+	hw_leave();
+}
+
+
+// queue bytes to UART0 RX, back to back at the current baud rate
+void hw_rx(const unsigned char *buf, unsigned char len)
+{
+	while (len--)
+	{
+		if ((unsigned char)(rx_head+1) == rx_tail)
+			hw_fault("RX queue full");
+		rx_buf[rx_head++] = *buf++;
+		if (!rx_next)
+			rx_next = hw_now + uart_byte();
+	}
+}
+
+
+// reset state of the SFRs we model
+static void hw_reset(void)
+{
+	P0 = 0xFF;
+	P1 = 0xFF;
+	p1_seen = P1;
+	OSCICN = 0x80;						// SYSCLK/8
+	PCA0MD = 0x40;						// watchdog on
+	PCA0CPL2 = 0;
+	TMR2 = 0;
+	ADC0DEC = 0x7FF;
+	SBUF0 = HW_NOWRITE;
+	PCA0CPH2 = HW_NOWRITE;
+	RSTSRC = HW_NOWRITE | hw_rst_flags;
+	wd_last = hw_now;
+	t0_last = hw_now;
+	t0_pulses = hw_t0_pulses;
+}
+
+
+// run the firmware from reset until end (absolute time) or a reset,
+//   return the reason (HW_END...); the firmware state is left as it is,
+//   so each run needs a fresh process
+int hw_run(const struct hw_env *e, hw_time t_end)
+{
+	int r;
+
+	env = e;
+	end = t_end;
+	hw_reset();
+	r = setjmp(stop);
+	if (r == 0)
+	{
+		_sdcc_external_startup();
+		hw_sync();
+		hw_main();
+		r = HW_RET;
+	}
+	return r;
+}
@@ -0,0 +1,161 @@
+// hw.h
+// TENDONI V2
+// rev1 - RV110905
+// native build of the firmware (build.sh host): included in place of
+//   C8051F350.h, SFRs are host variables run by the chip model in hw.c
+
+#ifndef _HW_H_
+#define _HW_H_
+
+//-----------------------------------------------------------------------------
+// SDCC keywords
+//-----------------------------------------------------------------------------
+// build.sh also removes __interrupt/__using and __asm blocks, and rewrites
+//   the flash pointer casts with HW_XWIN/HW_CODE and PSCTL writes with hw_psctl
+
+#define __bit _Bool			// assignments give 0/1, as with the 8051 bits
+#define __code const
+#define __data
+#define __idata
+#define __xdata
+#define __naked
+#define __reentrant
+#define __at(a)				// absolute placement: hw_flash holds the whole flash
+
+//-----------------------------------------------------------------------------
+// Global CONSTANTS
+//-----------------------------------------------------------------------------
+
+// bit masks used by the firmware, as in C8051F350.h
+#define PCON_IDLE 0x01
+#define T1M 0x08
+#define PSWE 0x01
+#define PSEE 0x02
+#define SWRSF 0x10
+
+#define HW_CLK 24500000ULL	// time unit: internal oscillator cycles (SYSCLK/1)
+#define HW_MS(ms) ((hw_time)(ms)*(HW_CLK/1000))
+#define HW_FLASH_SIZE 0x2000
+#define HW_FLASH_PAGE 512
+#define HW_LOCK_PAGE 0x1C00	// page of the lock byte
+#define HW_NOWRITE 0x100	// in the watched SFRs below: not written since last seen
+
+// hw_run() results
+#define HW_END 1			// end time reached
+#define HW_RST_WD 2			// watchdog reset
+#define HW_RST_SW 3			// software reset (RSTSRC)
+#define HW_RET 4			// main() returned (boot.c started the application)
+#define HW_FAULT 5			// model misuse: idle with EA=0, lock byte page erased...
+
+//-----------------------------------------------------------------------------
+// SFRs
+//-----------------------------------------------------------------------------
+
+typedef union
+{
+	unsigned char byte;
+	struct
+	{
+		_Bool b0:1, b1:1, b2:1, b3:1, b4:1, b5:1, b6:1, b7:1;
+	} bit;
+} hw_port_t;
+
+extern hw_port_t hw_p0, hw_p1;
+#define P0 hw_p0.byte
+#define P1 hw_p1.byte
+#define P0_0 hw_p0.bit.b0
+#define P0_1 hw_p0.bit.b1
+#define P1_0 hw_p1.bit.b0
+#define P1_1 hw_p1.bit.b1
+#define P1_2 hw_p1.bit.b2
+#define P1_3 hw_p1.bit.b3
+#define P1_4 hw_p1.bit.b4
+
+extern unsigned char PCON, TCON, TMOD, TH1, TL1, CKCON, PSCTL, FLKEY, OSCICN;
+extern unsigned char P0MDIN, P0MDOUT, P0SKIP, P1MDIN, P1MDOUT, P1SKIP, XBR0, XBR1;
+extern unsigned char SCON0, IE, IP, EIE1, VDM0CN, REF0CN, PCA0MD, PCA0CPL2;
+extern unsigned char IDA0, IDA0CN, TMR2CN;
+extern unsigned char ADC0CN, ADC0CF, ADC0MD, ADC0CLK, ADC0MUX, ADC0BUF, ADC0DAC;
+extern unsigned char ADC0FH, ADC0FM, ADC0FL;
+
+// 16 bit SFRs, with their byte halves
+extern unsigned short TMR0, TMR2, TMR2RL, ADC0DEC;
+#define TL0 (((unsigned char *)&TMR0)[0])
+#define TH0 (((unsigned char *)&TMR0)[1])
+#define TMR2L (((unsigned char *)&TMR2)[0])
+#define TMR2H (((unsigned char *)&TMR2)[1])
+
+// SFRs whose writes start something: HW_NOWRITE (plus the value read) until
+//   the firmware writes them, picked up at the next hw_sync()
+extern unsigned short SBUF0;	// TX on write, RX byte on read
+extern unsigned short PCA0CPH2;	// watchdog reload on write
+extern unsigned short RSTSRC;	// reset flags on read, SWRSF write resets
+
+// bits
+extern _Bool EA, ES0, ET2, PT2, TR0, TR1, TF0, RI0, TI0;
+extern _Bool TR2, TF2H, T2XCLK, AD0INT, AD0CALC;
+#define TF2 TF2H
+
+// idle: run the peripherals and the IRQs until an IRQ has been served
+#define PCON (*hw_idle(&PCON))
+
+#ifdef HW_POLL
+// busy-wait loops (boot.c): each read of a flag runs the peripherals for
+//   HW_POLL_CYC cycles, about one loop iteration
+#define RI0 (*hw_poll(&RI0))
+#define TI0 (*hw_poll(&TI0))
+#define TF0 (*hw_poll(&TF0))
+#endif
+#ifdef HW_POLL_CAL
+// the same for the calibration wait of ADC0_Init in trees before ADC0_Poll
+//   (HOSTFLAGS=-DHW_POLL_CAL, to compare them with startup.c)
+#define AD0CALC (*hw_poll(&AD0CALC))
+#endif
+
+// flash as seen by MOVX writes (PSWE) and by MOVC reads
+#define HW_XWIN(a) (hw_xwin + (unsigned short)(a))
+#define HW_CODE(a) ((const unsigned char *)hw_flash + (unsigned short)(a))
+
+//-----------------------------------------------------------------------------
+// Model interface
+//-----------------------------------------------------------------------------
+
+typedef unsigned long long hw_time;
+
+// what is outside the chip, supplied by each tool; any hook may be 0
+struct hw_env
+{
+	// wait for the next event at t: the simulation just returns t, a real
+	//   time port sleeps and may return earlier when an input arrives
+	//   (t2 = 1 if the event is a Timer2 tick, the only one worth sleeping for)
+	hw_time (*wait)(hw_time t, int t2);
+	void (*step)(void);				// at every event time: update the inputs
+	void (*out)(unsigned char p1, unsigned char changed);	// P1 outputs changed
+	void (*tx)(unsigned char c);	// byte sent on UART0
+	// A/D conversion result (16 bit, ADC0FH:FM) for channel ch (ADC0MUX
+	//   AINP) with excitation ida (IDA0 at conversion start)
+	unsigned short (*adc)(unsigned char ch, unsigned char ida);
+	void (*irq)(int vector);		// before each IRQ (vector 4, 5, 10)
+};
+
+extern hw_time hw_now;				// current time
+extern unsigned char hw_flash[HW_FLASH_SIZE];
+extern unsigned char hw_xwin[HW_FLASH_SIZE];
+extern unsigned long hw_t0_pulses;	// pulses on T0 (P0.0), Timer0 counter mode
+extern unsigned char hw_rst_flags;	// RSTSRC read by the firmware after reset
+extern unsigned long hw_ad_cal;		// A/D calibration, in conversion periods
+extern hw_time hw_flash_erase, hw_flash_write;	// CPU stall per operation
+extern unsigned long hw_wakeups;	// hw_idle() returns
+
+int hw_run(const struct hw_env *env, hw_time end);	// HW_END...
+void hw_stop(int reason);
+void hw_rx(const unsigned char *buf, unsigned char len);	// queue bytes to UART0 RX
+int hw_preempt(int vector);			// next IRQ of vector 5 or 10 right now (explore.c)
+__attribute__((format(printf, 1, 2))) void hw_fault(const char *fmt, ...);
+
+// used through the SFR macros above
+unsigned char *hw_idle(unsigned char *pcon);
+_Bool *hw_poll(_Bool *flag);
+void hw_psctl(unsigned char val);
+
+#endif // _HW_H_
@@ -0,0 +1,237 @@
+//-----------------------------------------------------------------------------
+// kverify.c
+// TENDONI V2
+// rev1 - RV110905
+// exhaustive check of the fixed point kernels (kernels.h) against the
+//   original expressions, as SDCC computes them
+//-----------------------------------------------------------------------------
+// usage: kverify [-j threads] [-s stride] [kernel...]
+//   -j  threads (default: all cores)
+//   -s  check every stride-th value of the first operand (default 1: all)
+//   kernel names: filt_w filt_p filt_w_hum filt_p_hum wd_ratio dc_th wd_th
+//     (default all)
+// Filters and ratio: all 2^32 pairs (y, x) or (wd_a, wd_b); pots: all 2^16.
+// For each kernel prints the pairs checked, mismatches, max |error| and the
+//   first mismatch. Exit status 1 if any kernel doesn't match.
+//
+// The references are written with explicit 32 bit types, since on SDCC
+//   long is 32 bit and int 16 bit, while the host long is 64 bit: e.g. in
+//   wd_a*65536L the product wraps negative for wd_a >= 32768 on the chip.
+//   A filter sum beyond 31 bits (impossible with a+b = 32768) is reported
+//   as a mismatch of the reference itself.
+// Rows of the first operand are shared among the threads; the inner loops
+//   have no branches, so the compiler vectorizes them (build.sh uses -O3).
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../kernels.h"
+
+struct kernel;
+typedef void (*row_fn)(const struct kernel *k, unsigned y, unsigned short *fw, unsigned short *ref);
+
+struct kernel
+{
+	const char *name;
+	const char *expr;		// original expression
+	long a, b;				// filter coefficients, as in F35x_ADC0.c
+	int pairs;				// 1: 2^32 pairs, 0: 2^16 values (row 0 only)
+	row_fn row;
+	// results
+	unsigned long long checked, mismatches;
+	unsigned max_err;
+	int first;				// first mismatch found
+	unsigned first_y, first_x, first_fw, first_ref;
+};
+
+
+//-----------------------------------------------------------------------------
+// Kernels and references, one row (fixed first operand) at a time
+//-----------------------------------------------------------------------------
+
+// (unsigned short)((y*a + x*b) >> 15), y and x promoted to 32 bit long
+static void row_filt(const struct kernel *k, unsigned y, unsigned short *fw, unsigned short *ref)
+{
+	long a = k->a, b = k->b;
+	unsigned x;
+
+	for (x=0; x<65536; x++)
+	{
+		int64_t sum = (int64_t)y*(int32_t)a + (int64_t)x*(int32_t)b;
+
+		fw[x] = K_FILT((unsigned short)y, (unsigned short)x, a, b);
+		// beyond 31 bits the chip would wrap: flag it with an impossible value
+		ref[x] = sum > INT32_MAX ? (unsigned short)~fw[x] : (unsigned short)((int32_t)sum >> 15);
+	}
+}
+
+
+// (unsigned short)(wd_a*65536L/wd_b), 65535 for wd_b = 0
+static void row_wd_ratio(const struct kernel *k, unsigned wd_a, unsigned short *fw, unsigned short *ref)
+{
+	int32_t num = (int32_t)((uint32_t)wd_a << 16);	// wraps as _mullong
+	unsigned wd_b;
+
+	fw[0] = K_WD_RATIO((unsigned short)wd_a, (unsigned short)0);
+	ref[0] = 65535;
+	for (wd_b=1; wd_b<65536; wd_b++)
+	{
+		fw[wd_b] = K_WD_RATIO((unsigned short)wd_a, (unsigned short)wd_b);
+		ref[wd_b] = (unsigned short)(num / (int32_t)wd_b);	// truncates toward 0
+	}
+}
+
+
+// dc_th = 39-(unsigned char)(pot >> 11), into unsigned char
+static void row_dc_th(const struct kernel *k, unsigned y, unsigned short *fw, unsigned short *ref)
+{
+	unsigned pot;
+
+	for (pot=0; pot<65536; pot++)
+	{
+		fw[pot] = (unsigned char)K_DC_TH((unsigned short)pot);
+		ref[pot] = (unsigned char)(39 - (uint8_t)(pot >> 11));
+	}
+}
+
+
+// wd_th = (pot >> 1)+8192, into unsigned short
+static void row_wd_th(const struct kernel *k, unsigned y, unsigned short *fw, unsigned short *ref)
+{
+	unsigned pot;
+
+	for (pot=0; pot<65536; pot++)
+	{
+		fw[pot] = (unsigned short)K_WD_TH((unsigned short)pot);
+		ref[pot] = (unsigned short)((int16_t)(pot >> 1) + 8192);
+	}
+}
+
+
+static struct kernel kernels[] =
+{
+	{ "filt_w", "(y*32361L + x*407L) >> 15", 32361, 407, 1, row_filt },
+	{ "filt_p", "(y*30783L + x*1985L) >> 15", 30783, 1985, 1, row_filt },
+	{ "filt_w_hum", "(y*30854L + x*1914L) >> 15", 30854, 1914, 1, row_filt },
+	{ "filt_p_hum", "(y*24253L + x*8515L) >> 15", 24253, 8515, 1, row_filt },
+	{ "wd_ratio", "wd_a*65536L/wd_b", 0, 0, 1, row_wd_ratio },
+	{ "dc_th", "39-(unsigned char)(pot >> 11)", 0, 0, 0, row_dc_th },
+	{ "wd_th", "(pot >> 1)+8192", 0, 0, 0, row_wd_th },
+};
+#define N_KERNELS (sizeof(kernels)/sizeof(kernels[0]))
+
+//-----------------------------------------------------------------------------
+// Sweep
+//-----------------------------------------------------------------------------
+
+static struct kernel *cur;
+static unsigned next_row, stride = 1;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static void *worker(void *arg)
+{
+	static __thread unsigned short fw[65536], ref[65536];
+	unsigned y, x, rows = cur->pairs ? 65536 : 1;
+
+	while (1)
+	{
+		unsigned long long n = 0;
+		unsigned max = 0;
+
+		pthread_mutex_lock(&lock);
+		y = next_row;
+		next_row += stride;
+		pthread_mutex_unlock(&lock);
+		if (y >= rows)
+			break;
+
+		cur->row(cur, y, fw, ref);
+		for (x=0; x<65536; x++)
+		{
+			unsigned e = fw[x] > ref[x] ? fw[x] - ref[x] : ref[x] - fw[x];
+
+			n += e != 0;
+			max = e > max ? e : max;
+		}
+
+		pthread_mutex_lock(&lock);
+		cur->checked += 65536;
+		cur->mismatches += n;
+		if (max > cur->max_err)
+			cur->max_err = max;
+		if (n)
+			for (x=0; x<65536; x++)
+				if (fw[x] != ref[x])
+				{
+					if (!cur->first || y < cur->first_y || (y == cur->first_y && x < cur->first_x))
+					{
+						cur->first = 1;
+						cur->first_y = y;
+						cur->first_x = x;
+						cur->first_fw = fw[x];
+						cur->first_ref = ref[x];
+					}
+					break;
+				}
+		pthread_mutex_unlock(&lock);
+	}
+	return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+	pthread_t th[256];
+	long nth = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned i;
+	int c, t, rc = 0;
+
+	while ((c = getopt(argc, argv, "j:s:")) != -1)
+		switch (c)
+		{
+		case 'j': nth = atol(optarg); break;
+		case 's': stride = strtoul(optarg, 0, 0); break;
+		default:
+			fprintf(stderr, "usage: kverify [-j threads] [-s stride] [kernel...]\n");
+			return 2;
+		}
+	if (nth < 1)
+		nth = 1;
+	if (nth > 256)
+		nth = 256;
+	if (stride < 1)
+		stride = 1;
+
+	for (i=0; i<N_KERNELS; i++)
+	{
+		cur = &kernels[i];
+		if (optind < argc)
+		{
+			for (c=optind; c<argc && strcmp(argv[c], cur->name); c++)
+				;
+			if (c == argc)
+				continue;
+		}
+
+		next_row = 0;
+		for (t=0; t<nth; t++)
+			pthread_create(&th[t], 0, worker, 0);
+		for (t=0; t<nth; t++)
+			pthread_join(th[t], 0);
+
+		printf("%-10s %-32s %11llu checked, %llu mismatches, max error %u",
+			cur->name, cur->expr, cur->checked, cur->mismatches, cur->max_err);
+		if (cur->first)
+		{
+			printf(", first at (%u, %u): %u instead of %u",
+				cur->first_y, cur->first_x, cur->first_fw, cur->first_ref);
+			rc = 1;
+		}
+		printf("\n");
+	}
+	return rc;
+}
@@ -0,0 +1,305 @@
+//-----------------------------------------------------------------------------
+// latbench.c
+// TENDONI V2
+// rev1 - RV110905
+// end to end detection latency of the native firmware, for regressions
+//-----------------------------------------------------------------------------
+// usage: latbench [-n trials] [-j jobs] [-c ref | -w ref]
+//   -n  trials per scenario, pot setting and noise level (default 8), each
+//       with its own phase of the event in the second
+//   -j  runs in parallel (default: all cores)
+//   -c  compare with a reference file: fails if a p50 or p90 is later than
+//       in the reference by more than 25 ms and 5%, or an edge is missing
+//   -w  write the reference file
+// Each run powers on the firmware (fresh process), lets it settle for
+//   LB_SETTLE s, then steps one input at the event time:
+//   rain    wd from dry to wet        -> LEDR=0 (pre-alarm), RL_AUTO=1, TRIAC_OFF=0
+//   gust    pulses from 0 to 1.5 dc_th+2 per s, same edges
+//   dry     wd back to dry 60 s after a rain alarm -> RL_AUTO=1 with RL_DOWN=1
+//   button  DI_DOWN pressed for 0.5 s -> bAutoDown=0
+// Pots: wind threshold dc_th 39, 23, 9 (pot 2) with water setpoint wd_th
+//   12288, 24576, 36864 (pot 3); noise: +-0, 32, 256 LSB on the water
+//   sensor channels. Rows aggregate pots and phases; latencies in ms.
+// build.sh check runs it against host/latbench.ref.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "hw.h"
+#include "../main.h"
+#include "../kernels.h"
+
+#define LB_SETTLE 10		// s from power on to the event
+#define LB_DRY_AFTER 60		// dry scenario: s of rain before drying
+#define LB_MAX_EDGES 3
+#define N_POTS 3
+#define N_NOISE 3
+#define MAX_TRIALS 64
+
+enum { SC_RAIN, SC_GUST, SC_DRY, SC_BUTTON, N_SC };
+
+static const struct scenario
+{
+	const char *name;
+	int n_edges;
+	const char *edge[LB_MAX_EDGES];
+	double max_s;			// run length after the event
+} sc[N_SC] =
+{
+	{ "rain", 3, { "LEDR", "RL_AUTO", "TRIAC" }, 60 },
+	{ "gust", 3, { "LEDR", "RL_AUTO", "TRIAC" }, 60 },
+	{ "dry", 1, { "down" }, 5*3600 },
+	{ "button", 1, { "bAutoDown" }, 10 },
+};
+
+static const unsigned short pot2[N_POTS] = { 0x0000, 0x8000, 0xF000 };
+static const unsigned short pot3[N_POTS] = { 0x2000, 0x8000, 0xE000 };
+static const unsigned noise[N_NOISE] = { 0, 32, 256 };
+
+// current run
+static int s_id, s_pot, s_noise;
+static hw_time t_event;
+static double lat[LB_MAX_EDGES];	// ms, -1 if not seen
+static unsigned wd_dry, wd_wet, gust;
+static uint64_t rnd_s;
+
+
+static unsigned long long rnd(void)
+{
+	rnd_s ^= rnd_s << 13;
+	rnd_s ^= rnd_s >> 7;
+	rnd_s ^= rnd_s << 17;
+	return rnd_s;
+}
+
+
+static void edge(int i)
+{
+	if (lat[i] < 0 && hw_now >= t_event)
+		lat[i] = (double)(hw_now - t_event) * 1000 / HW_CLK;
+}
+
+
+static unsigned wd_now(void)
+{
+	if (s_id == SC_RAIN && hw_now >= t_event)
+		return wd_wet;
+	if (s_id == SC_DRY && hw_now < t_event && hw_now >= t_event - LB_DRY_AFTER*HW_CLK)
+		return wd_wet;
+	return wd_dry;
+}
+
+
+static void step(void)
+{
+	// gust: a regular pulse train
+	if (s_id == SC_GUST && hw_now > t_event)
+		hw_t0_pulses = (hw_now - t_event) * gust / HW_CLK;
+	if (s_id == SC_BUTTON)
+	{
+		P0_1 = !(hw_now >= t_event && hw_now < t_event + HW_MS(500));
+		if (!bAutoDown)
+			edge(0);
+	}
+	if (hw_now >= t_event + (hw_time)(sc[s_id].max_s*HW_CLK))
+		hw_stop(HW_END);
+}
+
+
+static unsigned short adc(unsigned char ch, unsigned char ida)
+{
+	long swing = (long)ida - 77, n = noise[s_noise];
+
+	n = n ? (long)(rnd() % (2*n+1)) - n : 0;
+	switch (ch)
+	{
+	case 0:
+		return 0x8000 + swing*100 + n;
+	case 1:
+		return 0x8000 + swing*100*(long)wd_now()/65536 + n;
+	case 2:
+		return pot2[s_pot];
+	default:
+		return pot3[s_pot];
+	}
+}
+
+
+static void out(unsigned char p1, unsigned char changed)
+{
+	if (s_id == SC_RAIN || s_id == SC_GUST)
+	{
+		if ((changed & 0x08) && !(p1 & 0x08))
+			edge(0);
+		if ((changed & p1 & 0x01) && !(p1 & 0x10))
+			edge(1);
+		if ((changed & 0x02) && !(p1 & 0x02))
+			edge(2);
+	}
+	else if (s_id == SC_DRY && (changed & p1 & 0x01) && (p1 & 0x10))
+		edge(0);
+}
+
+
+// one run in a child process, latencies to r (shared with the parent)
+static void run(double *r, int id, int pot, int nz, int trial)
+{
+	static const struct hw_env env = { 0, step, out, 0, adc, 0 };
+	unsigned dc_th, wd_th;
+	int i;
+
+	s_id = id;
+	s_pot = pot;
+	s_noise = nz;
+	rnd_s = 0x9E3779B97F4A7C15ULL ^ (id << 24 | pot << 16 | nz << 8 | trial);
+	t_event = LB_SETTLE*HW_CLK + rnd() % HW_CLK;
+	if (id == SC_DRY)
+		t_event += LB_DRY_AFTER*HW_CLK;
+	dc_th = K_DC_TH(pot2[pot]);
+	wd_th = K_WD_TH(pot3[pot]);
+	gust = dc_th*3/2 + 2;
+	wd_dry = 50000;
+	wd_wet = wd_th/3;
+	for (i=0; i<LB_MAX_EDGES; i++)
+		lat[i] = -1;
+
+	hw_run(&env, ~(hw_time)0);
+	memcpy(r, lat, sizeof(lat));
+	_exit(0);
+}
+
+
+static int cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+
+// p-th percentile, nearest rank; -1 (missing edge) sorts first: any miss
+//   makes the max and the row invalid
+static double pct(double *v, int n, double p)
+{
+	int k = (int)(p/100*n + 0.999999);
+
+	return v[k < 1 ? 0 : k-1];
+}
+
+
+int main(int argc, char **argv)
+{
+	double (*res)[N_POTS][N_NOISE][MAX_TRIALS][LB_MAX_EDGES];
+	const char *ref = 0, *wref = 0;
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	int trials = 8, c, id, pot, nz, t, e, running = 0, fail = 0;
+	FILE *f = 0;
+
+	while ((c = getopt(argc, argv, "n:j:c:w:")) != -1)
+		switch (c)
+		{
+		case 'n': trials = atoi(optarg); break;
+		case 'j': jobs = atol(optarg); break;
+		case 'c': ref = optarg; break;
+		case 'w': wref = optarg; break;
+		default:
+			fprintf(stderr, "usage: latbench [-n trials] [-j jobs] [-c ref | -w ref]\n");
+			return 2;
+		}
+	if (trials < 1 || trials > MAX_TRIALS)
+		trials = 8;
+	if (jobs < 1)
+		jobs = 1;
+
+	// results of all runs, written by the children
+	res = mmap(0, sizeof(*res)*N_SC, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (res == MAP_FAILED)
+		return 1;
+	memset(res, 0xFF, sizeof(*res)*N_SC);		// runs that die leave NaN: edge missing
+
+	// fork the runs, at most jobs at a time
+	for (id=0; id<N_SC; id++)
+		for (pot=0; pot<N_POTS; pot++)
+			for (nz=0; nz<N_NOISE; nz++)
+				for (t=0; t<trials; t++)
+				{
+					if (running == jobs)
+					{
+						wait(0);
+						running--;
+					}
+					if (fork() == 0)
+						run(res[id][pot][nz][t], id, pot, nz, t);
+					running++;
+				}
+	while (wait(0) > 0)
+		;
+
+	if (ref && !(f = fopen(ref, "r")))
+	{
+		perror(ref);
+		return 1;
+	}
+	if (wref && !(f = fopen(wref, "w")))
+	{
+		perror(wref);
+		return 1;
+	}
+	printf("%-7s %-10s %5s %9s %9s %9s %9s\n", "event", "edge", "noise", "p50", "p90", "p99", "max");
+	for (id=0; id<N_SC; id++)
+		for (e=0; e<sc[id].n_edges; e++)
+			for (nz=0; nz<N_NOISE; nz++)
+			{
+				double v[N_POTS*MAX_TRIALS], p50, p90, p99, max;
+				int n = 0;
+
+				for (pot=0; pot<N_POTS; pot++)
+					for (t=0; t<trials; t++)
+					{
+						v[n] = res[id][pot][nz][t][e];
+						if (v[n] != v[n])
+							v[n] = -1;
+						n++;
+					}
+				qsort(v, n, sizeof(v[0]), cmp);
+				p50 = pct(v, n, 50);
+				p90 = pct(v, n, 90);
+				p99 = pct(v, n, 99);
+				max = v[0] < 0 ? -1 : v[n-1];
+				printf("%-7s %-10s %5u %9.1f %9.1f %9.1f %9.1f", sc[id].name, sc[id].edge[e],
+					noise[nz], p50, p90, p99, max);
+				if (v[0] < 0)
+				{
+					printf("  edge missing");
+					fail = 1;
+				}
+				if (wref)
+					fprintf(f, "%s %s %u %.1f %.1f\n", sc[id].name, sc[id].edge[e], noise[nz], p50, p90);
+				else if (ref)
+				{
+					char name[16], edge_name[16];
+					unsigned rnz;
+					double r50, r90;
+
+					if (fscanf(f, "%15s %15s %u %lf %lf", name, edge_name, &rnz, &r50, &r90) != 5
+						|| strcmp(name, sc[id].name) || strcmp(edge_name, sc[id].edge[e]) || rnz != noise[nz])
+					{
+						printf("  not in %s\n", ref);
+						return 1;
+					}
+					if ((p50 > r50 + 25 && p50 > r50 * 1.05) || (p90 > r90 + 25 && p90 > r90 * 1.05))
+					{
+						printf("  REGRESSION (ref %.1f %.1f)", r50, r90);
+						fail = 1;
+					}
+				}
+				printf("\n");
+			}
+	if (f)
+		fclose(f);
+	return fail;
+}
@@ -0,0 +1,597 @@
+//-----------------------------------------------------------------------------
+// mc.c
+// TENDONI V2
+// rev1 - RV110905
+// Monte Carlo fleet runs: many controllers at once, as struct of arrays
+//-----------------------------------------------------------------------------
+// usage: mc [-n units] [-d days] [-s seed] [-2 pot] [-3 pot] [-w scale]
+//           [-r prob] [-j threads] [-v units]
+//   -n  controllers (default 65536), each with its own weather seed, pots
+//       and location profile
+//   -d  days of 1s loops of each controller (default 1)
+//   -s  seed of the fleet draw (default 1)
+//   -2  wind threshold pot, -3 water setpoint pot (default: random per unit)
+//   -w  SIM_WIND_SCALE, -r SIM_RAIN_PROB of the profile (default: random per
+//       unit, 8-16 pulses/s and 4-18/65536 per s)
+//   -j  threads (default: all cores)
+//   -v  validate the first units against the native firmware: state frame
+//       and counters of every 1s loop (default 0)
+// Each unit is the 1s loop of main.c built with SIMWEATHER SIMNOAD: the
+//   weather of sim.c, det_wind and det_water with their timers, hold_second,
+//   moves and TMR_AUTODOWN, no peer on the link. A move takes the seconds of
+//   move_updown, without 1s loops meanwhile; the next loop runs at once.
+// The state of BLK units is kept as one array per variable, 32 bit lanes
+//   with the 8/16 bit wraps of the firmware made explicit; every step is a
+//   loop over the block without branches (selects), so the compiler
+//   vectorizes it (build.sh uses -O3 -march=native). A block stays in the
+//   L1 cache for all its seconds; threads take blocks in turn.
+// -v runs each unit also on the firmware objects of difftest (fresh process
+//   per unit) and compares the state frame (state_dump) and the sim.c and
+//   hold.c counters at each call of link_send(LINK_T_STATE) (--wrap).
+// Prints false alarms and tents-up time, totals and per unit-day percentiles,
+//   and the simulated unit-seconds per second of the fleet run.
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "hw.h"
+#include "../main.h"
+#include "../F35x_ADC0.h"
+#include "../link.h"
+#include "../detect.h"
+#include "../kernels.h"
+#include "../hold.h"
+#include "../sim.h"
+
+#define BLK 64				// units per block
+#define N_WIN (WIND_GUST_EVENTS-1)	// wind windows (TMR_WIND0...) in use
+#define MAX_THREADS 256
+#define N_CNT 8
+
+// state of a block, lane i of each array is unit i
+struct blk
+{
+	// weather (sim.c) and profile
+	uint32_t st[BLK], period[BLK], mean[BLK], gust[BLK], gmul[BLK], rain[BLK], wd[BLK], recent[BLK];
+	uint32_t btn[BLK], scale[BLK], rainp[BLK];
+	// pots
+	uint32_t dc_th[BLK], wd_th[BLK];
+	// main.c: uptime of the next 1s loop, timer deadlines (0: not armed)
+	uint32_t up[BLK], win[N_WIN][BLK], adl[BLK];
+	uint32_t down[BLK], autod[BLK], moved[BLK], bbtn[BLK];
+	// det_water.c
+	uint32_t wt[BLK], wp1[BLK], wp2[BLK], wmin[BLK], wcnt[BLK];
+	// hold.c
+	uint32_t hlen[BLK], hmin[BLK], hcause[BLK], hcalm[BLK], havg[BLK], hearly[BLK], hearly_at[BLK];
+	// this loop, as in state_dump
+	uint32_t now[BLK], ticks[BLK], wdv[BLK], pre[BLK], alm[BLK], events[BLK];
+	// counters: sim_alarms, sim_false, sim_retract, sim_up, sim_up_clear,
+	//   hold_early, hold_relapse, hold_saved
+	uint32_t cnt[N_CNT][BLK];
+};
+
+// state frame and counters after a 1s loop (-v)
+struct rec
+{
+	unsigned char frame[16];
+	uint32_t cnt[N_CNT];
+};
+
+static struct blk *blk;
+static unsigned n_blk, loops, n_val;
+static struct rec *val;			// [n_val][loops]
+static unsigned long pot2 = ~0UL, pot3 = ~0UL, scale = ~0UL, rainp = ~0UL;
+static unsigned next_blk;
+static uint64_t fleet = 1;
+static uint32_t weibull[16];	// sim_weibull, 32 bit for the vector loads
+
+// firmware (difftest objects), for -v
+extern const unsigned short sim_weibull[16];
+extern unsigned short sim_pot2, sim_pot3;
+extern unsigned short sim_alarms, sim_false, sim_retract, hold_early, hold_relapse;
+extern unsigned long sim_up, sim_up_clear, hold_saved;
+char __real_link_send(unsigned char type, unsigned char *payload, unsigned char len);
+
+
+// sim_rand() on a 16 bit state
+static inline uint32_t xs(uint32_t s)
+{
+	s = (s ^ s << 7) & 0xFFFF;
+	s ^= s >> 9;
+	return (s ^ s << 8) & 0xFFFF;
+}
+
+
+static inline uint32_t max(uint32_t a, uint32_t b)
+{
+	return a > b ? a : b;
+}
+
+
+// c ? a : b without a branch: jump threading turns chains of ?: on the same
+//   condition back into branches, and the loop no longer vectorizes
+static inline uint32_t sel(uint32_t c, uint32_t a, uint32_t b)
+{
+	return b ^ ((a ^ b) & -(uint32_t)(c != 0));
+}
+
+
+//-----------------------------------------------------------------------------
+// One 1s loop of all the units of a block
+//-----------------------------------------------------------------------------
+
+static void second(struct blk *restrict b)
+{
+	uint32_t wb[16];
+	int i, j;
+
+	memcpy(wb, weibull, sizeof(wb));
+
+	// a press in the last loop is seen by sim_button at the next wakeup:
+	//   before this loop, in its own wakeup after a move (bButtonDown)
+	for (i=0; i<BLK; i++)
+	{
+		uint32_t p = b->btn[i];
+
+		b->bbtn[i] = p & b->moved[i];
+		b->autod[i] &= !p;
+		b->down[i] |= p;
+		b->wcnt[i] = p ? 0 : b->wcnt[i];
+		for (j=0; j<N_WIN; j++)
+			b->win[j][i] = p ? 0 : b->win[j][i];
+		b->btn[i] = 0;
+		b->now[i] = b->up[i];
+	}
+
+	// sim_second(): a draw is taken only where the firmware calls sim_rand
+	// (here and below all loads come first, conditions are combined with & |
+	//   and selected with sel(): the two loops vectorize)
+	for (i=0; i<BLK; i++)
+	{
+		uint32_t s = b->st[i], r, p = b->period[i], g = b->gust[i], m = b->gmul[i];
+		uint32_t ra = b->rain[i], w = b->wd[i], mean = b->mean[i], rc = b->recent[i];
+		uint32_t sc = b->scale[i], rp = b->rainp[i], dn = b->down[i], v, go;
+
+		// new mean wind (the table as selects: no gathers of narrowed lanes)
+		r = xs(s);
+		for (j=0, v=0; j<16; j++)
+			v = sel((r & 15) == (uint32_t)j, wb[j], v);
+		mean = sel(p, mean, (v * sc) >> 8 & 0xFF);
+		s = sel(p, s, r);
+		b->period[i] = sel(p, p, SIM_WIND_PERIOD) - 1;
+
+		// gust bursts
+		r = xs(s);
+		go = (g == 0) & (r < SIM_GUST_PROB);
+		s = sel(g, s, r);
+		r = xs(s);
+		g = sel(g, g-1, sel(go, 3 + (r & 7), 0));
+		s = sel(go, r, s);
+		r = xs(s);
+		m = sel(go, 6 + (r & 3), m);
+		s = sel(go, r, s);
+
+		// pulses, +-25% noise: |(v >> 2)*(-128..127)| < 2^15, the (short)
+		//   cast of sim.c changes nothing
+		v = sel(g, (mean * m) >> 2, mean);
+		s = xs(s);
+		v = (v + (uint32_t)((int32_t)((v >> 2) * ((s & 0xFF) - 128)) >> 7)) & 0xFFFF;
+		b->ticks[i] = sel(v > 255, 255, v);
+
+		// rain, wetting or drying
+		r = xs(s);
+		go = (ra == 0) & (r < rp);
+		s = sel(ra, s, r);
+		r = xs(s);
+		ra = sel(ra, ra-1, sel(go, 600 + r % 6600, 0));
+		s = sel(go, r, s);
+		w = sel(ra, w - ((w - SIM_WD_WET) >> 5), sel(w < SIM_WD_DRY, w + ((SIM_WD_DRY - w) >> 9) + 1, w));
+
+		rc = sel(g | ra, WIND_GUST_TIME, sel(rc, rc-1, 0));
+		s = xs(s);
+		b->btn[i] = s < SIM_BTN_PROB;
+		b->cnt[3][i] += !dn;
+		b->cnt[4][i] += !dn & !rc;
+
+		b->st[i] = s;
+		b->mean[i] = mean;
+		b->gust[i] = g;
+		b->gmul[i] = m;
+		b->rain[i] = ra;
+		b->wd[i] = w;
+		b->recent[i] = rc;
+	}
+
+	// det_second(): wind, then water
+	for (i=0; i<BLK; i++)
+	{
+		uint32_t u = b->now[i], th = b->wd_th[i], wt = b->wt[i], mn = b->wmin[i], cnt = b->wcnt[i];
+		uint32_t dn = b->down[i], bb = b->bbtn[i], au = b->autod[i], wp1 = b->wp1[i], wp2 = b->wp2[i];
+		uint32_t win[N_WIN], pw, aw, pa, aa, n = 0, arm, put, placed = 0, wd, a, c, e;
+		int32_t d;
+
+		// pre-alarm: count the open windows, open one or alarm
+		pw = b->ticks[i] > b->dc_th[i];
+		for (j=0; j<N_WIN; j++)
+		{
+			win[j] = b->win[j][i];
+			n += win[j] > u;
+		}
+		aw = pw & (n >= WIND_GUST_EVENTS-1);
+		arm = pw & !aw;
+		for (j=0; j<N_WIN; j++)
+		{
+			put = arm & !placed & (win[j] <= u);
+			b->win[j][i] = sel(put, u + WIND_GUST_TIME + 1, win[j]);
+			placed |= put;
+		}
+		b->events[i] = n + arm;
+
+		// water: pre-alarm on the last threshold, follow the setpoint pot
+		wd = K_WD_RATIO(b->wd[i] >> 1, 32768);
+		pa = wd < wt;
+		d = (int16_t)(th - wp2);
+		wt = sel((d > 1000) | (d < -1000), th, wt);
+		b->wp2[i] = wp1;
+		b->wp1[i] = th;
+
+		// det_water_adapt(): down after the button, down, up (auto, manual)
+		a = (wd - 1000) & 0xFFFF;
+		a = sel(a > th, th, a);
+		c = sel((wt >= th) | (wd > th + WD_DRY_MARGIN), th, sel(wd > wt + 5000, wt + 1000, wt));
+		e = sel(!au, th, sel(wd < mn, (th >> 1) + (wd >> 1), wt));
+		b->wt[i] = sel(dn, sel(bb, a, c), e);
+		b->wmin[i] = sel(dn, sel(bb, mn, 65535), sel(au & (wd < mn), wd, mn));
+
+		cnt = sel(pa, (cnt + 1) & 0xFF, 0);
+		aa = pa & (cnt >= WATER_ALM_TIME);
+		b->wcnt[i] = cnt;
+		b->wdv[i] = wd;
+		b->pre[i] = sel(pw, DET_BIT(wind), 0) | sel(pa, DET_BIT(water), 0);
+		b->alm[i] = sel(aw, DET_BIT(wind), 0) | sel(aa, DET_BIT(water), 0);
+	}
+
+	// sim_alarm(), hold_second(), then the moves of main()
+	for (i=0; i<BLK; i++)
+	{
+		uint32_t u = b->now[i], u2, alm = b->alm[i], al = alm != 0, dn = b->down[i], adl = b->adl[i];
+		uint32_t hc = b->hcause[i], havg, act, busy, calm, left, early, mv_up, mv_down, cause;
+
+		b->cnt[0][i] += al;
+		b->cnt[1][i] += al && !b->recent[i];
+
+		// hold: wind mean always, early end when the causes are gone
+		havg = (b->havg[i] - (b->havg[i] >> 5) + b->ticks[i]) & 0xFFFF;
+		act = !dn && b->autod[i] && hc && adl > u;
+		busy = ((hc & HOLD_RAIN) && b->wdv[i] <= b->wd_th[i] + WD_DRY_MARGIN)
+			|| ((hc & HOLD_WIND) && (b->events[i] || havg >= b->dc_th[i] << 4));
+		calm = !act ? b->hcalm[i] : busy ? 0 : b->hcalm[i] < 65535 ? b->hcalm[i] + 1 : 65535;
+		left = adl - u;
+		early = act && !busy && calm >= HOLD_CALM_TIME && ((b->hlen[i] - left) & 0xFFFF) >= b->hmin[i];
+		adl = early ? 0 : adl;
+		b->cnt[5][i] += early;
+		b->cnt[7][i] += early ? left : 0;
+		b->hearly_at[i] = early ? u : b->hearly_at[i];
+		b->havg[i] = havg;
+
+		// up on an alarm, down when the hold is over (not armed)
+		mv_up = dn && al;
+		mv_down = !dn && !al && b->autod[i] && adl <= u;
+		u2 = u + (mv_up ? 4 + TENTS_UP_TIME : mv_down ? 4 + TENTS_DOWN_TIME : 0);
+
+		// arm_auto_down(det_alm) at the end of the move: hold_arm()
+		b->cnt[6][i] += al && (b->hearly[i] | early) && u2 - b->hearly_at[i] < HOLD_CALM_TIME;
+		b->hearly[i] = al ? 0 : b->hearly[i] | early;
+		cause = alm | (adl > u2 ? hc : 0);
+		b->hcause[i] = al ? cause : hc;
+		b->hcalm[i] = al ? 0 : calm;
+		b->hmin[i] = al ? max(cause & HOLD_WIND ? HOLD_WIND_MIN : 0, cause & HOLD_RAIN ? HOLD_RAIN_MIN : 0) : b->hmin[i];
+		b->hlen[i] = al ? max(cause & HOLD_WIND ? HOLD_WIND_MAX : 0, cause & HOLD_RAIN ? HOLD_RAIN_MAX : 0) : b->hlen[i];
+		b->adl[i] = al ? u2 + b->hlen[i] : adl;
+
+		// alarm_reset() after a move
+		b->down[i] = mv_up ? 0 : mv_down ? 1 : dn;
+		b->cnt[2][i] += mv_up;
+		b->wcnt[i] = mv_up || mv_down ? 0 : b->wcnt[i];
+		for (j=0; j<N_WIN; j++)
+			b->win[j][i] = mv_up || mv_down ? 0 : b->win[j][i];
+		b->moved[i] = mv_up || mv_down;
+		b->now[i] = u2;
+		b->up[i] = mv_up || mv_down ? u2 : u2 + 1;
+	}
+}
+
+
+// state_dump() of lane i and the counters
+static void record(const struct blk *b, int i, struct rec *r)
+{
+	uint32_t adt = b->adl[i] > b->now[i] ? b->adl[i] - b->now[i] : 0;
+	unsigned char *f = r->frame;
+	int k;
+
+	f[0] = (unsigned char)b->now[i];
+	f[1] = (unsigned char)(b->now[i] >> 8);
+	f[2] = b->pre[i] ? 0x02 : 0x0A;			// TRIAC_OFF, LEDR
+	f[3] = b->down[i] | b->autod[i] << 1 | b->bbtn[i] << 2;
+	f[4] = b->pre[i];
+	f[5] = b->alm[i];
+	f[6] = (unsigned char)b->wt[i];
+	f[7] = (unsigned char)(b->wt[i] >> 8);
+	f[8] = (unsigned char)b->wdv[i];
+	f[9] = (unsigned char)(b->wdv[i] >> 8);
+	f[10] = b->wcnt[i];
+	f[11] = b->dc_th[i];
+	f[12] = b->ticks[i];
+	f[13] = 0;
+	f[14] = (unsigned char)adt;
+	f[15] = (unsigned char)(adt >> 8);
+	for (k=0; k<N_CNT; k++)
+		r->cnt[k] = b->cnt[k][i];
+}
+
+
+static void *worker(void *arg)
+{
+	unsigned k, s, i;
+
+	(void)arg;
+	while ((k = __atomic_fetch_add(&next_blk, 1, __ATOMIC_RELAXED)) < n_blk)
+		for (s=0; s<loops; s++)
+		{
+			second(&blk[k]);
+			for (i=0; k*BLK + i < n_val && i < BLK; i++)
+				record(&blk[k], i, &val[(k*BLK + i)*(size_t)loops + s]);
+		}
+	return 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Fleet draw and power on state
+//-----------------------------------------------------------------------------
+
+static uint64_t rnd_s;
+
+static uint64_t rnd(void)
+{
+	uint64_t z = (rnd_s += 0x9E3779B97F4A7C15ULL);
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+
+// unit k of the fleet: seed, pots, profile (the validated ones keep the
+//   sim.h profile)
+static void unit(unsigned k, uint32_t *seed, uint32_t *p2, uint32_t *p3, uint32_t *sc, uint32_t *rp)
+{
+	uint64_t r;
+
+	rnd_s = fleet << 32 ^ k;
+	r = rnd();
+	*seed = (r & 0xFFFF) ? r & 0xFFFF : 1;
+	*p2 = pot2 != ~0UL ? pot2 : (r >> 16) & 0xFFFF;
+	*p3 = pot3 != ~0UL ? pot3 : (r >> 32) & 0xFFFF;
+	r = rnd();
+	*sc = k < n_val ? SIM_WIND_SCALE : scale != ~0UL ? scale : 8 + r % 9;
+	*rp = k < n_val ? SIM_RAIN_PROB : rainp != ~0UL ? rainp : 4 + (r >> 32) % 15;
+}
+
+
+static void power_on(void)
+{
+	unsigned k, i;
+
+	memset(blk, 0, n_blk * sizeof(*blk));
+	for (k=0; k<16; k++)
+		weibull[k] = sim_weibull[k];
+	for (k=0; k<n_blk*BLK; k++)
+	{
+		struct blk *b = &blk[k / BLK];
+		uint32_t seed, p2, p3;
+
+		i = k % BLK;
+		unit(k, &seed, &p2, &p3, &b->scale[i], &b->rainp[i]);
+		b->st[i] = seed;
+		b->wd[i] = SIM_WD_DRY;
+		b->dc_th[i] = K_DC_TH(p2);
+		b->wd_th[i] = K_WD_TH(p3);
+		b->up[i] = 1;
+		b->down[i] = 1;
+		b->autod[i] = 1;
+		b->wmin[i] = 65535;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Native firmware, one unit per process (-v)
+//-----------------------------------------------------------------------------
+
+static struct rec *v_ref;		// expected loops of this unit
+static unsigned v_n;
+static int *v_bad;				// first differing loop +1, shared with the parent
+
+char __wrap_link_send(unsigned char type, unsigned char *payload, unsigned char len)
+{
+	if (type == LINK_T_STATE && v_n < loops)
+	{
+		const struct rec *r = &v_ref[v_n];
+		uint32_t cnt[N_CNT] = { sim_alarms, sim_false, sim_retract, sim_up, sim_up_clear,
+			hold_early, hold_relapse, hold_saved };
+		int k, same = memcmp(r->frame, payload, 16) == 0;
+
+		for (k=0; k<N_CNT; k++)
+			same &= k < 3 || k == 5 || k == 6 ? (r->cnt[k] & 0xFFFF) == cnt[k] : r->cnt[k] == cnt[k];
+		if (!same)
+		{
+			*v_bad = v_n + 1;
+			printf("unit %ld loop %u differs\n  firmware", (long)(v_ref - val) / loops, v_n);
+			for (k=0; k<16; k++)
+				printf(" %02X", payload[k]);
+			for (k=0; k<N_CNT; k++)
+				printf(" %lu", (unsigned long)cnt[k]);
+			printf("\n  mc      ");
+			for (k=0; k<16; k++)
+				printf(" %02X", r->frame[k]);
+			for (k=0; k<N_CNT; k++)
+				printf(" %lu", (unsigned long)r->cnt[k]);
+			printf("\n");
+			fflush(stdout);
+			hw_stop(HW_END);
+		}
+		if (++v_n == loops)
+			hw_stop(HW_END);
+	}
+	return __real_link_send(type, payload, len);
+}
+
+
+static int validate(long jobs)
+{
+	static const struct hw_env env = { 0, 0, 0, 0, 0, 0 };
+	int *bad = mmap(0, n_val*sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	unsigned k, fail = 0;
+	long running = 0;
+
+	if (bad == MAP_FAILED)
+		return 1;
+	memset(bad, 0xFF, n_val*sizeof(int));		// -1: the run died
+	for (k=0; k<n_val; k++)
+	{
+		if (running == jobs)
+		{
+			wait(0);
+			running--;
+		}
+		if (fork() == 0)
+		{
+			uint32_t seed, p2, p3, sc, rp;
+
+			unit(k, &seed, &p2, &p3, &sc, &rp);
+			sim_seed(seed);
+			sim_pot2 = p2;
+			sim_pot3 = p3;
+			v_ref = &val[k*(size_t)loops];
+			v_bad = &bad[k];
+			hw_run(&env, (hw_time)loops * (5+TENTS_UP_TIME) * HW_CLK);
+			if (*v_bad < 0)
+				*v_bad = v_n == loops ? 0 : -1;
+			_exit(0);
+		}
+		running++;
+	}
+	while (wait(0) > 0)
+		;
+	for (k=0; k<n_val; k++)
+		fail += bad[k] != 0;
+	printf("validation: %u units x %u loops against the firmware, %u differ\n", n_val, loops, fail);
+	return fail != 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Statistics
+//-----------------------------------------------------------------------------
+
+static int cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+
+static void pcts(const char *name, double *v, unsigned n)
+{
+	qsort(v, n, sizeof(v[0]), cmp);
+	printf("  %-26s p50 %8.3f  p90 %8.3f  p99 %8.3f  max %8.3f\n", name,
+		v[n/2], v[(unsigned)(n*0.9)], v[(unsigned)(n*0.99)], v[n-1]);
+}
+
+
+int main(int argc, char **argv)
+{
+	unsigned long long tot[N_CNT] = { 0 }, secs = 0;
+	unsigned long n = 65536, k;
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	double days = 1, wall, *fa, *upc;
+	struct timespec t0, t1;
+	pthread_t th[MAX_THREADS];
+	int c, t, r = 0;
+
+	while ((c = getopt(argc, argv, "n:d:s:2:3:w:r:j:v:")) != -1)
+		switch (c)
+		{
+		case 'n': n = strtoul(optarg, 0, 0); break;
+		case 'd': days = atof(optarg); break;
+		case 's': fleet = strtoull(optarg, 0, 0); break;
+		case '2': pot2 = strtoul(optarg, 0, 0) & 0xFFFF; break;
+		case '3': pot3 = strtoul(optarg, 0, 0) & 0xFFFF; break;
+		case 'w': scale = strtoul(optarg, 0, 0) & 0xFF; break;
+		case 'r': rainp = strtoul(optarg, 0, 0) & 0xFFFF; break;
+		case 'j': jobs = atol(optarg); break;
+		case 'v': n_val = strtoul(optarg, 0, 0); break;
+		default:
+			fprintf(stderr, "usage: mc [-n units] [-d days] [-s seed] [-2 pot] [-3 pot] [-w scale]\n"
+				"          [-r prob] [-j threads] [-v units]\n");
+			return 2;
+		}
+	if (jobs < 1)
+		jobs = 1;
+	if (jobs > MAX_THREADS)
+		jobs = MAX_THREADS;
+	loops = (unsigned)(days*86400);
+	if (n_val > n)
+		n = n_val;
+	n_blk = (n + BLK-1) / BLK;
+	if (!n || !loops || !(blk = aligned_alloc(64, n_blk * sizeof(*blk)))
+		|| (n_val && !(val = malloc(n_val * (size_t)loops * sizeof(*val)))))
+	{
+		fprintf(stderr, "mc: nothing to run or out of memory\n");
+		return 1;
+	}
+
+	power_on();
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (t=0; t<jobs; t++)
+		pthread_create(&th[t], 0, worker, 0);
+	for (t=0; t<jobs; t++)
+		pthread_join(th[t], 0);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	wall = (t1.tv_sec-t0.tv_sec) + (t1.tv_nsec-t0.tv_nsec)*1e-9;
+
+	// units beyond n (last block) are simulated, not counted
+	fa = malloc(n * sizeof(double));
+	upc = malloc(n * sizeof(double));
+	for (k=0; k<n; k++)
+	{
+		const struct blk *b = &blk[k / BLK];
+		unsigned i = k % BLK, j;
+		double d = (b->up[i] - 1) / 86400.;
+
+		for (j=0; j<N_CNT; j++)
+			tot[j] += b->cnt[j][i];
+		secs += b->up[i] - 1;
+		fa[k] = b->cnt[1][i] / d;
+		upc[k] = 100. * b->cnt[4][i] / loops;
+	}
+	printf("%lu units x %u loops, %.3g simulated s in %.3f s: %.3g unit-s per s\n",
+		n, loops, (double)secs, wall, secs / wall);
+	printf("alarms %llu (false %llu), retractions %llu, early downs %llu (relapses %llu)\n",
+		tot[0], tot[1], tot[2], tot[5], tot[6]);
+	printf("tents up %.2f%% of the loops, %.2f%% without a reason\n",
+		100. * tot[3] / ((double)n * loops), 100. * tot[4] / ((double)n * loops));
+	pcts("false alarms per day", fa, n);
+	pcts("% up without a reason", upc, n);
+	if (n_val)
+		r = validate(jobs);
+	return r;
+}
@@ -0,0 +1,108 @@
+//-----------------------------------------------------------------------------
+// run.c
+// TENDONI V2
+// rev1 - RV110905
+// run the native firmware on constant inputs, print outputs and link frames
+//-----------------------------------------------------------------------------
+// usage: run [-t s] [-r wd] [-2 pot] [-3 pot] [-w pulses/s] [-b s]
+//   -t  seconds to run (default 10)
+//   -r  water ratio wd_a/wd_b*65536 seen by det_water (default 32768, dry)
+//   -2  wind threshold pot, -3 water setpoint pot (default 0x8000)
+//   -w  wind sensor pulses per second (default 0)
+//   -b  keep the down button pressed from this second on
+// The water sensor is modelled as two channels with a swing proportional to
+//   the excitation: ch 0 (wd_b) 100 LSB per IDA0 step, ch 1 (wd_a) scaled
+//   to give the requested ratio.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "hw.h"
+#include "../link.h"
+
+static unsigned long ratio = 32768, pot2 = 0x8000, pot3 = 0x8000, wind;
+static long btn = -1;
+static unsigned char frame[3+LINK_MAX_PAYLOAD+1];
+static int flen;
+
+
+static void step(void)
+{
+	hw_t0_pulses = hw_now * wind / HW_CLK;
+	P0_1 = !(btn >= 0 && hw_now >= btn * HW_CLK);
+}
+
+
+static unsigned short adc(unsigned char ch, unsigned char ida)
+{
+	long swing = (long)ida - 77;
+
+	switch (ch)
+	{
+	case 0:
+		return 0x8000 + swing*100;
+	case 1:
+		return 0x8000 + swing*100*(long)ratio/65536;
+	case 2:
+		return pot2;
+	default:
+		return pot3;
+	}
+}
+
+
+static void out(unsigned char p1, unsigned char changed)
+{
+	printf("%10.6f P1 %02X  RL_AUTO %d TRIAC_OFF %d LEDG %d LEDR %d RL_DOWN %d\n",
+		(double)hw_now/HW_CLK, p1, p1 & 1, (p1 >> 1) & 1, (p1 >> 2) & 1,
+		(p1 >> 3) & 1, (p1 >> 4) & 1);
+}
+
+
+// print whole frames, bytes outside frames one by one
+static void tx(unsigned char c)
+{
+	int i;
+
+	if (flen == 0 && c != LINK_SOF)
+	{
+		printf("%10.6f tx %02X\n", (double)hw_now/HW_CLK, c);
+		return;
+	}
+	frame[flen++] = c;
+	if (flen < 3 || flen < 3+frame[2]+1)
+		return;
+	printf("%10.6f frame %c", (double)hw_now/HW_CLK, frame[1]);
+	for (i=3; i<flen-1; i++)
+		printf(" %02X", frame[i]);
+	printf("\n");
+	flen = 0;
+}
+
+
+int main(int argc, char **argv)
+{
+	static const struct hw_env env = { 0, step, out, tx, adc, 0 };
+	static const char *reason[] = { "", "end", "watchdog reset",
+		"software reset", "main returned", "fault" };
+	double secs = 10;
+	int c, r;
+
+	while ((c = getopt(argc, argv, "t:r:2:3:w:b:")) != -1)
+		switch (c)
+		{
+		case 't': secs = atof(optarg); break;
+		case 'r': ratio = strtoul(optarg, 0, 0); break;
+		case '2': pot2 = strtoul(optarg, 0, 0); break;
+		case '3': pot3 = strtoul(optarg, 0, 0); break;
+		case 'w': wind = strtoul(optarg, 0, 0); break;
+		case 'b': btn = atol(optarg); break;
+		default:
+			fprintf(stderr, "usage: run [-t s] [-r wd] [-2 pot] [-3 pot] [-w pulses/s] [-b s]\n");
+			return 2;
+		}
+
+	r = hw_run(&env, (hw_time)(secs*HW_CLK));
+	printf("%10.6f %s, %lu wakeups\n", (double)hw_now/HW_CLK, reason[r], hw_wakeups);
+	return r == HW_END ? 0 : 1;
+}
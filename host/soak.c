@@ -0,0 +1,269 @@
+//-----------------------------------------------------------------------------
+// soak.c
+// TENDONI V2
+// rev1 - RV110905
+// soak runs of the native firmware on synthetic weather (weather.c)
+//-----------------------------------------------------------------------------
+// usage: soak [-s seed] [-d days] [-2 pot] [-3 pot] [-n lsb] [-f] [-b]
+//   -s  weather seed (default 1)
+//   -d  days of weather (default 30)
+//   -2  wind threshold pot, -3 water setpoint pot (default 0x8000)
+//   -n  A/D noise on the water sensor channels, +-lsb (default 8)
+//   -f  fast: drive the detectors directly, once per second, with the
+//       pulses of the second and wd as snapshot (no A/D chain, no main loop);
+//       the tents go up on an alarm and down after FOUR_HOURS s without
+//       alarms (no early down of hold.c, no moves, no manual mode)
+//   -b  benchmark the generator alone
+// The default runs the whole firmware on the chip model: pulses go to T0,
+//   wd to the A/D channels 0/1 (swing proportional to the excitation, as in
+//   run.c), presses to DI_DOWN. Counted:
+//   - retractions: up moves (RL_AUTO set with RL_DOWN=0), and false ones,
+//     with no reason in the last WIND_GUST_TIME s: no gust, no rain, wind
+//     below the pot threshold and sensor drier than the setpoint
+//   - time with tents up, and the part of it without such a reason
+//   - down moves, button presses
+//   - watchdog margin: min WDcnt at Timer2 IRQ entry (0 = reset at next tick)
+// A watchdog reset or a model fault stops the run, with exit status 1.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "hw.h"
+#include "weather.h"
+#include "../main.h"
+#include "../F35x_ADC0.h"
+#include "../detect.h"
+#include "../kernels.h"
+#include "../timers.h"
+
+#define BUF 4096			// samples generated at once
+
+static unsigned long long seed = 1;
+static struct wx wx;
+static struct wx_sample buf[BUF], cur;
+static unsigned buf_n = BUF;
+static unsigned long pot2 = 0x8000, pot3 = 0x8000, noise = 8;
+static unsigned dc_th, wd_th;
+static hw_time next_sample;
+static uint64_t noise_s = 0x2545F4914F6CDD1DULL;
+
+// statistics
+static uint64_t last_reason;		// last sample with a reason for an alarm
+static int up;
+static unsigned long retract, retract_false, down, presses, gusts, rains;
+static uint64_t up_samples, up_clear;
+static unsigned wd_margin = 255;
+
+
+static void next(void)
+{
+	int was_btn = cur.flags & WX_BTN, was_gust = cur.flags & WX_GUST, was_rain = cur.flags & WX_RAIN;
+
+	if (buf_n == BUF)
+	{
+		wx_run(&wx, buf, BUF);
+		buf_n = 0;
+	}
+	cur = buf[buf_n++];
+
+	presses += (cur.flags & WX_BTN) && !was_btn;
+	gusts += (cur.flags & WX_GUST) && !was_gust;
+	rains += (cur.flags & WX_RAIN) && !was_rain;
+	if ((cur.flags & (WX_GUST | WX_RAIN)) || cur.speed >= dc_th*16 || cur.wd < wd_th)
+		last_reason = wx.n;
+	if (up)
+	{
+		up_samples++;
+		up_clear += wx.n - last_reason > WIND_GUST_TIME*WX_RATE;
+	}
+}
+
+
+static int is_false(void)
+{
+	return wx.n - last_reason > WIND_GUST_TIME*WX_RATE;
+}
+
+
+static void report(double secs, double wall)
+{
+	printf("%.1f days, seed %llu: %lu retractions, %lu false, %lu down moves, %lu presses\n",
+		secs/86400, seed, retract, retract_false, down, presses);
+	printf("tents up %.2f%% of the time, %.2f%% without a reason; %lu gusts, %lu rain events\n",
+		100.*up_samples/wx.n, 100.*up_clear/wx.n, gusts, rains);
+	if (wd_margin != 255)
+		printf("watchdog margin: min WDcnt %u of %u\n", wd_margin, SOFT_WD_COUNTS);
+	printf("%.3f s, %.0f simulated s per s\n", wall, secs/wall);
+}
+
+
+//-----------------------------------------------------------------------------
+// Whole firmware
+//-----------------------------------------------------------------------------
+
+static void step(void)
+{
+	while (hw_now >= next_sample)
+	{
+		next();
+		hw_t0_pulses += cur.pulses;
+		P0_1 = !(cur.flags & WX_BTN);
+		next_sample += HW_CLK/WX_RATE;
+	}
+}
+
+
+static unsigned short adc(unsigned char ch, unsigned char ida)
+{
+	long swing = (long)ida - 77, n;
+
+	noise_s ^= noise_s << 13;
+	noise_s ^= noise_s >> 7;
+	noise_s ^= noise_s << 17;
+	n = noise ? (long)(noise_s % (2*noise+1)) - (long)noise : 0;
+	switch (ch)
+	{
+	case 0:
+		return 0x8000 + swing*100 + n;
+	case 1:
+		return 0x8000 + swing*100*(long)cur.wd/65536 + n;
+	case 2:
+		return pot2;
+	default:
+		return pot3;
+	}
+}
+
+
+static void out(unsigned char p1, unsigned char changed)
+{
+	if (!(changed & p1 & 0x01))
+		return;
+	// RL_AUTO set: a move starts, RL_DOWN already selects the direction
+	if (p1 & 0x10)
+	{
+		down++;
+		up = 0;
+	}
+	else
+	{
+		retract++;
+		retract_false += is_false();
+		up = 1;
+	}
+}
+
+
+static void irq(int vector)
+{
+	if (vector == 5 && WDcnt < wd_margin)
+		wd_margin = WDcnt;
+}
+
+
+//-----------------------------------------------------------------------------
+// Detectors only
+//-----------------------------------------------------------------------------
+
+static void fast(unsigned long secs)
+{
+	unsigned long s, hold = 0;
+	unsigned i, pulses;
+
+	det_init();
+	for (s=0; s<secs; s++)
+	{
+		pulses = 0;
+		for (i=0; i<WX_RATE; i++)
+		{
+			next();
+			pulses += cur.pulses;
+		}
+		// as the 1s loop of main()
+		uptime++;
+		tmr_poll();
+		bButtonDown = (cur.flags & WX_BTN) != 0;
+		if (bButtonDown)
+			det_reset();
+		ad[0] = 32768;
+		ad[1] = cur.wd >> 1;
+		ad[2] = pot2;
+		ad[3] = pot3;
+		wind_ticks = pulses;
+		det_second();
+		if (det_alm)
+		{
+			if (!up)
+			{
+				retract++;
+				retract_false += is_false();
+				up = 1;
+			}
+			hold = FOUR_HOURS;
+			det_reset();
+		}
+		else if (up && !--hold)
+		{
+			down++;
+			up = 0;
+		}
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	static const struct hw_env env = { 0, step, out, 0, adc, irq };
+	struct timespec t0, t1;
+	double days = 30, wall;
+	int c, bench = 0, fast_mode = 0, r = HW_END;
+
+	while ((c = getopt(argc, argv, "s:d:2:3:n:fb")) != -1)
+		switch (c)
+		{
+		case 's': seed = strtoull(optarg, 0, 0); break;
+		case 'd': days = atof(optarg); break;
+		case '2': pot2 = strtoul(optarg, 0, 0); break;
+		case '3': pot3 = strtoul(optarg, 0, 0); break;
+		case 'n': noise = strtoul(optarg, 0, 0); break;
+		case 'f': fast_mode = 1; break;
+		case 'b': bench = 1; break;
+		default:
+			fprintf(stderr, "usage: soak [-s seed] [-d days] [-2 pot] [-3 pot] [-n lsb] [-f] [-b]\n");
+			return 2;
+		}
+
+	dc_th = K_DC_TH(pot2);
+	wd_th = K_WD_TH(pot3);
+	wx_init(&wx, &wx_default, seed);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	if (bench)
+	{
+		uint64_t n = (uint64_t)(days*86400*WX_RATE), sum = 0;
+
+		for (; n >= BUF; n -= BUF)
+		{
+			wx_run(&wx, buf, BUF);
+			sum += buf[BUF-1].pulses;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		wall = (t1.tv_sec-t0.tv_sec) + (t1.tv_nsec-t0.tv_nsec)*1e-9;
+		printf("%llu samples in %.3f s, %.0f samples/s (%llu)\n",
+			(unsigned long long)wx.n, wall, wx.n/wall, (unsigned long long)sum);
+		return 0;
+	}
+
+	if (fast_mode)
+		fast((unsigned long)(days*86400));
+	else
+		r = hw_run(&env, (hw_time)(days*86400*HW_CLK));
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	wall = (t1.tv_sec-t0.tv_sec) + (t1.tv_nsec-t0.tv_nsec)*1e-9;
+	if (r != HW_END)
+		printf("%s at %.3f s\n", r == HW_RST_WD ? "watchdog reset" : "stopped", (double)hw_now/HW_CLK);
+	report((double)wx.n/WX_RATE, wall);
+	return r != HW_END;
+}
@@ -0,0 +1,155 @@
+//-----------------------------------------------------------------------------
+// startup.c
+// TENDONI V2
+// rev1 - RV110905
+// power on to valid decision time of the native firmware
+//-----------------------------------------------------------------------------
+// usage: startup [-t s] [-r wd] [-2 pot] [-3 pot] [-e pct]
+//   -t  seconds to run (default 60), the readings of the last 1s loop are
+//       taken as settled
+//   -r  water ratio wd_a/wd_b*65536 (default 32768), -2 -3 pots (0x8000),
+//       sensor model as run.c
+//   -e  tolerance on the water ratio and on wd_th, % (default 1)
+// Prints, from power on:
+//   conv   A/D conversions started (ADC0 IRQ enabled, after calibration)
+//   valid  first seeded snapshot (bADValid), "-" on trees without it
+//   first  first 1s loop that read the A/D (ad[] changed)
+//   settle first 1s loop from which on every loop decides on readings within
+//          the tolerance of the settled ones: wd_a/wd_b and wd_th within e%,
+//          dc_th equal
+// The 1s loop of tick k is the one that runs after the k-th change of
+//   seconds_cnt; ad[] is sampled until the next change. The model has no
+//   time for CPU busy waits (the 100 us VDD monitor loop of old trees).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hw.h"
+#include "../main.h"
+#include "../F35x_ADC0.h"
+#include "../kernels.h"
+
+#define MAX_SECS 3600
+
+// bADValid is missing on trees before the seeded filters, ad[] is __idata
+//   on later ones: both seen as plain host variables
+extern volatile _Bool bADValid __attribute__((weak));
+extern unsigned short ad[N_ADCHANNELS];
+
+static unsigned long ratio = 32768, pot2 = 0x8000, pot3 = 0x8000;
+static unsigned char last_sec;
+static int secs = -1;					// 1s loops seen
+static hw_time tick[MAX_SECS];			// time of each loop
+static unsigned short rd[MAX_SECS][N_ADCHANNELS];	// ad[] after each loop
+static hw_time t_conv, t_valid;
+
+
+static void step(void)
+{
+	if (!t_conv && (EIE1 & 0x08))
+		t_conv = hw_now;
+	if (!t_valid && &bADValid && bADValid)
+		t_valid = hw_now;
+	if (seconds_cnt != last_sec)
+	{
+		last_sec = seconds_cnt;
+		if (++secs == MAX_SECS)
+			hw_stop(HW_END);
+		tick[secs] = hw_now;
+	}
+	if (secs >= 0)
+		memcpy(rd[secs], ad, sizeof(ad));
+}
+
+
+static unsigned short adc(unsigned char ch, unsigned char ida)
+{
+	long swing = (long)ida - 77;
+
+	switch (ch)
+	{
+	case 0:
+		return 0x8000 + swing*100;
+	case 1:
+		return 0x8000 + swing*100*(long)ratio/65536;
+	case 2:
+		return pot2;
+	default:
+		return pot3;
+	}
+}
+
+
+static int near(unsigned v, unsigned ref, double pct)
+{
+	double d = (double)v - ref;
+
+	return (d < 0 ? -d : d) <= ref*pct/100;
+}
+
+
+static void ms(const char *name, hw_time t)
+{
+	if (t)
+		printf("  %s %8.1f", name, (double)t*1000/HW_CLK);
+	else
+		printf("  %s %8s", name, "-");
+}
+
+
+int main(int argc, char **argv)
+{
+	static const struct hw_env env = { 0, step, 0, 0, adc, 0 };
+	double t = 60, e = 1;
+	unsigned short *fin;
+	unsigned wd_fin, wd_th_fin;
+	int c, k, first = -1, settle = -1;
+
+	while ((c = getopt(argc, argv, "t:r:2:3:e:")) != -1)
+		switch (c)
+		{
+		case 't': t = atof(optarg); break;
+		case 'r': ratio = strtoul(optarg, 0, 0); break;
+		case '2': pot2 = strtoul(optarg, 0, 0); break;
+		case '3': pot3 = strtoul(optarg, 0, 0); break;
+		case 'e': e = atof(optarg); break;
+		default:
+			fprintf(stderr, "usage: startup [-t s] [-r wd] [-2 pot] [-3 pot] [-e pct]\n");
+			return 2;
+		}
+
+	last_sec = seconds_cnt;
+	hw_run(&env, (hw_time)(t*HW_CLK));
+	if (secs < 1)
+	{
+		printf("no 1s loop in %.0f s\n", t);
+		return 1;
+	}
+
+	// the last loop may be cut by the end of the run: settled is the one before
+	fin = rd[secs-1];
+	wd_fin = K_WD_RATIO(fin[1], fin[0]);
+	wd_th_fin = K_WD_TH(fin[3]);
+	for (k=0; k<secs; k++)
+	{
+		unsigned short *a = rd[k];
+		int ok = near(K_WD_RATIO(a[1], a[0]), wd_fin, e) && near(K_WD_TH(a[3]), wd_th_fin, e)
+			&& K_DC_TH(a[2]) == K_DC_TH(fin[2]);
+
+		if (first < 0 && memcmp(a, k ? rd[k-1] : (unsigned short [N_ADCHANNELS]){0}, sizeof(rd[0])))
+			first = k;
+		if (!ok)
+			settle = -1;
+		else if (settle < 0)
+			settle = k;
+	}
+
+	printf("wd %5lu:", ratio);
+	ms("conv", t_conv);
+	ms("valid", t_valid);
+	ms("first", first < 0 ? 0 : tick[first]);
+	ms("settle", settle < 0 ? 0 : tick[settle]);
+	printf("  ms (wd %u, wd_th %u, dc_th %u)\n", wd_fin, wd_th_fin, (unsigned)K_DC_TH(fin[2]));
+	return settle < 0;
+}
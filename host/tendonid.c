@@ -0,0 +1,440 @@
+//-----------------------------------------------------------------------------
+// tendonid.c
+// TENDONI V2
+// rev1 - RV110905
+// Linux daemon: the native firmware (build.sh host) on GPIO lines
+//-----------------------------------------------------------------------------
+// usage: tendonid [-c chip] [-l lines] [-s tty] [-i iio-dir[:bits]]
+//                 [-r wd] [-2 pot] [-3 pot] [-x speed] [-m]
+//   -c  GPIO character device (default /dev/gpiochip0)
+//   -l  line offsets: wind,down,auto,triac,ledg,ledr,rldown (default 0,...,6);
+//       line values are the port bits of the firmware (DI_DOWN=0: pressed,
+//       TRIAC_OFF=0: TRIAC on, LEDR=0: red LED on)
+//   -s  tty of the link to the other unit, 9600 8N1
+//   -i  IIO device: in_voltage0/1_raw amplitude of the water sensor signals
+//       (wd_b/wd_a), in_voltage2/3_raw the pots, bits resolution (default 12);
+//       without it -r/-2/-3 set constant readings as in run.c
+//   -x  time scale, for tests (default 1)
+//   -m  mock chip on stdin/stdout instead of the GPIO lines, one command per
+//       line: "w n" n wind pulses, "d 0|1" DI_DOWN level; outputs are printed
+//       as "<s> P1 <hex>" on each change
+//
+// The firmware sleeps in PCON idle until the next event of the chip model.
+//   Here only the Timer2 tick (40 Hz, timebase of seconds_cnt, LEDs,
+//   watchdog and of the move_updown() waits) becomes a timerfd deadline:
+//   the process sleeps in epoll_wait() until it expires, or until an input
+//   arrives (wind edge, button edge, link byte, signal). Inputs are applied
+//   as they arrive and seen by the firmware at the next tick, as on the chip
+//   where Timer2_ISR reads the counter and main polls DI_DOWN. Conversions
+//   and UART bytes due before the tick run in the same wakeup.
+// Wind pulses are counted on falling edges, as Timer0 does on T0.
+// A watchdog or software reset (BOOT command) restarts the process.
+//
+// gpio-sim test (root; not available on the build machine):
+//   modprobe gpio-sim; cd /sys/kernel/config/gpio-sim; mkdir t t/bank0
+//   echo 8 > t/bank0/num_lines; echo 1 > t/live
+//   tendonid -c /dev/$(cat t/bank0/chip_name) &
+//   S=/sys/devices/platform/$(cat t/dev_name)/$(cat t/bank0/chip_name)
+//   echo pull-up > $S/sim_gpio1/pull  (button released, then pulses on line 0:)
+//   for i in $(seq 600); do echo pull-up > $S/sim_gpio0/pull; echo pull-down > $S/sim_gpio0/pull; done
+//   cat $S/sim_gpio2/value  (RL_AUTO=1 after the wind alarm)
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <linux/gpio.h>
+#include "hw.h"
+
+#define N_LINES 7			// wind, down, then P1.0-P1.4
+#define P1_MASK 0x1F
+#define P1_SAFE 0x0A		// RL_AUTO=0, TRIAC_OFF=1, as PORT_Init()
+
+static const char *chip = "/dev/gpiochip0";
+static unsigned int line[N_LINES] = { 0, 1, 2, 3, 4, 5, 6 };
+static const char *tty, *iio;
+static int iio_bits = 12;
+static double speed = 1;
+static int mock;
+static unsigned long ratio = 32768, pot2 = 0x8000, pot3 = 0x8000;
+
+static int ep, tfd, sfd, in_fd = -1, down_fd = -1, out_fd = -1, tty_fd = -1;
+static int iio_fd[4] = { -1, -1, -1, -1 };
+static unsigned short iio_val[4];
+static hw_time iio_next;
+static struct timespec start;
+static char mock_buf[256];
+static int mock_len;
+
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+
+// firmware time to CLOCK_MONOTONIC
+static struct timespec real_time(hw_time t)
+{
+	struct timespec ts = start;
+	double s = (double)t / HW_CLK / speed;
+	long long ns = (long long)(s * 1e9) + ts.tv_nsec;
+
+	ts.tv_sec += ns / 1000000000;
+	ts.tv_nsec = ns % 1000000000;
+	return ts;
+}
+
+
+static void add_fd(int fd)
+{
+	struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+
+	if (epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) < 0)
+		die("epoll_ctl");
+}
+
+
+//-----------------------------------------------------------------------------
+// GPIO lines (character device, uAPI v2)
+//-----------------------------------------------------------------------------
+
+static int line_request(int chip_fd, unsigned int *offs, int n, unsigned long long flags,
+	unsigned long long values)
+{
+	struct gpio_v2_line_request req;
+	int i;
+
+	memset(&req, 0, sizeof(req));
+	for (i=0; i<n; i++)
+		req.offsets[i] = offs[i];
+	req.num_lines = n;
+	strcpy(req.consumer, "tendonid");
+	req.config.flags = flags;
+	if (flags & GPIO_V2_LINE_FLAG_OUTPUT)
+	{
+		req.config.num_attrs = 1;
+		req.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+		req.config.attrs[0].attr.values = values;
+		req.config.attrs[0].mask = (1ULL << n) - 1;
+	}
+	if (ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &req) < 0)
+		die("GPIO_V2_GET_LINE_IOCTL");
+	fcntl(req.fd, F_SETFD, FD_CLOEXEC);
+	fcntl(req.fd, F_SETFL, O_NONBLOCK);		// gpio_events() drains them
+	return req.fd;
+}
+
+
+static void gpio_open(void)
+{
+	struct gpio_v2_line_values v = { 0, 1 };
+	int fd;
+
+	fd = open(chip, O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		die(chip);
+	in_fd = line_request(fd, &line[0], 1,
+		GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_FALLING, 0);
+	down_fd = line_request(fd, &line[1], 1,
+		GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING, 0);
+	out_fd = line_request(fd, &line[2], 5, GPIO_V2_LINE_FLAG_OUTPUT, P1_SAFE);
+	close(fd);
+
+	if (ioctl(down_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &v) < 0)
+		die("GPIO_V2_LINE_GET_VALUES_IOCTL");
+	P0_1 = v.bits & 1;
+	add_fd(in_fd);
+	add_fd(down_fd);
+}
+
+
+static void gpio_events(int fd)
+{
+	struct gpio_v2_line_event ev[16];
+	ssize_t n;
+	int i;
+
+	while ((n = read(fd, ev, sizeof(ev))) > 0)
+		for (i=0; i<n/(ssize_t)sizeof(ev[0]); i++)
+			if (fd == in_fd)
+				hw_t0_pulses++;
+			else
+				P0_1 = ev[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE;
+}
+
+
+static void set_outputs(unsigned char p1, unsigned char changed)
+{
+	struct gpio_v2_line_values v = { p1 & P1_MASK, changed & P1_MASK };
+
+	if (mock)
+		printf("%.3f P1 %02X\n", (double)hw_now/HW_CLK, p1 & P1_MASK);
+	else if (v.mask && ioctl(out_fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &v) < 0)
+		die("GPIO_V2_LINE_SET_VALUES_IOCTL");
+}
+
+
+// mock chip: commands on stdin
+static void mock_input(void)
+{
+	ssize_t n;
+	char *nl;
+
+	n = read(0, mock_buf + mock_len, sizeof(mock_buf)-1 - mock_len);
+	if (n <= 0)
+	{
+		set_outputs(P1_SAFE, P1_MASK);
+		exit(0);
+	}
+	mock_len += n;
+	mock_buf[mock_len] = 0;
+	while ((nl = strchr(mock_buf, '\n')) != 0)
+	{
+		*nl = 0;
+		if (mock_buf[0] == 'w')
+			hw_t0_pulses += strtoul(mock_buf+1, 0, 0);
+		else if (mock_buf[0] == 'd')
+			P0_1 = strtoul(mock_buf+1, 0, 0) != 0;
+		mock_len -= nl+1 - mock_buf;
+		memmove(mock_buf, nl+1, mock_len+1);
+	}
+	if (mock_len == sizeof(mock_buf)-1)
+		mock_len = 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Link tty, IIO
+//-----------------------------------------------------------------------------
+
+static void tty_open(void)
+{
+	struct termios t;
+
+	tty_fd = open(tty, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (tty_fd < 0)
+		die(tty);
+	if (tcgetattr(tty_fd, &t) == 0)
+	{
+		cfmakeraw(&t);
+		cfsetspeed(&t, B9600);
+		t.c_cflag |= CLOCAL | CREAD;
+		tcsetattr(tty_fd, TCSANOW, &t);
+	}
+	add_fd(tty_fd);
+}
+
+
+static void tty_input(void)
+{
+	unsigned char buf[64];
+	ssize_t n;
+
+	while ((n = read(tty_fd, buf, sizeof(buf))) > 0)
+		hw_rx(buf, n);
+}
+
+
+static void tx(unsigned char c)
+{
+	if (tty_fd >= 0 && write(tty_fd, &c, 1) < 0 && errno != EAGAIN)
+		die(tty);
+}
+
+
+static void iio_open(void)
+{
+	char path[512], *colon;
+	int ch;
+
+	colon = strrchr(iio, ':');
+	if (colon)
+	{
+		iio_bits = atoi(colon+1);
+		*colon = 0;
+	}
+	for (ch=0; ch<4; ch++)
+	{
+		snprintf(path, sizeof(path), "%s/in_voltage%d_raw", iio, ch);
+		iio_fd[ch] = open(path, O_RDONLY | O_CLOEXEC);
+		if (iio_fd[ch] < 0)
+			die(path);
+	}
+}
+
+
+// read the IIO channels every 100 ms, scaled to 16 bits
+static void step(void)
+{
+	char buf[16];
+	ssize_t n;
+	int ch;
+
+	if (!iio || hw_now < iio_next)
+		return;
+	iio_next = hw_now + HW_MS(100);
+	for (ch=0; ch<4; ch++)
+	{
+		n = pread(iio_fd[ch], buf, sizeof(buf)-1, 0);
+		if (n <= 0)
+			continue;
+		buf[n] = 0;
+		iio_val[ch] = (unsigned short)(strtoul(buf, 0, 10) << (16 - iio_bits));
+	}
+}
+
+
+// water sensor: swing proportional to the excitation (IDA0 0-154), with
+//   amplitude iio_val[ch] (16 bit p-p) or 100 LSB per step and -r ratio
+static unsigned short adc(unsigned char ch, unsigned char ida)
+{
+	long swing = (long)ida - 77;
+
+	if (iio)
+		return ch < 2 ? 0x8000 + swing*iio_val[ch]/154 : iio_val[ch];
+	switch (ch)
+	{
+	case 0:
+		return 0x8000 + swing*100;
+	case 1:
+		return 0x8000 + swing*100*(long)ratio/65536;
+	case 2:
+		return pot2;
+	default:
+		return pot3;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Event loop
+//-----------------------------------------------------------------------------
+
+// sleep until the Timer2 tick at t, handling the inputs meanwhile; other
+//   events run without waiting (see top)
+static hw_time wait(hw_time t, int t2)
+{
+	struct itimerspec its = { { 0, 0 }, { 0, 0 } };
+	struct epoll_event ev[8];
+	int i, n;
+
+	if (!t2)
+		return t;
+	its.it_value = real_time(t);
+	if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, 0) < 0)
+		die("timerfd_settime");
+
+	while (1)
+	{
+		n = epoll_wait(ep, ev, 8, -1);
+		if (n < 0 && errno != EINTR)
+			die("epoll_wait");
+		for (i=0; i<n; i++)
+		{
+			int fd = ev[i].data.fd;
+
+			if (fd == tfd)
+			{
+				unsigned long long exp;
+
+				if (read(tfd, &exp, sizeof(exp)) > 0)
+					return t;
+			}
+			else if (fd == sfd)
+			{
+				// stop in the safe state, as after a power loss
+				set_outputs(P1_SAFE, P1_MASK);
+				exit(0);
+			}
+			else if (fd == tty_fd)
+				tty_input();
+			else if (fd == 0)
+				mock_input();
+			else
+				gpio_events(fd);
+		}
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	static const struct hw_env env = { wait, step, set_outputs, tx, adc, 0 };
+	sigset_t sigs;
+	int c, r;
+
+	while ((c = getopt(argc, argv, "c:l:s:i:r:2:3:x:m")) != -1)
+		switch (c)
+		{
+		case 'c': chip = optarg; break;
+		case 'l':
+			if (sscanf(optarg, "%u,%u,%u,%u,%u,%u,%u", &line[0], &line[1], &line[2],
+				&line[3], &line[4], &line[5], &line[6]) != N_LINES)
+				goto usage;
+			break;
+		case 's': tty = optarg; break;
+		case 'i': iio = optarg; break;
+		case 'r': ratio = strtoul(optarg, 0, 0); break;
+		case '2': pot2 = strtoul(optarg, 0, 0); break;
+		case '3': pot3 = strtoul(optarg, 0, 0); break;
+		case 'x': speed = atof(optarg); break;
+		case 'm': mock = 1; break;
+		default:
+		usage:
+			fprintf(stderr, "usage: tendonid [-c chip] [-l lines] [-s tty] [-i iio-dir[:bits]]\n"
+				"                [-r wd] [-2 pot] [-3 pot] [-x speed] [-m]\n");
+			return 2;
+		}
+
+	ep = epoll_create1(EPOLL_CLOEXEC);
+	tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (ep < 0 || tfd < 0)
+		die("epoll/timerfd");
+	add_fd(tfd);
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGTERM);
+	sigaddset(&sigs, SIGINT);
+	sigprocmask(SIG_BLOCK, &sigs, 0);
+	sfd = signalfd(-1, &sigs, SFD_CLOEXEC);
+	add_fd(sfd);
+
+	if (mock)
+	{
+		setvbuf(stdout, 0, _IOLBF, 0);
+		P0_1 = 1;
+		add_fd(0);
+	}
+	else
+		gpio_open();
+	if (tty)
+		tty_open();
+	if (iio)
+		iio_open();
+	step();
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	r = hw_run(&env, ~(hw_time)0);
+	if (r == HW_RST_WD || r == HW_RST_SW)
+	{
+		// on the chip the application starts again: the same from a fresh process
+		fprintf(stderr, "tendonid: %s reset, restarting\n", r == HW_RST_WD ? "watchdog" : "software");
+		set_outputs(P1_SAFE, P1_MASK);
+		sigprocmask(SIG_UNBLOCK, &sigs, 0);
+		execv("/proc/self/exe", argv);
+		die("execv");
+	}
+	set_outputs(P1_SAFE, P1_MASK);
+	return 1;
+}
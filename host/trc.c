@@ -0,0 +1,745 @@
+//-----------------------------------------------------------------------------
+// trc.c
+// TENDONI V2
+// rev1 - RV110905
+// recorder, reader and replay of the TRACEMODE sensor trace
+//-----------------------------------------------------------------------------
+// usage: trc -o file [-u capture] [-t s] [-r wd] [-w pulses/s] [-e noise]
+//        trc [-x] [-f s] [-l s] file
+//        trc -p [-c] [-f s] [-l s] file
+//   -o  record the trace frames (LINK_T_TRACE_HDR, LINK_T_TRACE) into file:
+//       from a raw UART0 capture of a TRACEMODE unit (-u, "-" for stdin), or
+//       else from the native TRACEMODE build run for -t seconds (default 60)
+//       on the sensor model of run.c (-r -w), plus +-noise LSB (default 20)
+//   read (no -o, -p): chunks, samples, gaps and the decoding speed of the
+//       range; -x prints each sample (second, slot, channel, value)
+//   -p  replay the range into the native build: each A/D conversion gets the
+//       recorded sample of its slot, Timer0 the pulses recorded in its second
+//   -c  with -p, trace again during the replay and compare samples and
+//       Timer0 counts with the file (from its start only: the replay starts
+//       at power on, the traced cycles of a range would not be the same)
+//   -f  first second of the range, -l seconds (default: whole file)
+// The file is the one described in trace.h: chunks of 16 byte header and
+//   delta bytes, then the index. The reader maps it and finds the first
+//   chunk of the range with a binary search on the index (rebuilt by a scan
+//   if the recording was cut before it was written); every chunk decodes on
+//   its own.
+// Slots follow each other within a chunk; after slot DA_PERIOD-1 come
+//   TRACE_EVERY-1 cycles not traced: the replay repeats the last traced
+//   sample of each slot for them. After a gap it waits for the second and
+//   the slot of the next chunk. From the start of a recording without gaps
+//   the replay is exact: -c gets back the same samples.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hw.h"
+#include "../link.h"
+#include "../F35x_ADC0.h"
+#include "../trace.h"
+
+#define HDR_SIZE 16
+#define MAX_CHUNK 0x10000		// bytes in a chunk (u16 in the header)
+
+// firmware (TRACEMODE objects)
+extern const unsigned char ad_ch_arr[DA_PERIOD];
+extern unsigned char adDaCounter;
+extern volatile unsigned char seconds_cnt;
+
+// recorder: link frames in, chunks out
+struct rec
+{
+	FILE *f;
+	unsigned char frame[3+LINK_MAX_PAYLOAD+1];
+	int flen;
+	int open, lost;
+	uint32_t sec;				// unwrapped seconds_cnt of the chunk
+	int have_sec;
+	unsigned char hdr[HDR_SIZE];
+	unsigned char buf[MAX_CHUNK];
+	unsigned len;
+	uint32_t *idx;				// seconds, offset of each chunk
+	unsigned long n_idx, max_idx, off;
+};
+
+// mapped trace file
+struct trc
+{
+	const unsigned char *m;
+	size_t size;
+	uint32_t *sec, *off;		// index
+	unsigned long n;
+};
+
+struct chunk
+{
+	uint32_t sec;
+	unsigned tm0, slot, flags, samples, bytes;
+	const unsigned char *data;
+};
+
+static struct rec rec, retrace;
+static struct trc trc;
+static unsigned long ratio = 32768, wind, noise = 20;
+static uint32_t rnd = 1;
+
+// replay state
+static unsigned long r_chunk, r_end;	// next chunk, end of the range
+static struct chunk r_cur;
+static unsigned short r_val[MAX_CHUNK], r_hold[DA_PERIOD];
+static unsigned r_n, r_k, r_skip, r_every = TRACE_EVERY;
+static int r_sync = 1, r_started;
+static long r_off;						// recorded second - replay second
+static unsigned long r_secs, r_first, r_fed, r_held, r_badch;
+static unsigned char r_last_sec;
+static unsigned long r_pulses, r_rate;
+static hw_time r_sec_start;
+
+
+//-----------------------------------------------------------------------------
+// Recorder
+//-----------------------------------------------------------------------------
+
+static void put16(unsigned char *p, unsigned v)
+{
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)(v >> 8);
+}
+
+
+static void put32(unsigned char *p, uint32_t v)
+{
+	put16(p, v & 0xFFFF);
+	put16(p+2, v >> 16);
+}
+
+
+static unsigned get16(const unsigned char *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+
+static uint32_t get32(const unsigned char *p)
+{
+	return get16(p) | (uint32_t)get16(p+2) << 16;
+}
+
+
+static void rec_fail(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+
+// write the chunk being received, up to its last whole sample: a frame
+//   lost on the way may have cut one
+static void rec_close(struct rec *r)
+{
+	unsigned i, n = 0, len = 0;
+
+	if (!r->open)
+		return;
+	r->open = 0;
+	for (i=0; i<r->len; i++)
+		if (!(r->buf[i] & 0x80))
+		{
+			n++;
+			len = i+1;
+		}
+	put16(r->hdr+12, n);
+	put16(r->hdr+14, len);
+	if (r->n_idx == r->max_idx)
+	{
+		r->max_idx = r->max_idx ? 2*r->max_idx : 4096;
+		if (!(r->idx = realloc(r->idx, r->max_idx*2*sizeof(*r->idx))))
+			rec_fail("trc");
+	}
+	r->idx[2*r->n_idx] = r->sec;
+	r->idx[2*r->n_idx+1] = r->off;
+	r->n_idx++;
+	if (fwrite(r->hdr, HDR_SIZE, 1, r->f) != 1 || (len && fwrite(r->buf, len, 1, r->f) != 1))
+		rec_fail("trc");
+	r->off += HDR_SIZE + len;
+}
+
+
+static void rec_frame(struct rec *r, unsigned char type, const unsigned char *p, unsigned char len)
+{
+	if (type == LINK_T_TRACE_HDR && len == 5)
+	{
+		rec_close(r);
+		// seconds_cnt is 8 bit: unwrapped on the previous chunk
+		r->sec = r->have_sec ? r->sec + (unsigned char)(p[0] - r->sec) : p[0];
+		r->have_sec = 1;
+		memcpy(r->hdr, "TRC1", 4);
+		put32(r->hdr+4, r->sec);
+		put16(r->hdr+8, get16(p+1));
+		r->hdr[10] = p[3];
+		r->hdr[11] = p[4] | (r->lost ? TRACE_F_GAP : 0);
+		r->open = 1;
+		r->lost = 0;
+		r->len = 0;
+	}
+	else if (type == LINK_T_TRACE && r->open)
+	{
+		if (r->len + len > MAX_CHUNK)
+		{
+			rec_close(r);
+			r->lost = 1;
+			return;
+		}
+		memcpy(r->buf + r->len, p, len);
+		r->len += len;
+	}
+}
+
+
+// link frame decoder as difftest.c; a bad frame ends the chunk, the next
+//   one is marked as a gap
+static void rec_byte(struct rec *r, unsigned char c)
+{
+	unsigned char sum = 0;
+	int i;
+
+	if (r->flen == 0 && c != LINK_SOF)
+		return;
+	r->frame[r->flen++] = c;
+	if (r->flen == 3 && r->frame[2] > LINK_MAX_PAYLOAD)
+	{
+		r->flen = 0;
+		r->lost |= r->open;
+		rec_close(r);
+		return;
+	}
+	if (r->flen < 3 || r->flen < 4 + r->frame[2])
+		return;
+	for (i=1; i<r->flen; i++)
+		sum += r->frame[i];
+	if (sum == 0)
+		rec_frame(r, r->frame[1], r->frame+3, r->frame[2]);
+	else
+	{
+		r->lost |= r->open;
+		rec_close(r);
+	}
+	r->flen = 0;
+}
+
+
+// close the last chunk, append the index
+static void rec_finish(struct rec *r)
+{
+	unsigned char t[8];
+	unsigned long i;
+
+	rec_close(r);
+	for (i=0; i<r->n_idx; i++)
+	{
+		put32(t, r->idx[2*i]);
+		put32(t+4, r->idx[2*i+1]);
+		if (fwrite(t, 8, 1, r->f) != 1)
+			rec_fail("trc");
+	}
+	put32(t, r->n_idx);
+	memcpy(t+4, "TIDX", 4);
+	if (fwrite(t, 8, 1, r->f) != 1 || fflush(r->f))
+		rec_fail("trc");
+}
+
+
+//-----------------------------------------------------------------------------
+// Reader
+//-----------------------------------------------------------------------------
+
+static int chunk_at(const struct trc *t, unsigned long k, struct chunk *c)
+{
+	const unsigned char *p = t->m + t->off[k];
+
+	c->sec = get32(p+4);
+	c->tm0 = get16(p+8);
+	c->slot = p[10] % DA_PERIOD;
+	c->flags = p[11];
+	c->samples = get16(p+12);
+	c->bytes = get16(p+14);
+	c->data = p + HDR_SIZE;
+	return t->off[k] + HDR_SIZE + c->bytes <= t->size;
+}
+
+
+static int trc_open(struct trc *t, const char *name)
+{
+	struct stat st;
+	unsigned long n, i;
+	size_t o;
+	int fd = open(name, O_RDONLY);
+
+	if (fd < 0 || fstat(fd, &st))
+	{
+		perror(name);
+		return 1;
+	}
+	t->size = st.st_size;
+	t->m = t->size ? mmap(0, t->size, PROT_READ, MAP_PRIVATE, fd, 0) : 0;
+	close(fd);
+	if (t->m == MAP_FAILED)
+	{
+		perror(name);
+		return 1;
+	}
+	n = t->size >= 8 && !memcmp(t->m + t->size - 4, "TIDX", 4) ? get32(t->m + t->size - 8) : 0;
+	if (n && 8 + 8*(size_t)n <= t->size)
+	{
+		const unsigned char *p = t->m + t->size - 8 - 8*n;
+
+		t->sec = malloc(n * sizeof(*t->sec));
+		t->off = malloc(n * sizeof(*t->off));
+		if (!t->sec || !t->off)
+			rec_fail("trc");
+		for (i=0; i<n; i++)
+		{
+			t->sec[i] = get32(p + 8*i);
+			t->off[i] = get32(p + 8*i + 4);
+		}
+		t->n = n;
+		return 0;
+	}
+
+	// no index: cut recording, chunks are found by their magic
+	fprintf(stderr, "%s: no index, scanning\n", name);
+	for (o=0, i=0; o + HDR_SIZE <= t->size && !memcmp(t->m + o, "TRC1", 4); o += HDR_SIZE + get16(t->m + o + 14))
+	{
+		if (o + HDR_SIZE + get16(t->m + o + 14) > t->size)
+			break;
+		if (t->n == i)
+		{
+			i = i ? 2*i : 4096;
+			if (!(t->sec = realloc(t->sec, i * sizeof(*t->sec))) || !(t->off = realloc(t->off, i * sizeof(*t->off))))
+				rec_fail("trc");
+		}
+		t->sec[t->n] = get32(t->m + o + 4);
+		t->off[t->n++] = o;
+	}
+	return 0;
+}
+
+
+// first chunk of second s or later
+static unsigned long trc_seek(const struct trc *t, uint32_t s)
+{
+	unsigned long lo = 0, hi = t->n;
+
+	while (lo < hi)
+	{
+		unsigned long mid = (lo + hi) / 2;
+
+		if (t->sec[mid] < s)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+
+// samples of a chunk; slot of val[i] is (c->slot + i) % DA_PERIOD
+static unsigned decode(const struct chunk *c, unsigned short *val)
+{
+	unsigned short pred[DA_PERIOD] = { 0 };
+	const unsigned char *p = c->data, *end = p + c->bytes;
+	unsigned n = 0, s = c->slot, z;
+
+	while (p < end)
+	{
+		z = *p++;
+		if (z & 0x80)
+		{
+			z = (z & 0x7F) | (*p & 0x7F) << 7;
+			if (*p++ & 0x80)
+				z |= (*p++ & 0x03) << 14;
+		}
+		// zigzag: 0, -1, 1, -2...
+		pred[s] += (unsigned short)((z >> 1) ^ -(z & 1));
+		val[n++] = pred[s];
+		if (++s == DA_PERIOD)
+			s = 0;
+	}
+	return n;
+}
+
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+// summary and decoding speed of chunks a..b-1, or all samples (-x)
+static int read_range(unsigned long a, unsigned long b, int dump)
+{
+	static unsigned short val[MAX_CHUNK];
+	unsigned long k, chunks = 0, samples = 0, gaps = 0, bytes = 0, passes = 0;
+	double t0, t;
+	struct chunk c;
+	unsigned i, n;
+
+	if (a == b)
+	{
+		printf("no chunks in the range\n");
+		return 1;
+	}
+	t0 = now();
+	do
+	{
+		for (k=a; k<b; k++)
+		{
+			if (!chunk_at(&trc, k, &c))
+			{
+				printf("chunk %lu cut at the end of the file\n", k);
+				return 1;
+			}
+			n = decode(&c, val);
+			if (passes)
+				continue;
+			chunks++;
+			samples += n;
+			bytes += c.bytes;
+			gaps += c.flags & TRACE_F_GAP ? 1 : 0;
+			if (n != c.samples)
+			{
+				printf("second %lu: %u samples decoded, %u in the header\n", (unsigned long)c.sec, n, c.samples);
+				return 1;
+			}
+			if (dump)
+				for (i=0; i<n; i++)
+				{
+					unsigned s = (c.slot + i) % DA_PERIOD;
+
+					printf("%lu %2u %u %5u\n", (unsigned long)c.sec, s, ad_ch_arr[s], val[i]);
+				}
+		}
+		passes++;
+		t = now() - t0;
+	} while (!dump && t < 0.2);
+	if (dump)
+		return 0;
+	printf("seconds %lu-%lu: %lu chunks, %lu gaps, %lu samples in %lu bytes (%.2f byte/sample)\n",
+		(unsigned long)trc.sec[a], (unsigned long)trc.sec[b-1], chunks, gaps, samples, bytes,
+		samples ? (double)bytes/samples : 0.);
+	printf("decoded at %.3g samples/s, %.3g MB/s of trace\n",
+		samples*passes/t, (bytes + chunks*HDR_SIZE)*passes/t/1e6);
+	return 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Sources for the native build
+//-----------------------------------------------------------------------------
+
+// sensor model of run.c plus noise
+static unsigned short model_adc(unsigned char ch, unsigned char ida)
+{
+	long swing = (long)ida - 77, v;
+
+	rnd ^= rnd << 13;
+	rnd ^= rnd >> 17;
+	rnd ^= rnd << 5;
+	v = noise ? (long)(rnd % (2*noise+1)) - (long)noise : 0;
+	switch (ch)
+	{
+	case 0:
+		return 0x8000 + swing*100 + v;
+	case 1:
+		return 0x8000 + swing*100*(long)ratio/65536 + v;
+	default:
+		return 0x8000 + v;
+	}
+}
+
+
+static void model_step(void)
+{
+	hw_t0_pulses = hw_now * wind / HW_CLK;
+}
+
+
+static void rec_tx(unsigned char c)
+{
+	rec_byte(&rec, c);
+}
+
+
+// next chunk of the range into r_val
+static int replay_next(void)
+{
+	while (r_chunk < r_end)
+	{
+		if (!chunk_at(&trc, r_chunk++, &r_cur))
+			break;
+		r_n = decode(&r_cur, r_val);
+		r_k = 0;
+		if (r_cur.flags & TRACE_F_GAP)
+			r_sync = 1;
+		r_every = (r_cur.flags >> 4) + 1;
+		if (r_n)
+			return 1;
+	}
+	return 0;
+}
+
+
+static unsigned short replay_adc(unsigned char ch, unsigned char ida)
+{
+	unsigned char s = adDaCounter;
+	unsigned short v;
+
+	if (ch != ad_ch_arr[s])
+		r_badch++;
+	if (r_k == r_n && !replay_next())
+	{
+		hw_stop(HW_END);
+		return r_hold[s];
+	}
+
+	// cycles not traced
+	if (r_skip)
+	{
+		if (s == DA_PERIOD-1)
+			r_skip--;
+		r_held++;
+		return r_hold[s];
+	}
+
+	// at the start and after a gap: wait for the second and the slot
+	if ((r_cur.slot + r_k) % DA_PERIOD != s || (r_sync && r_started && (long)r_secs + r_off < (long)r_cur.sec))
+	{
+		r_held++;
+		return r_hold[s];
+	}
+	if (!r_started)
+	{
+		r_off = (long)r_cur.sec - (long)r_secs;
+		r_first = r_secs;
+	}
+	r_started = 1;
+	r_sync = 0;
+	v = r_hold[s] = r_val[r_k++];
+	if (s == DA_PERIOD-1)
+		r_skip = r_every - 1;
+	r_fed++;
+	return v;
+}
+
+
+// Timer0 counter (tm0_cnt) at the tick of second s, from its first chunk
+static long tm0_at(const struct trc *t, uint32_t s)
+{
+	unsigned long k = trc_seek(t, s);
+
+	return k < t->n && t->sec[k] == s ? (long)get16(t->m + t->off[k] + 8) : -1;
+}
+
+
+// Timer0: the pulses counted between two recorded ticks, spread over the
+//   first 0.9 s of the replayed second so they all fall before its end
+static void replay_step(void)
+{
+	hw_time dt;
+
+	if (seconds_cnt != r_last_sec)
+	{
+		long a, b;
+
+		r_last_sec = seconds_cnt;
+		r_secs++;
+		r_pulses += r_rate;
+		r_sec_start = hw_now;
+		a = tm0_at(&trc, r_secs + r_off);
+		b = tm0_at(&trc, r_secs + r_off + 1);
+		r_rate = r_started && a >= 0 && b >= 0 ? (unsigned short)(b - a) : 0;
+	}
+	dt = hw_now - r_sec_start;
+	hw_t0_pulses = r_pulses + (dt >= HW_CLK*9/10 ? r_rate : r_rate * dt / (HW_CLK*9/10));
+}
+
+
+static void replay_tx(unsigned char c)
+{
+	if (retrace.f)
+		rec_byte(&retrace, c);
+}
+
+
+// samples of the retrace against the file from chunk a on
+static int compare(unsigned long a)
+{
+	static unsigned short v1[MAX_CHUNK], v2[MAX_CHUNK];
+	struct trc t2 = { 0 };
+	struct chunk c1, c2;
+	unsigned long k1 = a, k2 = 0, same = 0, secs = 0;
+	unsigned n1 = 0, n2 = 0, i1 = 0, i2 = 0;
+	char name[32];
+
+	rec_finish(&retrace);
+	snprintf(name, sizeof(name), "/dev/fd/%d", fileno(retrace.f));
+	if (trc_open(&t2, name))
+		return 1;
+	for (;;)
+	{
+		if (i1 == n1)
+		{
+			if (k1 == trc.n || !chunk_at(&trc, k1++, &c1))
+				break;
+			n1 = decode(&c1, v1);
+			i1 = 0;
+			continue;
+		}
+		if (i2 == n2)
+		{
+			if (k2 == t2.n || !chunk_at(&t2, k2++, &c2))
+				break;
+			n2 = decode(&c2, v2);
+			i2 = 0;
+			continue;
+		}
+		if ((c1.slot + i1) % DA_PERIOD != (c2.slot + i2) % DA_PERIOD || v1[i1] != v2[i2])
+		{
+			printf("retrace differs after %lu samples: second %lu slot %u %u, retraced second %lu slot %u %u\n",
+				same, (unsigned long)c1.sec, (c1.slot + i1) % DA_PERIOD, v1[i1],
+				(unsigned long)c2.sec, (c2.slot + i2) % DA_PERIOD, v2[i2]);
+			return 1;
+		}
+		same++;
+		i1++;
+		i2++;
+	}
+	printf("retrace: %lu samples equal to the file\n", same);
+
+	// pulses of each second, where both ends are in both files, from the
+	//   first one replayed whole
+	for (k2=0; k2<t2.n; k2++)
+	{
+		uint32_t s = t2.sec[k2];
+		long x = tm0_at(&t2, s), y = tm0_at(&t2, s+1), fx = tm0_at(&trc, s + r_off), fy = tm0_at(&trc, s + r_off + 1);
+
+		if ((k2 && s == t2.sec[k2-1]) || s <= r_first || x < 0 || y < 0 || fx < 0 || fy < 0)
+			continue;
+		if ((unsigned short)(y - x) != (unsigned short)(fy - fx))
+		{
+			printf("retrace second %lu: %u Timer0 pulses, %u in the file\n", (unsigned long)s,
+				(unsigned short)(y - x), (unsigned short)(fy - fx));
+			return 1;
+		}
+		secs++;
+	}
+	printf("retrace: Timer0 counts of %lu seconds equal to the file\n", secs);
+	return !same;
+}
+
+
+int main(int argc, char **argv)
+{
+	static const struct hw_env model = { 0, model_step, 0, rec_tx, model_adc, 0 };
+	static const struct hw_env replay = { 0, replay_step, 0, replay_tx, replay_adc, 0 };
+	const char *out = 0, *cap = 0;
+	double t = 60;
+	long from = -1, len = -1;
+	int c, dump = 0, play = 0, check = 0, r;
+	unsigned long a, b;
+
+	while ((c = getopt(argc, argv, "o:u:t:r:w:e:xpcf:l:")) != -1)
+		switch (c)
+		{
+		case 'o': out = optarg; break;
+		case 'u': cap = optarg; break;
+		case 't': t = atof(optarg); break;
+		case 'r': ratio = strtoul(optarg, 0, 0); break;
+		case 'w': wind = strtoul(optarg, 0, 0); break;
+		case 'e': noise = strtoul(optarg, 0, 0); break;
+		case 'x': dump = 1; break;
+		case 'p': play = 1; break;
+		case 'c': check = 1; break;
+		case 'f': from = atol(optarg); break;
+		case 'l': len = atol(optarg); break;
+		default:
+			fprintf(stderr, "usage: trc -o file [-u capture] [-t s] [-r wd] [-w pulses/s] [-e noise]\n"
+				"       trc [-x] [-f s] [-l s] file\n"
+				"       trc -p [-c] [-f s] [-l s] file\n");
+			return 2;
+		}
+
+	// record
+	if (out)
+	{
+		if (!(rec.f = fopen(out, "wb")))
+			rec_fail(out);
+		if (cap)
+		{
+			FILE *f = strcmp(cap, "-") ? fopen(cap, "rb") : stdin;
+
+			if (!f)
+				rec_fail(cap);
+			while ((c = getc(f)) != EOF)
+				rec_byte(&rec, c);
+		}
+		else if ((r = hw_run(&model, (hw_time)(t*HW_CLK))) != HW_END)
+		{
+			printf("native build stopped (%d) at %.3f s\n", r, (double)hw_now/HW_CLK);
+			return 1;
+		}
+		rec_finish(&rec);
+		fclose(rec.f);
+		printf("%lu chunks, %lu bytes\n", rec.n_idx, rec.off + 8*rec.n_idx + 8);
+		return !rec.n_idx;
+	}
+
+	if (optind != argc-1)
+	{
+		fprintf(stderr, "trc: no trace file\n");
+		return 2;
+	}
+	if (trc_open(&trc, argv[optind]))
+		return 1;
+	if (!trc.n)
+	{
+		printf("no chunks\n");
+		return 1;
+	}
+	a = from < 0 ? 0 : trc_seek(&trc, from);
+	b = len < 0 ? trc.n : trc_seek(&trc, (a < trc.n ? trc.sec[a] : 0) + len);
+	if (!play)
+		return read_range(a, b, dump);
+
+	// replay
+	if (check && from > 0)
+	{
+		fprintf(stderr, "trc: -c compares from the start of the recording\n");
+		return 2;
+	}
+	r_chunk = a;
+	r_end = b;
+	r_last_sec = seconds_cnt;
+	if (check && !(retrace.f = tmpfile()))
+		rec_fail("trc");
+	r = hw_run(&replay, (hw_time)(trc.sec[b-1] - trc.sec[a] + 60) * HW_CLK);
+	if (r != HW_END)
+	{
+		printf("native build stopped (%d) at %.3f s\n", r, (double)hw_now/HW_CLK);
+		return 1;
+	}
+	printf("replayed %lu samples (%lu held) in %.3f s, %lu conversions on another channel\n",
+		r_fed, r_held, (double)hw_now/HW_CLK, r_badch);
+	if (r_badch || !r_fed)
+		return 1;
+	return check ? compare(a) : 0;
+}
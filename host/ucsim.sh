@@ -0,0 +1,41 @@
+#!/bin/sh
+# ucsim.sh
+# TENDONI V2
+# rev1 - RV110905
+# differential test: the .ihx built by SDCC, run by ucsim (s51), against
+#   the native build of the same sources (host/difftest.c)
+# usage: host/ucsim.sh [seconds]   (default 3600, uptime of the last frame)
+#
+# Both images are built with DIFFFLAGS of build.sh (SIMWEATHER STATEDUMP
+#   SIMNOAD): s51 has no ADC0, with SIMNOAD the 1s loop doesn't wait for it
+#   and all channels come from sim_ad. The 8052 core of s51 shares Timer2
+#   (vector 5, TMR2CN/RCAP at the same SFRs) and the UART with the F350; its
+#   clocks and baud rate differ (~600 baud from TH1 at SYSCLK/12/32), which
+#   changes how long a second takes, not what the 1s loop computes. The
+#   bootloader times out (no BOOT_SYNC on RX) and jumps to the application.
+# UART0 output goes to host/out/ucsim.raw, polled until its last state frame
+#   reaches the requested uptime; then difftest runs the native build for as
+#   long and compares frame by frame.
+
+S=${1:-3600}
+S51=${S51:-s51}
+RAW=host/out/ucsim.raw
+
+cd "$(dirname "$0")/.." || exit 1
+DIFFFLAGS=$(sed -n 's/^DIFFFLAGS="\(.*\)".*/\1/p' build.sh)
+SDCCFLAGS="$DIFFFLAGS" ./build.sh all || exit 1
+./build.sh host || exit 1
+
+rm -f $RAW
+$S51 -t 8052 -X 24.5M -S in=/dev/null,out=$RAW -G boot.ihx BATMON.ihx > host/out/ucsim.log 2>&1 &
+PID=$!
+while kill -0 $PID 2>/dev/null; do
+	sleep 10
+	T=$(host/out/difftest -q $RAW 2>/dev/null || echo 0)
+	echo "ucsim at uptime $T of $S"
+	[ "$T" -ge "$S" ] && break
+done
+kill $PID 2>/dev/null
+wait $PID 2>/dev/null
+
+host/out/difftest -t $((S+2)) -r $RAW
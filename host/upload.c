@@ -0,0 +1,605 @@
+//-----------------------------------------------------------------------------
+// upload.c
+// TENDONI V2
+// rev1 - RV110905
+// firmware uploader for the serial bootloader (boot.c)
+//-----------------------------------------------------------------------------
+// usage: upload [-d tty [-u unit]] [-s [-k blocks]] [image.ihx | -z bytes]
+//   -d  serial port to the unit (57600 8N1 as BOOT_BAUD)
+//   -u  first ask the application of that unit to restart in the bootloader
+//       (CMD_T_BOOT at the link baud rate), else the unit must be reset by
+//       hand: SYNC is repeated until the bootloader answers
+//   -s  no port: run the native bootloader (boot.o on host/hw.c) and print
+//       the update time, check the relays stay safe and the application
+//       starts at the next power on
+//   -k  with -s, cut the power after that many blocks first: the next power
+//       on must stay in the bootloader, then the update is done again
+//   -z  a pseudo-random image of that many bytes at BOOT_APP instead of a
+//       .ihx (6144 for a full one)
+// Each page of the image is sent from its start, so the bootloader erases it
+//   with its first block; blocks all erased are skipped, except the first
+//   of a page, and the erased tail of a block is not sent.
+// A block is retried up to 5 times on BOOT_NAK or after 1.5 s without reply.
+// The bootloader of the ucsim image (host/ucsim.sh) can be reached the same
+//   way with -d on a pty joined to the simulated UART.
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "hw.h"
+#include "../link.h"
+#include "../cmd.h"
+
+// as in boot.c
+#define BOOT_APP 0x0400
+#define BOOT_END 0x1C00
+#define BOOT_PAGE 512
+#define BOOT_BLOCK 64
+#define BOOT_SYNC 'U'
+#define BOOT_HELLO 'B'
+#define BOOT_ACK 'A'
+#define BOOT_NAK 'N'
+
+#define N_BLOCKS ((BOOT_END-BOOT_APP)/BOOT_BLOCK)
+#define RETRIES 5
+#define T_SYNC 10				// ms between SYNCs
+#define T_REPLY 1500			// ms for the reply to a block
+
+enum { U_SYNC, U_BLOCK, U_GO, U_DONE, U_FAIL };
+
+static unsigned char img[HW_FLASH_SIZE];
+static unsigned short blk_addr[N_BLOCKS];
+static unsigned char blk_len[N_BLOCKS];
+static unsigned n_blk, n_pages, n_bytes;
+
+// protocol state
+static int state = U_SYNC;
+static unsigned blk, tries, naks;
+static unsigned char out[4+BOOT_BLOCK+2];
+static int out_len;
+
+// simulation: results of a run in its own process, flash shared with it
+static struct sim
+{
+	unsigned char flash[HW_FLASH_SIZE];
+	int r, state, unsafe;
+	unsigned blk, naks;
+	hw_time t_hello, t_done, t_end;
+} *sim;
+static long cut = -1;
+static hw_time deadline;
+static int host_on;				// the uploader talks in this run
+
+
+//-----------------------------------------------------------------------------
+// Image
+//-----------------------------------------------------------------------------
+
+static int hex(const char *s, int n)
+{
+	int v = 0;
+
+	while (n--)
+	{
+		int c = *s++;
+
+		if (c >= '0' && c <= '9')
+			c -= '0';
+		else if (c >= 'A' && c <= 'F')
+			c -= 'A' - 10;
+		else if (c >= 'a' && c <= 'f')
+			c -= 'a' - 10;
+		else
+			return -1;
+		v = v << 4 | c;
+	}
+	return v;
+}
+
+
+// Intel HEX (SDCC .ihx): data records in the application area
+static int read_ihx(const char *name)
+{
+	FILE *f = fopen(name, "r");
+	char line[600];
+	int n = 0;
+
+	if (!f)
+	{
+		perror(name);
+		return 1;
+	}
+	while (fgets(line, sizeof(line), f))
+	{
+		int len, addr, type, i, v;
+		unsigned char sum = 0;
+
+		n++;
+		if (line[0] != ':')
+			continue;
+		len = hex(line+1, 2);
+		addr = hex(line+3, 4);
+		type = hex(line+7, 2);
+		for (i=0; len >= 0 && i < len+5; i++)
+		{
+			if ((v = hex(line+1+2*i, 2)) < 0)
+				break;
+			sum += v;
+		}
+		if (len < 0 || addr < 0 || type < 0 || i < len+5 || sum)
+		{
+			fprintf(stderr, "%s:%d: bad record\n", name, n);
+			return 1;
+		}
+		if (type == 1)
+			break;
+		if (type != 0)
+			continue;
+		if (addr < BOOT_APP || addr+len > BOOT_END)
+		{
+			fprintf(stderr, "%s:%d: 0x%04X-0x%04X outside the application (0x%04X-0x%04X)\n",
+				name, n, addr, addr+len-1, BOOT_APP, BOOT_END-1);
+			return 1;
+		}
+		for (i=0; i<len; i++)
+			img[addr+i] = hex(line+9+2*i, 2);
+		n_bytes += len;
+	}
+	fclose(f);
+	return 0;
+}
+
+
+// blocks of the pages with data, see above
+static void make_blocks(void)
+{
+	unsigned p, a, len;
+
+	n_blk = n_pages = 0;
+	for (p=BOOT_APP; p<BOOT_END; p+=BOOT_PAGE)
+	{
+		for (a=p; a<p+BOOT_PAGE && img[a] == 0xFF; a++)
+			;
+		if (a == p+BOOT_PAGE)
+			continue;
+		n_pages++;
+		for (a=p; a<p+BOOT_PAGE; a+=BOOT_BLOCK)
+		{
+			for (len=BOOT_BLOCK; len && img[a+len-1] == 0xFF; len--)
+				;
+			if (len || a == p)
+			{
+				blk_addr[n_blk] = a;
+				blk_len[n_blk++] = len;
+			}
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Protocol
+//-----------------------------------------------------------------------------
+
+// CRC16-CCITT as boot_crc()
+static unsigned short crc16(unsigned short crc, unsigned char c)
+{
+	int i;
+
+	crc ^= (unsigned short)c << 8;
+	for (i=0; i<8; i++)
+		crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	return crc;
+}
+
+
+// next frame to send in out[], for the current state
+static void frame(void)
+{
+	unsigned short crc = 0xFFFF;
+	int i;
+
+	if (state == U_SYNC)
+	{
+		out[0] = BOOT_SYNC;
+		out_len = 1;
+		return;
+	}
+	if (state == U_GO)
+	{
+		out[0] = 'G';
+		out_len = 1;
+		return;
+	}
+	out[0] = 'W';
+	out[1] = blk_addr[blk] >> 8;
+	out[2] = (unsigned char)blk_addr[blk];
+	out[3] = blk_len[blk];
+	memcpy(out+4, img + blk_addr[blk], blk_len[blk]);
+	for (i=1; i<4+blk_len[blk]; i++)
+		crc = crc16(crc, out[i]);
+	out[i++] = crc >> 8;
+	out[i++] = (unsigned char)crc;
+	out_len = i;
+}
+
+
+// a reply byte, or -1 after the timeout: return 1 if out[] is to be sent
+//   (again), 0 to keep waiting
+static int reply(int c)
+{
+	if (state == U_SYNC)
+	{
+		if (c != BOOT_HELLO)
+			return c < 0;
+		state = n_blk ? U_BLOCK : U_GO;
+	}
+	else if (c == BOOT_HELLO)
+		return 0;				// late answer to a repeated SYNC
+	else if (c == BOOT_ACK && state == U_GO)
+	{
+		state = U_DONE;
+		return 0;
+	}
+	else if (c == BOOT_ACK)
+	{
+		tries = 0;
+		if (++blk == n_blk)
+			state = U_GO;
+	}
+	else
+	{
+		naks += c >= 0;
+		if (++tries == RETRIES)
+		{
+			state = U_FAIL;
+			return 0;
+		}
+	}
+	frame();
+	return 1;
+}
+
+
+//-----------------------------------------------------------------------------
+// Serial port
+//-----------------------------------------------------------------------------
+
+static int tty_open(const char *name, speed_t baud)
+{
+	struct termios t;
+	int fd = open(name, O_RDWR | O_NOCTTY);
+
+	if (fd < 0 || tcgetattr(fd, &t))
+	{
+		perror(name);
+		return -1;
+	}
+	cfmakeraw(&t);
+	cfsetispeed(&t, baud);
+	cfsetospeed(&t, baud);
+	t.c_cc[VMIN] = 0;
+	t.c_cc[VTIME] = 0;
+	if (tcsetattr(fd, TCSANOW, &t))
+	{
+		perror(name);
+		return -1;
+	}
+	tcflush(fd, TCIOFLUSH);
+	return fd;
+}
+
+
+static int tty_getc(int fd, int ms)
+{
+	struct pollfd p = { fd, POLLIN, 0 };
+	unsigned char c;
+
+	if (poll(&p, 1, ms) <= 0 || read(fd, &c, 1) != 1)
+		return -1;
+	return c;
+}
+
+
+// CMD_T_BOOT to the application at the link baud rate, wait for its ack
+static int tty_restart(const char *name, int unit)
+{
+	unsigned char f[5] = { LINK_SOF, CMD_T_BOOT, 1, unit };
+	int fd = tty_open(name, B9600), c, n = 0, i;
+	unsigned char r[3+LINK_MAX_PAYLOAD+1];
+
+	if (fd < 0)
+		return 1;
+	f[4] = -(f[1] + f[2] + f[3]);
+	for (i=0; i<3 && n == 0; i++)
+	{
+		if (write(fd, f, sizeof(f)) != sizeof(f))
+			break;
+		// reply: SOF CMD_T_ACK 2 'X' result sum, other frames skipped
+		while (n == 0 && (c = tty_getc(fd, 500)) >= 0)
+		{
+			int k = 0;
+
+			if (c != LINK_SOF)
+				continue;
+			r[k++] = c;
+			while (k < 3 || k < 4 + r[2])
+			{
+				if ((c = tty_getc(fd, 50)) < 0 || (k == 2 && c > LINK_MAX_PAYLOAD))
+					break;
+				r[k++] = c;
+			}
+			if (k == 6 && r[1] == CMD_T_ACK && r[2] == 2 && r[3] == CMD_T_BOOT)
+				n = r[4] == 0 ? 1 : -1;
+		}
+	}
+	close(fd);
+	if (n <= 0)
+		fprintf(stderr, "upload: unit %d %s\n", unit, n ? "refused the restart (moving?)" : "did not answer");
+	return n <= 0;
+}
+
+
+static int tty_upload(const char *name)
+{
+	int fd = tty_open(name, B57600), c;
+
+	if (fd < 0)
+		return 1;
+	frame();
+	while (state != U_DONE && state != U_FAIL)
+	{
+		if (write(fd, out, out_len) != out_len)
+		{
+			perror(name);
+			return 1;
+		}
+		do
+		{
+			c = tty_getc(fd, state == U_SYNC ? T_SYNC : T_REPLY);
+			if (state == U_SYNC && c == BOOT_HELLO)
+			{
+				// drop the answers to the SYNCs still on the way
+				usleep(20000);
+				tcflush(fd, TCIFLUSH);
+			}
+		} while (!reply(c) && state != U_DONE && state != U_FAIL);
+		if (state == U_BLOCK)
+			fprintf(stderr, "\r%u/%u blocks", blk, n_blk);
+	}
+	fprintf(stderr, "\r%u/%u blocks, %u NAKs: %s\n", blk, n_blk, naks,
+		state == U_DONE ? "application started" : "failed");
+	close(fd);
+	return state != U_DONE;
+}
+
+
+//-----------------------------------------------------------------------------
+// Simulation
+//-----------------------------------------------------------------------------
+
+static void sim_send(void)
+{
+	hw_rx(out, out_len);
+	deadline = hw_now + HW_MS(state == U_SYNC ? T_SYNC : T_REPLY);
+}
+
+
+static void sim_tx(unsigned char c)
+{
+	int s = state;
+
+	if (!host_on)
+		return;
+	if (s == U_SYNC && c == BOOT_HELLO)
+		sim->t_hello = hw_now;
+	if (reply(c))
+		sim_send();
+	if (state == U_DONE && s != U_DONE)
+		sim->t_done = hw_now;
+	if (state == U_FAIL || (long)blk == cut)
+		hw_stop(HW_END);
+}
+
+
+// SYNC from 1 ms after power on, then resends after the timeouts
+static void sim_step(void)
+{
+	if (!host_on || state == U_DONE || state == U_FAIL)
+		return;
+	if (!deadline)
+	{
+		if (hw_now < HW_MS(1))
+			return;
+		frame();
+		sim_send();
+	}
+	else if (hw_now >= deadline && reply(-1))
+		sim_send();
+}
+
+
+// relays in their safe state: RL_AUTO (P1.0) = 0, TRIAC_OFF (P1.1) = 1
+static void sim_out(unsigned char p1, unsigned char changed)
+{
+	if ((p1 & 0x03) != 0x02)
+		sim->unsafe++;
+}
+
+
+// one power on of the bootloader for at most t s, in a process of its own
+static int sim_run(int with_host, double t)
+{
+	static const struct hw_env env = { 0, sim_step, sim_out, sim_tx, 0, 0 };
+	pid_t pid;
+	int st;
+
+	fflush(stdout);
+	if ((pid = fork()) < 0)
+	{
+		perror("fork");
+		exit(1);
+	}
+	if (pid == 0)
+	{
+		memcpy(hw_flash, sim->flash, HW_FLASH_SIZE);
+		host_on = with_host;
+		sim->r = hw_run(&env, (hw_time)(t*HW_CLK));
+		sim->state = state;
+		sim->blk = blk;
+		sim->naks = naks;
+		sim->t_end = hw_now;
+		memcpy(sim->flash, hw_flash, HW_FLASH_SIZE);
+		exit(0);
+	}
+	waitpid(pid, &st, 0);
+	return sim->r;
+}
+
+
+static int sim_update(void)
+{
+	int r;
+
+	sim->t_hello = sim->t_done = 0;
+	r = sim_run(1, 10);
+	if (sim->state != U_DONE || r != HW_RET)
+	{
+		printf("update failed at block %u (state %d, run %d)\n", sim->blk, sim->state, r);
+		return 1;
+	}
+	if (memcmp(sim->flash + BOOT_APP, img + BOOT_APP, BOOT_END-BOOT_APP))
+	{
+		printf("flash differs from the image after the update\n");
+		return 1;
+	}
+	printf("update: %u bytes, %u pages, %u blocks, %u NAKs: %.3f s from HELLO to the ACK of G"
+		" (%.0f byte/s), %.3f s from power on\n",
+		n_bytes, n_pages, n_blk, sim->naks, (double)(sim->t_done - sim->t_hello)/HW_CLK,
+		n_bytes / ((double)(sim->t_done - sim->t_hello)/HW_CLK), (double)sim->t_done/HW_CLK);
+	return 0;
+}
+
+
+static int simulate(void)
+{
+	int r;
+
+	sim = mmap(0, sizeof(*sim), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (sim == MAP_FAILED)
+	{
+		perror("mmap");
+		return 1;
+	}
+	memset(sim, 0, sizeof(*sim));
+	memset(sim->flash, 0xFF, HW_FLASH_SIZE);
+
+	// a first image, then the power cut in the middle of the new one
+	if (cut >= 0)
+	{
+		unsigned char fw[HW_FLASH_SIZE];
+		long k = cut;
+
+		memcpy(fw, img, sizeof(fw));
+		memset(img + BOOT_APP, 0x5A, BOOT_END-BOOT_APP);
+		cut = -1;
+		make_blocks();
+		if (sim_update())
+			return 1;
+		memcpy(img, fw, sizeof(img));
+		make_blocks();
+		cut = k;
+		r = sim_run(1, 10);
+		printf("power cut after %u of %u blocks\n", sim->blk, n_blk);
+		if (r != HW_END || (long)sim->blk != cut)
+			return 1;
+		r = sim_run(0, 2);
+		printf("power on: %s\n", r == HW_END ? "bootloader stays active (application byte erased)" :
+			r == HW_RET ? "application started" : "reset");
+		if (r != HW_END)
+			return 1;
+		cut = -1;
+	}
+
+	if (sim_update())
+		return 1;
+	r = sim_run(0, 2);
+	printf("power on without host: %s after %.1f ms\n", r == HW_RET ? "application started" : "no start",
+		(double)sim->t_end*1000/HW_CLK);
+	if (r != HW_RET)
+		return 1;
+	if (sim->unsafe)
+		printf("relays left the safe state %d times\n", sim->unsafe);
+	return sim->unsafe != 0;
+}
+
+
+int main(int argc, char **argv)
+{
+	const char *dev = 0;
+	int c, unit = -1, s = 0;
+	long z = -1;
+
+	while ((c = getopt(argc, argv, "d:u:sk:z:")) != -1)
+		switch (c)
+		{
+		case 'd': dev = optarg; break;
+		case 'u': unit = atoi(optarg); break;
+		case 's': s = 1; break;
+		case 'k': cut = atol(optarg); break;
+		case 'z': z = atol(optarg); break;
+		default:
+			fprintf(stderr, "usage: upload [-d tty [-u unit]] [-s [-k blocks]] [image.ihx | -z bytes]\n");
+			return 2;
+		}
+	if (dev == 0 && !s)
+	{
+		fprintf(stderr, "upload: -d tty or -s\n");
+		return 2;
+	}
+
+	memset(img, 0xFF, sizeof(img));
+	if (z >= 0)
+	{
+		unsigned long x = 1;
+		long i;
+
+		if (z > BOOT_END-BOOT_APP)
+			z = BOOT_END-BOOT_APP;
+		for (i=0; i<z; i++)
+		{
+			x = x * 1103515245 + 12345;
+			img[BOOT_APP+i] = x >> 16;
+		}
+		n_bytes = z;
+	}
+	else if (optind != argc-1 || read_ihx(argv[optind]))
+	{
+		if (optind != argc-1)
+			fprintf(stderr, "upload: no image\n");
+		return optind != argc-1 ? 2 : 1;
+	}
+	if (img[BOOT_APP] == 0xFF)
+	{
+		fprintf(stderr, "upload: no reset vector at 0x%04X\n", BOOT_APP);
+		return 1;
+	}
+	make_blocks();
+	// at least the first block, which erases the reset vector
+	if (cut == 0)
+		cut = 1;
+	if (cut > (long)n_blk)
+		cut = n_blk;
+
+	if (s)
+		return simulate();
+	if (unit >= 0 && tty_restart(dev, unit))
+		return 1;
+	return tty_upload(dev);
+}
@@ -0,0 +1,155 @@
+//-----------------------------------------------------------------------------
+// weather.c
+// TENDONI V2
+// rev1 - RV110905
+// host weather generator for soak runs of the native build (soak.c)
+//-----------------------------------------------------------------------------
+// Same weather as sim.c (SIMWEATHER on the chip), with the resolution the
+//   detectors see instead of 1 s steps:
+//   - wind: Weibull (k=2) mean speed, renewed at random (mean wind_period),
+//     random gust bursts at gust_mul times the mean, turbulence on every
+//     sample; the speed is integrated into reed switch closures, so the
+//     pulse train keeps its fractional phase from sample to sample
+//   - rain: random events; wd falls towards wd_wet with time constant
+//     tau_wet while raining, rises back towards wd_dry with tau_dry
+//   - button: random presses of btn_len s
+// Events start at random (Poisson): the time to the next start is drawn
+//   from the exponential distribution when the previous event ends, so a
+//   sample only draws its turbulence. Each seed gives an independent,
+//   reproducible run (xorshift128+, splitmix64 seeding).
+
+#include <math.h>
+#include "weather.h"
+
+// as sim.h
+const struct wx_param wx_default =
+{
+	.wind_scale = 12, .wind_period = 600, .turb = 0.15,
+	.gust_rate = 1./300, .gust_min = 3, .gust_max = 10,
+	.gust_mul_min = 1.5, .gust_mul_max = 2.25,
+	.rain_rate = 1./7200, .rain_min = 600, .rain_max = 7200,
+	.wd_dry = 36000, .wd_wet = 8000, .tau_wet = 32, .tau_dry = 512,
+	.btn_rate = 1./65536, .btn_len = 0.5,
+};
+
+
+static uint64_t rnd(struct wx *w)
+{
+	uint64_t a = w->s[0], b = w->s[1];
+
+	w->s[0] = b;
+	a ^= a << 23;
+	w->s[1] = a ^ b ^ (a >> 17) ^ (b >> 26);
+	return w->s[1] + b;
+}
+
+
+// uniform in [0, 1)
+static double unif(struct wx *w)
+{
+	return (rnd(w) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+static double range(struct wx *w, double lo, double hi)
+{
+	return lo + (hi - lo) * unif(w);
+}
+
+
+// samples to the next start of an event with this rate
+static uint32_t wait(struct wx *w, double rate)
+{
+	double n = -log(1 - unif(w)) * WX_RATE / rate;
+
+	return n > 4e9 ? 4000000000u : (uint32_t)n + 1;
+}
+
+
+static uint64_t splitmix(uint64_t *x)
+{
+	uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+
+void wx_init(struct wx *w, const struct wx_param *p, uint64_t seed)
+{
+	w->s[0] = splitmix(&seed);
+	w->s[1] = splitmix(&seed);
+	w->p = *p;
+	w->k_wet = 1 - exp(-1 / (p->tau_wet * WX_RATE));
+	w->k_dry = 1 - exp(-1 / (p->tau_dry * WX_RATE));
+	w->mean = p->wind_scale * sqrt(-log(1 - unif(w)));
+	w->mul = 1;
+	w->phase = unif(w);
+	w->wd = p->wd_dry;
+	w->to_period = wait(w, 1 / p->wind_period);
+	w->to_gust = wait(w, p->gust_rate);
+	w->to_rain = wait(w, p->rain_rate);
+	w->to_btn = wait(w, p->btn_rate);
+	w->gust = w->rain = w->btn = 0;
+	w->n = 0;
+}
+
+
+void wx_run(struct wx *w, struct wx_sample *out, unsigned n)
+{
+	const struct wx_param *p = &w->p;
+	double v, turb = p->turb * 1.7320508;		// uniform with std dev turb, < 1
+
+	for (; n; n--, out++)
+	{
+		// wind: mean, gusts, turbulence
+		if (!--w->to_period)
+		{
+			w->mean = p->wind_scale * sqrt(-log(1 - unif(w)));
+			w->to_period = wait(w, 1 / p->wind_period);
+		}
+		if (w->gust)
+		{
+			if (!--w->gust)
+				w->to_gust = wait(w, p->gust_rate);
+		}
+		else if (!--w->to_gust)
+		{
+			w->gust = (uint32_t)(range(w, p->gust_min, p->gust_max) * WX_RATE) + 1;
+			w->mul = range(w, p->gust_mul_min, p->gust_mul_max);
+		}
+		v = w->mean * (w->gust ? w->mul : 1);
+		v *= 1 + turb * (2 * unif(w) - 1);
+		w->phase += v / WX_RATE;
+		out->pulses = (uint16_t)w->phase;
+		w->phase -= out->pulses;
+		out->speed = v * 16 > 65535 ? 65535 : (uint16_t)(v * 16);
+
+		// rain sensor
+		if (w->rain)
+		{
+			if (!--w->rain)
+				w->to_rain = wait(w, p->rain_rate);
+		}
+		else if (!--w->to_rain)
+			w->rain = (uint32_t)(range(w, p->rain_min, p->rain_max) * WX_RATE) + 1;
+		if (w->rain)
+			w->wd += (p->wd_wet - w->wd) * w->k_wet;
+		else
+			w->wd += (p->wd_dry - w->wd) * w->k_dry;
+		out->wd = (uint16_t)w->wd;
+
+		// button
+		if (w->btn)
+		{
+			if (!--w->btn)
+				w->to_btn = wait(w, p->btn_rate);
+		}
+		else if (!--w->to_btn)
+			w->btn = (uint32_t)(p->btn_len * WX_RATE) + 1;
+
+		out->flags = (w->btn ? WX_BTN : 0) | (w->gust ? WX_GUST : 0) | (w->rain ? WX_RAIN : 0);
+		w->n++;
+	}
+}
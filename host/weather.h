@@ -0,0 +1,75 @@
+// weather.h
+// TENDONI V2
+// rev1 - RV110905
+// host weather generator: reed switch pulse trains, rain sensor ratio and
+//   button presses, WX_RATE samples per second (see weather.c)
+
+#ifndef _WEATHER_H_
+#define _WEATHER_H_
+
+#include <stdint.h>
+
+//-----------------------------------------------------------------------------
+// Global CONSTANTS
+//-----------------------------------------------------------------------------
+
+#define WX_RATE 40			// samples per second, one per Timer2 tick
+
+// wx_sample.flags
+#define WX_BTN 0x01			// down button pressed (DI_DOWN = 0)
+#define WX_GUST 0x02		// gust burst in progress
+#define WX_RAIN 0x04		// raining
+
+//-----------------------------------------------------------------------------
+// Types
+//-----------------------------------------------------------------------------
+
+// rates are per second, times in seconds
+struct wx_param
+{
+	double wind_scale;		// Weibull (k=2) scale of the mean wind, pulses/s
+	double wind_period;		// mean time between changes of the mean wind
+	double turb;			// turbulence: relative std dev of the speed per sample
+	double gust_rate;		// gust bursts
+	double gust_min, gust_max;		// burst length
+	double gust_mul_min, gust_mul_max;	// burst speed over the mean
+	double rain_rate;		// rain events
+	double rain_min, rain_max;		// event length
+	double wd_dry, wd_wet;	// wd of the dry and of the wet sensor
+	double tau_wet, tau_dry;	// time constants of wetting and drying
+	double btn_rate;		// button presses
+	double btn_len;			// press length
+};
+
+struct wx_sample
+{
+	uint16_t pulses;		// reed switch closures in this sample
+	uint16_t wd;			// rain sensor ratio wd_a/wd_b*65536
+	uint16_t speed;			// wind speed in pulses/s, Q4
+	uint8_t flags;			// WX_BTN, WX_GUST, WX_RAIN
+};
+
+struct wx
+{
+	uint64_t s[2];			// xorshift128+
+	struct wx_param p;
+	// per sample constants
+	double k_wet, k_dry;
+	// state, in samples: samples to the next start of each event, then
+	//   length of the gust, rain and press in progress
+	double mean, mul, phase, wd;
+	uint32_t to_period, to_gust, to_rain, to_btn;
+	uint32_t gust, rain, btn;
+	uint64_t n;				// samples generated
+};
+
+extern const struct wx_param wx_default;
+
+//-----------------------------------------------------------------------------
+// Global FUNCTIONS
+//-----------------------------------------------------------------------------
+
+void wx_init(struct wx *w, const struct wx_param *p, uint64_t seed);
+void wx_run(struct wx *w, struct wx_sample *out, unsigned n);	// next n samples
+
+#endif // _WEATHER_H_
@@ -11,6 +11,10 @@
 #include "C8051F350.H"				// SFR declarations
 #include "main.h"
 #include "F35x_ADC0.h"
+#include "F35x_UART0.h"
+#include "timers.h"
+#include "lat.h"
+#include "hist.h"
 
 
 //-----------------------------------------------------------------------------
@@ -26,7 +30,17 @@ void Timer2_Init(int counts);
 //-----------------------------------------------------------------------------
 volatile unsigned char seconds_cnt=0;
 volatile unsigned short tm0_cnt=0;
+volatile unsigned long tm0_total=0;
 volatile unsigned char WDcnt = 10;
+#ifdef T2_JITTER_STATS
+volatile unsigned short t2_lat_max = 0;
+#endif
+#ifdef SIMWEATHER
+volatile unsigned char wd_margin_min = SOFT_WD_COUNTS;
+#endif
+#ifdef CLKSCALE
+__bit bClkSlow = 0;				// running at SYSCLK/2
+#endif
 
 
 // we need to stop watchdog during sdcc init code, because clock is slow and
@@ -44,18 +58,24 @@ unsigned char _sdcc_external_startup()
 void init(void)
 {
 	// enable VDD monitor and missing clock detector as reset sources
+	// the VDD monitor needs 100us to stabilize: do the other initializations
+	//   meanwhile, at full clock speed, and start A/D calibration as soon as
+	//   possible, it will complete in background (see ADC0_Poll)
     int i=0;
     VDM0CN = 0x80;
-    for (i=0; i<350; i++);  // Wait 100us for initialization
-    RSTSRC = 0x06;
 
 	PORT_Init();						// Initialize crossbar and GPIO
 	SYSCLK_Init();						// Initialize system clock
 
-	Timer2_Init(SYSCLK / 12 / 40);		// Init Timer2 to generate
+	ADC0_Init();						// Initialize 24 bit A/D
+
+	Timer2_Init(T2_COUNTS);				// Init Timer2 to generate
 										//   interrupts at a 40Hz rate.
 
-	ADC0_Init();						// Initialize 24 bit A/D
+	UART0_Init();						// Initialize serial link to other unit
+
+    for (i=0; i<350; i++);  // complete 100us wait (~170us at 24.5 MHz)
+    RSTSRC = 0x06;
 
 	// enable and lock WD timer at 32 ms (max with our clock)
     PCA0MD    &= ~0x40;
@@ -68,17 +88,10 @@ void init(void)
 
 	EA = 1;								// enable global interrupts
 
-/*
-	FLASH_Init();						// initialize FLASH memory I/O
-
-	// load parameters from FLASH
-	// if valid, initialize global vars
-	// otherwise, use default initial values for variables
-	if (flash.magic_code == 0x5432)
-	{
-		FLASH_BufRead(FLASH_STORE+2, (unsigned char *)&ramparam, sizeof(ramparam));
-	}
-*/
+#ifdef HISTSTATS
+	// restore histograms from the flash checkpoint
+	hist_init();
+#endif
 }
 
 
@@ -96,6 +109,9 @@ void PORT_Init (void)
 	//P0MDOUT = 0x00;
 	//P0 = 0xFF;
 
+	// UART0 TX (P0.4) as push-pull output
+	P0MDOUT = 0x10;
+
 	// enable digital outputs P1.0-P1.4 and DAC IDA0 (on P1.6)
 	P1MDIN = 0xBF;		// not sure this is necessary for IDA0
 	P1SKIP = 0x40;		// required for IDA0, not mapped on XBAR
@@ -103,13 +119,13 @@ void PORT_Init (void)
 	P1 = 0x0A;			// all off (TRIAC_OFF and LEDR have reverse logic)
 
 	// crossbar Initialization
-	XBR0    = 0x00;
+	XBR0    = 0x01;		// enable UART0 on P0.4 (TX), P0.5 (RX)
 	XBR1    = 0x50;		// enable T0 on P0.0, crossbar and weak pull-ups
 
 	// enable TIMER0 as 16 bit counter with clock from P0.0
 	// timer
 	TMOD = 0x05;		// counter mode 1, GATE0=0
-	TCON = 010;			// enable counter/timer TR0=1
+	TR0 = 1;			// enable counter/timer, never stopped
 }
 
 
@@ -119,13 +135,80 @@ void PORT_Init (void)
 //
 // This routine initializes the system clock to use the internal
 // oscillator as its clock source. Divide by 1, multiply off to get 24.5 MHz
-// Also enables missing clock detector reset.
 //
 void SYSCLK_Init (void)
 {
     OSCICN = 0x83;
-	RSTSRC = 0x04;				// enable missing clock detector
+	// missing clock detector is enabled with VDD monitor in init()
+}
+
+
+#ifdef CLKSCALE
+//-----------------------------------------------------------------------------
+// clk_set
+//-----------------------------------------------------------------------------
+//
+// Switch between SYSCLK and SYSCLK/2. Everything clocked from SYSCLK is
+// rescaled at the same time, with interrupts disabled:
+//   Timer2 (40 Hz timebase): reload halved, and the counts left in the
+//     current tick too, so the tick keeps its length (a few counts are
+//     lost while Timer2 is stopped, ~3 ppm at 2 switches/s)
+//   ADC0CLK: MDCLK stays 2.45 MHz (SYSCLK/10 or SYSCLK/2/5), so the
+//     decimation, the output word rate and the filters don't change.
+//     Only /2 allows this: SYSCLK/4 or /8 would need MDCLK 3.06 or 1.53 MHz.
+//     SYSCLK and ADC0CLK change only between conversions: a conversion in
+//     progress is aborted (AD0EN=0) and started again on the same slot
+//     (ADC0MUX and IDA0 unchanged); a completed one is left to ADC0_ISR,
+//     which starts the next at the new clock. Not switched before
+//     conversions start (calibration)
+//   Timer1 (UART0 baud rate): reload for the new clock, with a prescaler
+//     that keeps the same rate at both clocks (UART_TH1, 0.3% error). Not
+//     switched while sending; a byte being received during the switch can
+//     be corrupted, and its frame is dropped
+//   PCA watchdog: clocked by SYSCLK/12, its 32 ms period becomes 64 ms at
+//     SYSCLK/2, Timer2 still reloads it every 25 ms
+// The internal oscillator divider switches without glitches.
+//
+void clk_set(__bit bSlow)
+{
+	unsigned short left;
+	__bit bRestart;
+
+	if (bSlow == bClkSlow || UART0_Busy() || (!bADRunning && !bADOff))
+		return;
+
+	EA = 0;
+	bRestart = 0;
+	if (bADRunning && !AD0INT)
+	{
+		ADC0MD = 0x00;					// abort conversion, AD0EN=0
+		bRestart = 1;
+	}
+	TR2 = 0;
+	left = -TMR2;						// counts to next tick
+	if (bSlow)
+	{
+		OSCICN = 0x82;					// SYSCLK/2
+		ADC0CLK = (SYSCLK/2/MDCLK)-1;
+		TMR2RL = -(T2_COUNTS/2);
+		TMR2 = -(left/2);
+		TH1 = UART_TH1(SYSCLK/2);
+	}
+	else
+	{
+		OSCICN = 0x83;					// SYSCLK
+		ADC0CLK = (SYSCLK/MDCLK)-1;
+		TMR2RL = -T2_COUNTS;
+		TMR2 = -(left*2);
+		TH1 = UART_TH1(SYSCLK);
+	}
+	TR2 = 1;
+	if (bRestart)
+		ADC0MD = 0x82;					// same slot again (single conversion mode)
+	bClkSlow = bSlow;
+	EA = 1;
 }
+#endif
 
 
 //-----------------------------------------------------------------------------
@@ -143,6 +226,12 @@ void Timer2_Init (int counts)
 
    TMR2RL  = -counts;                     // Init reload values
    TMR2    = 0xffff;                      // set to reload immediately
+#ifdef TIMER2_HIPRI
+   // high priority, so timebase and watchdog reload are not delayed by
+   //   ADC0_ISR (32 bit filter math) or UART0_ISR; each IRQ has its own
+   //   register bank and they share no data, so nesting is safe
+   PT2     = 1;
+#endif
    ET2     = 1;                           // enable Timer2 interrupts
    TR2     = 1;                           // start Timer2
 }
@@ -161,23 +250,64 @@ void Timer2_ISR(void) __interrupt 5 __using 1
 {
 	static unsigned char cnt = 0;
 	static unsigned short tm0_cnt_old = 0;
+	static unsigned long tm0_acc = 0;
+	unsigned char tm0_h, tm0_l;
+	unsigned short tm0;
 	static __bit bLEDG = 0;
 
+#ifdef T2_JITTER_STATS
+	{
+		// Timer2 counts up from reload value: the count now is the time since
+		//   overflow, i.e. IRQ entry latency (plus our fixed prologue)
+		unsigned char h, l;
+		unsigned short lat;
+
+		do
+		{
+			h = TMR2H;
+			l = TMR2L;
+		} while (h != TMR2H);
+		lat = ((h << 8) | l) - TMR2RL;
+		if (lat > t2_lat_max)
+			t2_lat_max = lat;
+	}
+#endif
+
 	TF2H = 0;		// clear Timer2 interrupt flag
 
 	// visual indication of status
 	//  up, not auto: LEDG off
 	//  down, not auto: LEDG flashes 1s on / 1s off
 	//  down, auto: LEDG flashes 0.1s on / 1.9s off
-	//  up, auto-down, alarm off (waiting 4 hours): 0.1s on / 0.2s off / 0.1s on / 1.6s off
+	//  up, auto-down, alarm off (waiting the hold time): 0.1s on / 0.2s off / 0.1s on / 1.6s off
 	//  up, auto-down, but alarm still on: continuous fast flash
 	// plus, momentary pulse to signal operation of wind sensor
 
 	// increment 40 Hz counter
 	cnt++;
 
+#ifdef LATSTATS
+	// latency statistics: timebase and time of button press
+	{
+		static __bit bLatDown = 0;
+
+		lat_tick++;
+		if (!DI_DOWN && !bLatDown && !bLatBtn)
+		{
+			lat_btn_tick = lat_tick;
+			bLatBtn = 1;
+		}
+		bLatDown = !DI_DOWN;
+	}
+#endif
+
 	// reset watchdog (watchdog timer = 32 ms, we run at 25 ms), unless we have problems
 	//   in main() routine
+#ifdef SIMWEATHER
+	// soak test: keep the worst watchdog margin
+	if (WDcnt < wd_margin_min)
+		wd_margin_min = WDcnt;
+#endif
 	if (WDcnt)
 	{
 		// any write is ok
@@ -201,14 +331,14 @@ void Timer2_ISR(void) __interrupt 5 __using 1
 			break;
 
 		case 3:
-			bLEDG = (!bAutoDown && bDown) || (bAutoDown && !bDown && auto_down_timer<FOUR_HOURS);
+			bLEDG = (!bAutoDown && bDown) || (bAutoDown && !bDown && !bHoldFull);
 			break;
 
 		case 2:
 		case 4:
 		case 6:
 		case 8:
-			bLEDG = (!bAutoDown && bDown) || (bAutoDown && !bDown && auto_down_timer==FOUR_HOURS);
+			bLEDG = (!bAutoDown && bDown) || (bAutoDown && !bDown && bHoldFull);
 			break;
 
 		//case 10:	// handled by its own
@@ -216,7 +346,7 @@ void Timer2_ISR(void) __interrupt 5 __using 1
 		case 14:
 		case 16:
 		case 18:
-			bLEDG = bAutoDown && !bDown && auto_down_timer==FOUR_HOURS;
+			bLEDG = bAutoDown && !bDown && bHoldFull;
 			break;
 
 		case 11:
@@ -239,13 +369,15 @@ void Timer2_ISR(void) __interrupt 5 __using 1
 			// 1s actions
 			// update external TIMER0 counter every 1s
 			tm0_cnt = tm0_cnt_old;
+			tm0_total = tm0_acc;
 
-			// increment seconds counter
+			// increment seconds counters
 			seconds_cnt++;
+			uptime++;
 
 			// for LED, handle only the case cnt==40 (also 80 is arriving here)
 			if (cnt == 40)
-				bLEDG = bAutoDown && !bDown && auto_down_timer==FOUR_HOURS;
+				bLEDG = bAutoDown && !bDown && bHoldFull;
 			break;
 		}
 	}
@@ -253,19 +385,25 @@ void Timer2_ISR(void) __interrupt 5 __using 1
 	// set LEDG
 	LEDG = bLEDG;
 
-	// acquire TIMER0 count (not sure if we need to disable/reenable timer when using
-	//   16 bits readout: can't understand from documentation)
-	// disable
-	TCON = 0;
+	// acquire TIMER0 count while running: stopping it could lose pulses (and
+	//   writing TCON would also stop Timer1, the UART0 baud rate)
+	// read the high byte again, and retry if the low byte overflowed meanwhile
+	do
+	{
+		tm0_h = TH0;
+		tm0_l = TL0;
+	} while (tm0_h != TH0);
+	tm0 = (tm0_h << 8) | tm0_l;
 	// if timer changed, signal with irregular pulses of green LED
-	if (TMR0 != tm0_cnt_old)
+	if (tm0 != tm0_cnt_old)
 	{
 		// reverse green LED (visible externally) if tent is down
 		// will be restored from bLEDG on next cycle
 		if (bDown)
 			LEDG = !LEDG;
-		tm0_cnt_old = TMR0;
+		// extend to 32 bits: pulses in 25 ms never wrap the 16 bit counter
+		// (long add/sub are inline, no library calls)
+		tm0_acc += (unsigned short)(tm0 - tm0_cnt_old);
+		tm0_cnt_old = tm0;
 	}
-	// reenable timer
-	TCON = 0x10;
 }
@@ -0,0 +1,39 @@
+// kernels.h
+// TENDONI V2
+// rev1 - RV110805
+// fixed point arithmetic of the detectors
+
+#ifndef _KERNELS_H_
+#define _KERNELS_H_
+
+// The only definitions of the arithmetic used on the sensor readings (plain
+//   C, no SFR access). host/kverify.c checks them against the original
+//   expressions over the whole input domains: all (y, x) for each filter,
+//   all (wd_a, wd_b) for the ratio, all pots; run it after any change.
+// Results must stay bit exact, since thresholds are tuned on them.
+
+// 1st order low-pass filter in Q15: y = (y*a + x*(32768-a)) >> 15
+//   y, x: unsigned short; a, b=32768-a: long constants (AD_FW_A/B, AD_FP_A/B)
+//   y*a + x*b < 65536*32768 = 2^31, so signed long math never overflows
+#define K_FILT(y, x, a, b) \
+	((unsigned short)(((y)*(a) + (x)*(b)) >> 15))
+
+// water ratio wd_a*65536L/wd_b, 65535 if wd_b is 0
+// wd_a < wd_b gives wd < 65536, otherwise the result is truncated to 16 bits
+// the original product is a signed long: for wd_a >= 32768 it wraps to
+//   -(65536-wd_a)*65536, and the quotient truncates toward 0, so the ratio
+//   of 65536-wd_a is negated (kept, found by host/kverify.c)
+#define K_WD_RATIO(wd_a, wd_b) \
+	((wd_b) == 0 ? 65535 : \
+	 ((wd_a) & 0x8000) ? (unsigned short)(0-(((unsigned long)(65536L-(wd_a)) << 16)/(wd_b))) : \
+	 (unsigned short)(((unsigned long)(wd_a) << 16)/(wd_b)))
+
+// wind threshold in ticks per second from pot 2: 8-39 (full CW: max sensitivity)
+#define K_DC_TH(pot) \
+	(39-(unsigned char)((pot) >> 11))
+
+// water setpoint from pot 3: 8192-40959
+#define K_WD_TH(pot) \
+	(((pot) >> 1)+8192)
+
+#endif // _KERNELS_H_
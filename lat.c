@@ -0,0 +1,119 @@
+//-----------------------------------------------------------------------------
+// lat.c
+// TENDONI V2
+// rev1 - RV110725
+// detection latency statistics, compiled only with LATSTATS
+//-----------------------------------------------------------------------------
+// Each latency runs from an event seen by the controller (first pre-alarm,
+//   button press) to the output edge it causes (TRIAC on, manual mode), in
+//   25 ms ticks. For each one we keep count, min, max and log2 bins, read
+//   with CMD_T_LATSTATS, so percentiles can be estimated on the host.
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include "C8051F350.h"		// SFR declarations
+#include "main.h"
+#include "link.h"
+#include "cmd.h"
+#include "lat.h"
+
+#ifdef LATSTATS
+
+//-----------------------------------------------------------------------------
+// Function PROTOTYPES
+//-----------------------------------------------------------------------------
+unsigned short lat_now(void);
+
+//-----------------------------------------------------------------------------
+// Global VARIABLES
+//-----------------------------------------------------------------------------
+volatile unsigned short lat_tick = 0;
+volatile unsigned short lat_btn_tick;
+volatile __bit bLatBtn = 0;
+
+__xdata unsigned short lat_t0[N_LAT];	// start tick of running measures
+unsigned char lat_running = 0;			// bit id: measure running
+__xdata unsigned short lat_count[N_LAT], lat_min[N_LAT], lat_max[N_LAT];
+__xdata unsigned char lat_bin[N_LAT][LAT_BINS];
+
+
+// lat_tick is written by Timer2_ISR: read it twice to avoid a torn value
+unsigned short lat_now(void)
+{
+	unsigned short t;
+
+	do
+	{
+		t = lat_tick;
+	} while (t != lat_tick);
+	return t;
+}
+
+
+void lat_start(unsigned char id)
+{
+	lat_start_at(id, lat_now());
+}
+
+
+void lat_start_at(unsigned char id, unsigned short tick)
+{
+	if (lat_running & (1 << id))
+		return;
+	lat_t0[id] = tick;
+	lat_running |= 1 << id;
+}
+
+
+void lat_cancel(unsigned char id)
+{
+	lat_running &= ~(1 << id);
+}
+
+
+void lat_stop(unsigned char id)
+{
+	unsigned short d, b;
+	unsigned char k;
+
+	if (!(lat_running & (1 << id)))
+		return;
+	lat_running &= ~(1 << id);
+
+	d = lat_now() - lat_t0[id];
+	if (lat_count[id] == 0 || d < lat_min[id])
+		lat_min[id] = d;
+	if (d > lat_max[id])
+		lat_max[id] = d;
+	if (lat_count[id] < 65535)
+		lat_count[id]++;
+
+	// log2 bin
+	for (k=0, b=d >> 4; b && k < LAT_BINS-1; k++)
+		b >>= 1;
+	if (lat_bin[id][k] < 255)
+		lat_bin[id][k]++;
+}
+
+
+void lat_stats(unsigned char id)
+{
+	unsigned char buf[7+LAT_BINS], k;
+
+	if (id >= N_LAT)
+		return;
+
+	buf[0] = id;
+	buf[1] = (unsigned char)lat_count[id];
+	buf[2] = (unsigned char)(lat_count[id] >> 8);
+	buf[3] = (unsigned char)lat_min[id];
+	buf[4] = (unsigned char)(lat_min[id] >> 8);
+	buf[5] = (unsigned char)lat_max[id];
+	buf[6] = (unsigned char)(lat_max[id] >> 8);
+	for (k=0; k<LAT_BINS; k++)
+		buf[7+k] = lat_bin[id][k];
+	link_send(CMD_REPLY | CMD_T_LATSTATS, buf, 7+LAT_BINS);
+}
+
+#endif // LATSTATS
@@ -0,0 +1,42 @@
+// lat.h
+// TENDONI V2
+// rev1 - RV110725
+// detection latency statistics (LATSTATS only)
+
+#ifndef _LAT_H_
+#define _LAT_H_
+
+//-----------------------------------------------------------------------------
+// Global CONSTANTS
+//-----------------------------------------------------------------------------
+
+// measured latencies, in 25 ms Timer2 ticks
+#define LAT_WATER 0			// first water pre-alarm -> TRIAC on, moving up
+#define LAT_WIND 1			// first wind pre-alarm of a gust window -> TRIAC on, moving up
+#define LAT_BUTTON 2		// DI_DOWN pressed (sampled by Timer2) -> manual mode
+#define N_LAT 3
+
+#define LAT_BINS 9			// bin k: [2^(k+3), 2^(k+4)) ticks, first and last open
+
+// request: id -> reply: id, count, min, max (lo, hi), bins[LAT_BINS] (saturated)
+#define CMD_T_LATSTATS 'L'
+
+//-----------------------------------------------------------------------------
+// Global FUNCTIONS
+//-----------------------------------------------------------------------------
+
+void lat_start(unsigned char id);		// event seen, ignored if already running
+void lat_start_at(unsigned char id, unsigned short tick);
+void lat_cancel(unsigned char id);		// event gone without reaction
+void lat_stop(unsigned char id);		// reaction: record latency if running
+void lat_stats(unsigned char id);		// send CMD_T_LATSTATS reply
+
+//-----------------------------------------------------------------------------
+// Global VARIABLES
+//-----------------------------------------------------------------------------
+
+extern volatile unsigned short lat_tick;	// 40 Hz, incremented by Timer2_ISR
+extern volatile unsigned short lat_btn_tick;	// Timer2 tick of DI_DOWN press
+extern volatile __bit bLatBtn;				// lat_btn_tick is valid, cleared by main
+
+#endif // _LAT_H_
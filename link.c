@@ -0,0 +1,198 @@
+//-----------------------------------------------------------------------------
+// link.c
+// TENDONI V2
+// rev1 - RV110615
+// serial link framing and weather sharing between units
+//-----------------------------------------------------------------------------
+// Every second each unit broadcasts its pre-alarms and alarm (alarm is kept
+//   for LINK_ALM_HOLD s, so the peer can confirm it). A peer alarm seen in
+//   LINK_ALM_CONFIRM consecutive frames is treated as a local alarm. The
+//   broadcast is also the heartbeat: after LINK_TIMEOUT s of silence the
+//   peer state is cleared.
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include "C8051F350.h"		// SFR declarations
+#include "main.h"
+#include "F35x_UART0.h"
+#include "link.h"
+#include "cmd.h"
+
+//-----------------------------------------------------------------------------
+// Function PROTOTYPES
+//-----------------------------------------------------------------------------
+void link_frame(unsigned char type, unsigned char *payload, unsigned char len);
+void link_weather(unsigned char *payload, unsigned char len);
+void link_tx(unsigned char flags);
+
+//-----------------------------------------------------------------------------
+// Global VARIABLES
+//-----------------------------------------------------------------------------
+
+// RX parser: position in frame, 0 means waiting for SOF
+__xdata unsigned char rx_frame[LINK_MAX_PAYLOAD+3];
+unsigned char rx_pos=0, rx_sum;
+
+// local state
+__xdata unsigned char tx_seq=0, alm_hold=0, tx_second;
+
+// peer state
+__xdata unsigned char peer_age=LINK_TIMEOUT, peer_seq, peer_alm_cnt=0;
+
+
+// parse received bytes, at most LINK_POLL_MAX for each call, so we never
+//   delay the 1s loop or the watchdog reload
+void link_poll(void)
+{
+	unsigned char n;
+	int c;
+
+	for (n=0; n<LINK_POLL_MAX; n++)
+	{
+		c = UART0_GetChar();
+		if (c < 0)
+			break;
+
+		if (rx_pos == 0)
+		{
+			// wait for start of frame
+			if (c == LINK_SOF)
+			{
+				rx_pos = 1;
+				rx_sum = 0;
+			}
+			continue;
+		}
+
+		// store type, len, payload and checksum
+		rx_frame[rx_pos-1] = (unsigned char)c;
+		rx_sum += (unsigned char)c;
+		rx_pos++;
+
+		// drop frames with bad length, resync on next SOF
+		if (rx_pos == 3 && rx_frame[1] > LINK_MAX_PAYLOAD)
+			rx_pos = 0;
+		// complete frame: type, len, payload, chk
+		else if (rx_pos > 3 && rx_pos == rx_frame[1]+4)
+		{
+			if (rx_sum == 0)
+				link_frame(rx_frame[0], &rx_frame[2], rx_frame[1]);
+			rx_pos = 0;
+		}
+	}
+}
+
+
+// send a frame, dropped if TX buffer is full (next one will follow anyway)
+// return -1 if dropped
+char link_send(unsigned char type, unsigned char *payload, unsigned char len)
+{
+	__xdata unsigned char frame[LINK_MAX_PAYLOAD+4];
+	unsigned char i, sum;
+
+	frame[0] = LINK_SOF;
+	frame[1] = type;
+	frame[2] = len;
+	sum = type+len;
+	for (i=0; i<len; i++)
+	{
+		frame[3+i] = payload[i];
+		sum += payload[i];
+	}
+	frame[3+len] = -sum;
+
+	return UART0_Write(frame, len+4);
+}
+
+
+// called once per second: broadcast our status
+void link_second(__bit wind_pre, __bit water_pre, __bit alarm)
+{
+	// keep alarm flag for some seconds after a local alarm
+	if (alarm)
+		alm_hold = LINK_ALM_HOLD+1;
+
+	link_tx((wind_pre ? LINK_F_WIND_PRE:0) | (water_pre ? LINK_F_WATER_PRE:0));
+}
+
+
+// called while main loop is blocked (moving tents): keep parsing and keep
+//   broadcasting, so the peer can confirm our alarm and doesn't lose us
+void link_keepalive(void)
+{
+	link_poll();
+	if (seconds_cnt != tx_second)
+		link_tx(0);
+}
+
+
+// age peer data and send weather frame, once per second
+void link_tx(unsigned char flags)
+{
+	unsigned char payload[3];
+
+	tx_second = seconds_cnt;
+
+	// heartbeat timeout: forget about a silent peer
+	if (peer_age < LINK_TIMEOUT)
+		peer_age++;
+	else
+		peer_alm_cnt = 0;
+
+	if (alm_hold)
+	{
+		alm_hold--;
+		if (alm_hold)
+			flags |= LINK_F_ALARM;
+	}
+
+	payload[0] = LINK_UNIT_ID;
+	payload[1] = flags;
+	payload[2] = tx_seq++;
+	link_send(LINK_T_WEATHER, payload, 3);
+}
+
+
+// =1 while peer is alive and its alarm has been confirmed
+__bit link_peer_alarm(void)
+{
+	return peer_age < LINK_TIMEOUT && peer_alm_cnt >= LINK_ALM_CONFIRM;
+}
+
+
+// dispatch a valid frame
+void link_frame(unsigned char type, unsigned char *payload, unsigned char len)
+{
+	switch (type)
+	{
+	case LINK_T_WEATHER:
+		link_weather(payload, len);
+		break;
+
+	default:
+		cmd_frame(type, payload, len);
+		break;
+	}
+}
+
+
+// weather broadcast from a peer
+void link_weather(unsigned char *payload, unsigned char len)
+{
+	// ignore malformed frames and our own echo
+	if (len != 3 || payload[0] == LINK_UNIT_ID)
+		return;
+
+	// count consecutive frames with alarm, restart on a lost frame
+	if ((payload[1] & LINK_F_ALARM) && (peer_alm_cnt == 0 || payload[2] == (unsigned char)(peer_seq+1)))
+	{
+		if (peer_alm_cnt < 255)
+			peer_alm_cnt++;
+	}
+	else
+		peer_alm_cnt = (payload[1] & LINK_F_ALARM) ? 1:0;
+
+	peer_seq = payload[2];
+	peer_age = 0;
+}
@@ -0,0 +1,42 @@
+// link.h
+// TENDONI V2
+// rev1 - RV110615
+// serial link between units (SOGGIORNO <-> MANSARDA)
+
+#ifndef _LINK_H_
+#define _LINK_H_
+
+//-----------------------------------------------------------------------------
+// Global CONSTANTS
+//-----------------------------------------------------------------------------
+
+// frame: SOF, type, len, payload[len], chk (sum of type..chk == 0)
+#define LINK_SOF 0xA5
+#define LINK_MAX_PAYLOAD 16
+#define LINK_POLL_MAX 8		// max RX bytes parsed on each main loop wakeup
+
+// frame types (commands are in cmd.h)
+#define LINK_T_WEATHER 'W'	// periodic weather broadcast: unit id, flags, seq
+#define LINK_T_JITTER 'J'	// Timer2 latency stats (T2_JITTER_STATS): max lo, max hi
+#define LINK_T_STATE 'Q'	// 1s state dump (STATEDUMP), see state_dump() in main.c
+
+// weather flags
+#define LINK_F_WIND_PRE 0x01
+#define LINK_F_WATER_PRE 0x02
+#define LINK_F_ALARM 0x04
+
+#define LINK_ALM_HOLD 5		// seconds we keep signalling our alarm to the peer
+#define LINK_ALM_CONFIRM 2	// consecutive peer frames with alarm before we act
+#define LINK_TIMEOUT 5		// seconds without valid frames before peer is lost
+
+//-----------------------------------------------------------------------------
+// Global FUNCTIONS
+//-----------------------------------------------------------------------------
+
+void link_poll(void);		// parse received bytes, bounded
+char link_send(unsigned char type, unsigned char *payload, unsigned char len);
+void link_second(__bit wind_pre, __bit water_pre, __bit alarm);	// 1s broadcast
+void link_keepalive(void);	// poll and broadcast while main loop is blocked
+__bit link_peer_alarm(void);	// =1 while a confirmed peer alarm is active
+
+#endif // _LINK_H_
@@ -12,38 +12,62 @@
 #include <stdio.h>
 #include "main.h"
 #include "F35x_ADC0.h"
+#include "F35x_UART0.h"
+#include "link.h"
+#include "trace.h"
+#include "cmd.h"
+#include "sim.h"
+#include "timers.h"
+#include "lat.h"
+#include "hist.h"
+#include "detect.h"
+#include "hold.h"
 
 //-----------------------------------------------------------------------------
 // IRQ declarations must stay in module containing main()
 //-----------------------------------------------------------------------------
 void Timer2_ISR(void) __interrupt 5 __using 1;
 void ADC0_ISR (void) __interrupt 10 __using 2;
+void UART0_ISR (void) __interrupt 4 __using 3;
 
 //-----------------------------------------------------------------------------
 // Global VARIABLES
 //-----------------------------------------------------------------------------
 volatile __bit bDown = 1;		// goes to zero after an alarm
 volatile __bit bAutoDown = 1;	// goes to zero after pressing of buttons
-unsigned short ad[4];			// A/D readings
-unsigned short prev_seconds=0xFFFF;
-unsigned short prev_counter=0;
-unsigned short water_threshold=0, wd_th_prev1=0, wd_th_prev2=0, water_min=65535;
-unsigned char water_cnt=0, wind_timer[WIND_GUST_EVENTS-1] = { 0, 0, 0, 0 };
-volatile unsigned short auto_down_timer = 0;
-
-// flash persistent data with defaults
-// defaults force allocation, so the linker respects the area (512 byte flash page)
-//__code __at(FLASH_STORE) struct FLASHDATA flash = { 0x5432, { 0, 1.5e-3, 0 } };
-
-// avoid overwriting security lock byte
-//__code __at(0x1DFF) unsigned char lock_byte = 0xFF;
+__bit bButtonDown;
+__bit bMoving = 0;				// move_updown() running, relays energized
+#ifdef SLEEPMODE
+__bit bSleep = 0;				// acquisition suspended
+__bit bSleepWait = 0;			// TMR_SLEEP armed, suspend on expiry
+#endif
+unsigned char prev_seconds=0xFF;		// seconds_cnt at last 1s loop
+// 1s loop state: detector inputs and settings in IDATA, wind reading totals in XDATA
+__idata unsigned short ad[N_ADCHANNELS];	// A/D readings, coherent snapshot taken every 1s
+__xdata unsigned long prev_uptime=0, prev_total=0;	// uptime and tm0_total at last wind reading
+__idata unsigned short wind_ticks;
+__idata unsigned char wind_gust_time=WIND_GUST_TIME, wind_gust_events=WIND_GUST_EVENTS;
+__idata unsigned char water_alm_time=WATER_ALM_TIME;
+#ifdef RACECHECK
+__xdata unsigned short race_tm0_retry=0;
+#endif
+__idata unsigned short auto_down_timer = 0;
+// auto_down_timer as seen by Timer2_ISR (LEDG): the hold length changes with
+//   the cause, so main publishes the comparison as a bit (atomic)
+volatile __bit bHoldFull = 0;
 
 //-----------------------------------------------------------------------------
 // Function PROTOTYPES
 //-----------------------------------------------------------------------------
 void main(void);
 char move_updown(char bUp);
+__bit wait_seconds(unsigned char secs, __bit bCheckBtn);
 void alarm_reset();
+void set_auto_down_timer(unsigned short t);
+void wind_read(unsigned long *now, unsigned long *total);
+void sleep_poll(void);
+void state_dump(void);
+void arm_auto_down(unsigned char cause);
 
 
 //-----------------------------------------------------------------------------
@@ -51,18 +75,18 @@ void alarm_reset();
 //-----------------------------------------------------------------------------
 void main(void)
 {
-	__bit alarm, bButtonDown;
+	__bit alarm;
 
 	// various initializations
 	init();
+	det_init();
 
 	while (1)
 	{
 /*		// test
 		unsigned char i;
 		static unsigned short cnt = 0;
-		for (i=0; i<N_ADCHANNELS; i++)
-			ad[i] = getAD(i);
+		getADSnapshot(ad);
 
 		if (cnt++ == 10000)
 		{
@@ -84,13 +108,38 @@ void main(void)
 		// reset alarm condition
 		alarm = 0;
 
+		// start A/D conversions when calibration is complete, filter new samples
+		ADC0_Poll();
+		ADC0_Process();
+
+		// handle frames from the other unit
+		link_poll();
+#ifdef TRACEMODE
+		trace_poll();
+#endif
+
+		// handle expired timeouts
+		tmr_poll();
+
 		// check if tent is manually actuated
 		// check here, faster rate than 1s
+#ifdef SIMWEATHER
+		if (!DI_DOWN || sim_button())
+#else
 		if (!DI_DOWN)
+#endif
 		{
 			// manually commanded, assume down and exit automatic mode
 			bAutoDown = 0;
 			bDown = 1;
+#ifdef LATSTATS
+			if (bLatBtn)
+			{
+				lat_start_at(LAT_BUTTON, lat_btn_tick);
+				lat_stop(LAT_BUTTON);
+				bLatBtn = 0;
+			}
+#endif
 			// clear events memory for alarm detection
 			alarm_reset();
 			// set flag for water alarm relax
@@ -99,182 +148,112 @@ void main(void)
 		else
 			bButtonDown = 0;
 
+#ifdef SLEEPMODE
+		// suspend or resume acquisition, after the button check so a press
+		//   resumes in the same wakeup
+		sleep_poll();
+#endif
+
 		// check if 1s has passed, in that case read A/D and counter
-		if (seconds_cnt != prev_seconds)
+		// after power on and after ADC0_On (SLEEPMODE, ADC_DUTY bursts), wait
+		//   for a fresh snapshot (filters seeded): until then just track time
+		//   and counter
+		// while powered down the last snapshot is used: on purpose between
+		//   ADC_DUTY bursts, while suspended (bSleep) nothing is detected
+		if (seconds_cnt != prev_seconds && !bADValid && !bADOff)
 		{
-			__bit wind_pre, water_pre;	// pre-alarms
-			
-			// reset pre-alarms
-			wind_pre = 0;
-			water_pre = 0;
-
-			// check WIND
+			prev_seconds = seconds_cnt;
+			wind_read(&prev_uptime, &prev_total);
+#ifdef SIMNOAD
+			// no A/D to wait for: 1s loops from the next second on sim_ad readings
+			bADValid = 1;
+#endif
+		}
+		else if (seconds_cnt != prev_seconds)
+		{
+			prev_seconds = seconds_cnt;
+#ifdef CLKSCALE
+			// full speed for the 1s loop (32 bit math, flash writes in hist_save)
+			clk_set(0);
+#endif
+			// read all A/D channels at once, so wd_a and wd_b come from the same cycle
+			getADSnapshot(ad);
+#ifdef SIMWEATHER
+			// soak test: advance synthetic weather, replace water sensor readings
+			sim_second();
+			sim_ad(ad);
+#endif
+
+			// read WIND SENSOR: pulses since the previous reading, also if more
+			//   than 1s passed (after moves), as average pulses per second
 			{
-				unsigned char delta_counter, dc_th;
-
-				// read WIND SENSOR with interrupts disabled
-				EA = 0;
-				// if more than one second passed, then ignore (by clear) wind reading. Almost certainly
-				//   caused by a previous actuation of tents
-				if (seconds_cnt != prev_seconds+1)
-					delta_counter = 0;
+				unsigned long total, now, elapsed;
+
+				wind_read(&now, &total);
+				elapsed = now-prev_uptime;
+				total -= prev_total;
+				if (elapsed == 1)
+					wind_ticks = total > 65535 ? 65535 : (unsigned short)total;
 				else
-				{
-					// normal condition, 1s has passed
-					if (tm0_cnt-prev_counter > 255)
-						// very unlikely, but...
-						delta_counter = 255;
-					else
-						delta_counter = (unsigned char)(tm0_cnt-prev_counter);
-				}
-				prev_counter = tm0_cnt;
-				prev_seconds = seconds_cnt;
-				EA = 1;
-
-				// read threshold from pot and compare: pre-alarm if threshold passed
-				// set monitored range to 8-39 ticks per second (full CW: max sensitivity)
-				dc_th = 39-(unsigned char)(getAD(2) >> 11);
-				wind_pre = delta_counter > dc_th;
+					// 32 bit division in main only (library not reentrant)
+					wind_ticks = (unsigned short)(total/elapsed);
+				prev_uptime = now;
+				prev_total += total;
+#ifdef SIMWEATHER
+				wind_ticks = sim_wind();
+#endif
 			}
 
-			// check water: ratio of p-p measurement after and before R29
-			// use dynamic threshold to allow reduced sensitivity after an alarm or
-			//   after manual command down in case of sensor not completely dry
+			// pre-alarms and alarms of all detectors (detect.h): WATER_ALM_TIME s
+			//   consecutive for water, 5 times in WIND_GUST_TIME s for wind
+			// do even if tents are up, because it is required by automatic mode
+#ifdef SLEEPMODE
+			// suspended: readings are stale, don't detect (nor share pre-alarms)
+			if (bSleep)
 			{
-				unsigned short wd, wd_th, wd_a, wd_b;
-				short wd_th_delta;
-
-				wd_b = getAD(0);
-				wd_a = getAD(1);
-				if (wd_b != 0)
-					wd = (unsigned short)(wd_a*65536L/wd_b);
-				else
-					wd = 65535;
-				water_pre = wd < water_threshold;
-
-				// update threshold according to status
-				// with R29=22k we have for wd:
-				// short:5800, open:50447, 1k:8800, 10k:23700, 100k:35200
-				// a good value seems to be around 14k, so we allow a range 8192-40960
-				// wd_th is the user setpoint
-				wd_th = (getAD(3) >> 1)+8192;
-
-				// check if manually changed by rotating the pot: in this case align
-				//   water_threshold with setpoint, otherwise calibration becomes difficult
-				// compare with value 2s before, to be reasonably sure to catch trimmer rotation
-				// (we monitor variation over last 2 cycles, but we repeat check on each cycle)
-				wd_th_delta = (short)(wd_th-wd_th_prev2);
-				if ((wd_th_delta > 1000) || (wd_th_delta < -1000))
-				{
-					// reset threshold
-					water_threshold = wd_th;
-				}
-				wd_th_prev2 = wd_th_prev1;
-				wd_th_prev1 = wd_th;
-
-				// threshold adaptation algorithm
-				if (bDown)
-				{
-					// if we are in manual mode with button down just pressed,
-					//   set a threshold that allows the tent to remain down
-					if (bButtonDown)	// manual mode is implicit
-					{
-						// force a threshold lower than current measure,
-						//   so if commanded down it will stay there if conditions
-						//   don't get worse
-						water_threshold = wd-1000;
-						// however, not higher than setpoint
-						if (water_threshold > wd_th)
-							water_threshold = wd_th;
-					}
-					else
-					{
-						// normal or automatic mode, but button not pressed
-						// tent is down, threshold should gradually reach wd_th to restore
-						//   maximum sensitivity
-						if (water_threshold < wd_th)
-						{
-							// we have a lower threshold, due to a previous alarm or
-							//   to manual command down with wet sensor
-							// if actual measure has gone higher than user setpoint wd_th, restore it
-							//   (sensor is finally dry), otherwise keep reduced threshold
-							// keep some margin, to avoid getting an alarm on
-							//   following cycles due to noise
-							if (wd > wd_th+5000)
-								// final update
-								water_threshold = wd_th;
-							else if (wd > water_threshold+5000)
-								// gradually increase threshold while sensor dries
-								water_threshold += 1000;
-						}
-						else
-							// wd_th probably changed by rotating pot, straight copy
-							water_threshold = wd_th;
-
-						// reset sensor minimum reading
-						water_min = 65535;
-					}
-
-				}
-				else
-				{
-					// tent is up
-					// different water threshold for manual and automatic modes
-					if (bAutoDown)
-					{
-						// update minimum reading and threshold
-						if (wd < water_min)
-						{
-							water_min = wd;
-							// put threshold at mid between user setpoint and minimum reached
-							// divide before add to avoid integer overflow
-							water_threshold = (wd_th>>1)+(water_min>>1);
-						}
-					}
-					else
-						// manual mode, threshold doesn't matter, because it will be
-						//   reset when button down is pressed.
-						// reset it to setpoint to simplify tuning of pot looking at LEDR
-						water_threshold = wd_th;
-				}
+				det_pre = 0;
+				det_alm = 0;
 			}
+			else
+#endif
+			det_second();
+			alarm = det_alm != 0;
+#ifdef HISTSTATS
+			hist_prealarm((det_pre & DET_BIT(water)) != 0, (det_pre & DET_BIT(wind)) || wind_events, alarm);
+#endif
 
 			// set LEDR (warning LED) on pre-alarm
-			LEDR = (wind_pre || water_pre) ? 0:1;
-
-			// handle alarm conditions: WATER_ALM_TIME s consecutive for water,
-			//   5 times in WIND_GUST_TIME s for wind
-			// do even if tents are up, because it is required by automatic mode
+			LEDR = det_pre ? 0:1;
+
+			// share our status with the other unit, then act also on
+			//   a confirmed alarm of the other unit
+			// (__bit parameters: pass 0/1, not masks)
+			link_second((det_pre & DET_BIT(wind)) != 0, (det_pre & DET_BIT(water)) != 0, alarm);
+			if (link_peer_alarm())
+				alarm = 1;
+#ifdef SIMWEATHER
+			sim_alarm(alarm, 0);
+#endif
+
+#ifdef T2_JITTER_STATS
+			// report worst Timer2 IRQ latency seen so far (written only by
+			//   Timer2_ISR, read twice to avoid a torn value)
 			{
-				unsigned char iWind, nWindEvents, iFreeSlot;
-				water_cnt = water_pre ? water_cnt+1 : 0;
-				if (water_cnt >= WATER_ALM_TIME)
-					alarm = 1;
-
-				// decrease all active wind timers, count active ones
-				nWindEvents = 0;
-				for (iWind=0; iWind<WIND_GUST_EVENTS-1; iWind++)
-					if (wind_timer[iWind] > 0)
-					{
-						wind_timer[iWind]--;
-						// ignore the case of timer gone to zero now, unsignificant difference
-						nWindEvents++;
-					}
-					else
-						// copy index of free slot (we'll get the last one)
-						iFreeSlot = iWind;
-				
-				// pre-alarm ?
-				if (wind_pre)
+				unsigned short lat;
+				unsigned char buf[2];
+
+				do
 				{
-					if (nWindEvents >= WIND_GUST_EVENTS-1)
-						// this was pre-alarm #WIND_GUST_EVENTS in WIND_GUST_TIME s -> WIND ALARM
-						alarm = 1;
-					else
-						// load one free timer with WIND_GUST_TIME s timeout
-						wind_timer[iFreeSlot] = WIND_GUST_TIME;
-				}
+					lat = t2_lat_max;
+				} while (lat != t2_lat_max);
+				buf[0] = (unsigned char)lat;
+				buf[1] = (unsigned char)(lat >> 8);
+				link_send(LINK_T_JITTER, buf, 2);
 			}
+#endif
+
+			// re-deploy policy: end the hold early when its causes are gone
+			hold_second();
 
 			// now different behaviour with tents up or down
 			if (bDown)
@@ -283,17 +262,22 @@ void main(void)
 				if (alarm)
 				{
 					if (move_updown(1) == -1)
+					{
 						// interrupted by user: go to manual mode, assume we are still down
 						// (assuming to be down is the safest choice)
 						// WARNING: on next loop bButtonDown will be probably set and water
 						//   threshold changed (may not be what human wants...)
 						bAutoDown = 0;
+					}
 					else
 					{
 						// went up without interruptions: keep current auto/manual mode
 						bDown = 0;
-						// load timer for automatic mode with 4 hours (3600*4 s)
-						auto_down_timer = FOUR_HOURS;
+#ifdef SIMWEATHER
+						sim_alarm(0, 1);
+#endif
+						// load timer for automatic mode, hold time by alarm cause
+						arm_auto_down(det_alm);
 					}
 	
 					// clear events memory for alarm detection
@@ -305,17 +289,16 @@ void main(void)
 				// tents are up
 				// restart timer for automatic mode in case of alarms
 				if (alarm)
-					auto_down_timer = FOUR_HOURS;
+					arm_auto_down(det_alm);
 				else
 				{
-					// decrement timer in automatic mode
+					// automatic mode: wait for timer expiry
 					if (bAutoDown)
 					{
-						if (auto_down_timer)
-							auto_down_timer--;
-						else
+						if (!tmr_is_armed(TMR_AUTODOWN))
 						{
-							// timer has elapsed: tents can go down now, after 4 hours without alarms
+							// timer has elapsed or hold ended early by hold_second():
+							//   tents can go down now
 							if (move_updown(0) == -1)
 							{
 								// interrupted by user: go to manual mode, assume we are down
@@ -336,12 +319,75 @@ void main(void)
 				}
 			}
 
+			// time to automatic down, for LEDG and status
+			set_auto_down_timer(tmr_left(TMR_AUTODOWN));
+#ifdef STATEDUMP
+			state_dump();
+#endif
+
+#if defined(ADC_DUTY) && defined(SLEEPMODE)
+			if (!bSleep)
+#endif
+#ifdef ADC_DUTY
+			// acquisition always running while tents are down (alarms must be fast)
+			//   and before automatic down (decision on fresh readings), in bursts
+			//   otherwise: between bursts the readings above are the last ones
+			{
+				if (bDown || (bAutoDown && auto_down_timer < AD_DUTY_NEAR))
+					ADC0_Duty(0);
+				else
+					ADC0_Duty(bAutoDown ? AD_DUTY_AUTO : AD_DUTY_MANUAL);
+			}
+#endif
+
 		}	// end 1s timed loop
 
+		// automatic mode requested on the serial link: with tents up, start the
+		//   hold again, TMR_AUTODOWN kept running (and maybe expired) in manual mode
+		if (bCmdAuto)
+		{
+			bCmdAuto = 0;
+			if (!bAutoDown)
+			{
+				bAutoDown = 1;
+				if (!bDown)
+					arm_auto_down(0);
+			}
+		}
+
+		// move requested on the serial link: same handling as automatic moves
+		if (cmd_move >= 0)
+		{
+			char bUp = cmd_move;
+
+			cmd_move = -1;
+			if (move_updown(bUp) == -1)
+			{
+				// interrupted by user: go to manual mode, assume we are down
+				bAutoDown = 0;
+				bDown = 1;
+			}
+			else if (bUp)
+			{
+				// up: wait the hold time before automatic down, as after an alarm
+				bDown = 0;
+				arm_auto_down(0);
+			}
+			else
+				bDown = 1;
+
+			// clear events memory for alarm detection
+			alarm_reset();
+		}
+
 
 		// arrived here: restore soft watchdog counter
 		WDcnt = SOFT_WD_COUNTS;
 
+#ifdef CLKSCALE
+		// IRQs and the next wakeups run at half speed
+		clk_set(1);
+#endif
 		// go idle until next interrupt to save power
 		PCON = PCON_IDLE;
 	}	// end while(1)
@@ -355,58 +401,48 @@ void main(void)
 // if ok, return 0
 char move_updown(char bUp)
 {
-	unsigned char s;
-	char time_to_wait;
 	__bit bBtnPressed = 0;
 
 	// check button not pressed
 	if (!DI_DOWN)
 		return -1;
+	bMoving = 1;
+
+#ifdef CLKSCALE
+	// full speed to start the move, wait_seconds() slows down again
+	clk_set(0);
+#endif
 
 	// select relays according to required mode
 	RL_AUTO = 1;
 	RL_DOWN = bUp ? 0:1;
 
-	// wait at least 1s, checking button (safe exit if pressed)
+	// wait at least 1s
 	// NO, don't check button here, we are safely disconnected from it and sometimes
 	//   we get a glitch on DI_DOWN when the relay contact closes
-	s = seconds_cnt;
-	while ((char)(seconds_cnt-s) < 2) // && !bBtnPressed)
-	{
-		//bBtnPressed = !DI_DOWN;
-		// we need to avoid watchdog resets
-		WDcnt = SOFT_WD_COUNTS;
-	}
+	wait_seconds(2, 0);
 
 	// actuate TRIAC, unless button was pressed
 	// ok, now bBtnPressed is always == 0, but we leave the original code
 	TRIAC_OFF = bBtnPressed;
-
-	// now wait for completion of actuation, time is different according to direction
-	// immediate exit if button was previously pressed
-	s = seconds_cnt;
-	time_to_wait = bUp ? TENTS_UP_TIME:TENTS_DOWN_TIME;
-	while ((char)(seconds_cnt-s) < time_to_wait && !bBtnPressed)
+#ifdef LATSTATS
+	if (bUp)
 	{
-		bBtnPressed = !DI_DOWN;
-		// go idle until next interrupt to save power
-		// we need to avoid watchdog resets
-		WDcnt = SOFT_WD_COUNTS;
-		PCON = PCON_IDLE;
+		lat_stop(LAT_WATER);
+		lat_stop(LAT_WIND);
 	}
+#endif
+
+	// now wait for completion of actuation, time is different according to direction
+	// immediate exit if button is pressed
+	bBtnPressed = wait_seconds(bUp ? TENTS_UP_TIME:TENTS_DOWN_TIME, 1);
 
 	// terminate TRIAC actuation
 	TRIAC_OFF = 1;
 		
-	// wait at least 1s, checking button
+	// wait at least 1s
 	// NO, don't check button, as above
-	s = seconds_cnt;
-	while ((char)(seconds_cnt-s) < 2) // && !bBtnPressed)
-	{
-		// bBtnPressed = !DI_DOWN;
-		// we need to avoid watchdog resets
-		WDcnt = SOFT_WD_COUNTS;
-	}
+	wait_seconds(2, 0);
 
 	// now check if button is pressed, because we have removed the test above
 	if (!DI_DOWN)
@@ -419,37 +455,186 @@ char move_updown(char bUp)
 	{
 		RL_DOWN = 0;
 		RL_AUTO = 0;
+		bMoving = 0;
 		return 0;
 	}
 
 	// we must wait until button is released, then wait a further time
 	//   before releasing the relays
+	// wait for release (idle between Timer2 ticks), then at least 1s more,
+	//   restart if pressed again
 	while (bBtnPressed)
 	{
-		bBtnPressed = 0;
-		// wait at least 1s, checking button
-		s = seconds_cnt;
-		while ((char)(seconds_cnt-s) < 2 && !bBtnPressed)
+		while (!DI_DOWN)
 		{
-			bBtnPressed = !DI_DOWN;
 			// we need to avoid watchdog resets
 			WDcnt = SOFT_WD_COUNTS;
+			PCON = PCON_IDLE;
 		}
+		bBtnPressed = wait_seconds(2, 1);
 	}
 
 	// now release relays and exit with "button pressed" condition
 	RL_DOWN = 0;
 	RL_AUTO = 0;
+	bMoving = 0;
 	return -1;
 }
 
 
+// wait for <secs> seconds (at least secs-1 s, like the 1s loop), going idle
+//   until next interrupt instead of polling, so the core only wakes on events
+// if bCheckBtn, return 1 as soon as button is pressed, otherwise return 0
+__bit wait_seconds(unsigned char secs, __bit bCheckBtn)
+{
+	// expires after <secs> second ticks
+	tmr_arm(TMR_MOVE, secs);
+	while (tmr_is_armed(TMR_MOVE))
+	{
+		// we need to avoid watchdog resets, also on the early return
+		WDcnt = SOFT_WD_COUNTS;
+
+		if (bCheckBtn && !DI_DOWN)
+		{
+			tmr_cancel(TMR_MOVE);
+			return 1;
+		}
+		ADC0_Process();
+		link_keepalive();
+#ifdef TRACEMODE
+		trace_poll();
+#endif
+		tmr_poll();
+#ifdef CLKSCALE
+		clk_set(1);
+#endif
+		// go idle until next interrupt to save power
+		PCON = PCON_IDLE;
+	}
+	return 0;
+}
+
+
 void alarm_reset()
 {
-	unsigned char iWind;
 	// reset variables for alarm detection
-	// don't touch water thresholds
-	water_cnt = 0;
-	for (iWind = 0; iWind<4; iWind++)
-		wind_timer[iWind] = 0;
+	det_reset();
+}
+
+
+// (re)start the hold time before automatic down, <cause> as det_alm
+//   (0: moves from the link and alarms of the other unit, fixed FOUR_HOURS)
+void arm_auto_down(unsigned char cause)
+{
+	unsigned short t;
+
+	t = hold_arm(cause);
+	tmr_arm(TMR_AUTODOWN, t);
+	set_auto_down_timer(t);
+}
+
+
+// update auto_down_timer and publish to Timer2_ISR if the hold just (re)started
+void set_auto_down_timer(unsigned short t)
+{
+	auto_down_timer = t;
+	bHoldFull = t != 0 && t == hold_len;
+}
+
+
+// read uptime and the wind pulses total: both are updated with seconds_cnt
+//   by Timer2_ISR, so retry if a new second arrived while reading
+void wind_read(unsigned long *now, unsigned long *total)
+{
+	unsigned char sec;
+
+	while (1)
+	{
+		sec = seconds_cnt;
+		*now = uptime;
+		*total = tm0_total;
+		if (sec == seconds_cnt)
+			break;
+#ifdef RACECHECK
+		race_tm0_retry++;
+#endif
+	}
+}
+
+
+#ifdef SLEEPMODE
+// suspend: with tents up in manual mode nothing happens until the button
+//   is pressed (alarms don't move the tents and there is no automatic down),
+//   so after SLEEP_DELAY s (time to tune the pots looking at LEDR) turn off
+//   A/D and excitation: 40 instead of 280 IRQ/s and ~1 mA less (data sheet
+//   typical for ADC0 and IDA0, not measured). Detectors don't run meanwhile.
+// The F350 has no port match and leaves STOP mode only by reset, and the
+//   watchdog is locked at 32 ms, so Timer2 keeps running at 40 Hz: the core
+//   still goes idle between its ticks, and a press is seen within 25 ms.
+// Resume on any reason to detect (button, automatic mode, move command):
+//   a fresh snapshot is ready after 2 A/D cycles, used by the next 1s loop.
+void sleep_poll(void)
+{
+	if (bDown || bAutoDown || cmd_move >= 0)
+	{
+		if (bSleep)
+		{
+			bSleep = 0;
+			ADC0_On();
+		}
+		if (bSleepWait)
+		{
+			bSleepWait = 0;
+			tmr_cancel(TMR_SLEEP);
+		}
+	}
+	else if (!bSleepWait)
+	{
+		bSleepWait = 1;
+		tmr_arm(TMR_SLEEP, SLEEP_DELAY);
+	}
+	else if (!bSleep && !tmr_is_armed(TMR_SLEEP))
+	{
+		bSleep = 1;
+		ADC0_Off();
+		alarm_reset();
+		LEDR = 1;
+	}
+}
+#endif
+
+
+#ifdef STATEDUMP
+// send outputs and controller state at the end of each 1s loop, so two
+//   builds of the same sources (e.g. the .ihx in a simulator and a port)
+//   fed with the same inputs (SIMWEATHER) can be compared second by second:
+//   uptime (lo, hi), P1 outputs (without LEDG, driven by Timer2_ISR),
+//   flags (bit0 bDown, bit1 bAutoDown, bit2 bButtonDown), det_pre, det_alm,
+//   water_threshold, last_wd, water_cnt, last_dc_th, wind_ticks,
+//   auto_down_timer (16 bit values lo, hi)
+// the wraps of the 8/16 bit counters show up here first
+void state_dump(void)
+{
+	unsigned char buf[16];
+	unsigned short t;
+
+	t = (unsigned short)uptime_get();
+	buf[0] = (unsigned char)t;
+	buf[1] = (unsigned char)(t >> 8);
+	buf[2] = P1 & 0x1B;
+	buf[3] = (bDown ? 0x01:0) | (bAutoDown ? 0x02:0) | (bButtonDown ? 0x04:0);
+	buf[4] = det_pre;
+	buf[5] = det_alm;
+	buf[6] = (unsigned char)water_threshold;
+	buf[7] = (unsigned char)(water_threshold >> 8);
+	buf[8] = (unsigned char)last_wd;
+	buf[9] = (unsigned char)(last_wd >> 8);
+	buf[10] = water_cnt;
+	buf[11] = last_dc_th;
+	buf[12] = (unsigned char)wind_ticks;
+	buf[13] = (unsigned char)(wind_ticks >> 8);
+	buf[14] = (unsigned char)auto_down_timer;
+	buf[15] = (unsigned char)(auto_down_timer >> 8);
+	link_send(LINK_T_STATE, buf, 16);
 }
+#endif
@@ -13,8 +13,29 @@
 //#define SOGGIORNO
 #define MANSARDA
 //#define TESTMODE
+//#define TRACEMODE			// stream raw A/D samples on UART0 (see trace.h)
+//#define SIMWEATHER		// soak test with synthetic weather (see sim.c)
+//#define SIMNOAD			// with SIMWEATHER: 1s loop without A/D, all channels from sim_ad
+							//   (simulators without ADC0, see host/ucsim.sh)
+//#define ADC_HUM_REJECT	// A/D at 50 Hz to reject mains hum (see F35x_ADC0.c)
+							//   UNVALIDATED: hum rejection not measured yet
+//#define ADC_DUTY			// A/D and excitation in bursts while tents are up (see ADC0_Duty)
+//#define SLEEPMODE			// suspend acquisition in manual mode with tents up (see sleep_poll)
+
+// interrupt priorities
+//#define TIMER2_HIPRI		// Timer2 (timebase, watchdog) preempts ADC0 and UART0 IRQs
+							//   off until T2_JITTER_STATS latencies are measured on a
+							//   unit with and without it
+//#define T2_JITTER_STATS	// measure Timer2 IRQ entry latency, sent on link every 1s
+//#define LATSTATS			// detection latency statistics, read with CMD_T_LATSTATS
+//#define HISTSTATS			// site statistics histograms, read with CMD_T_HIST (see hist.c)
+//#define HIST_FLASH		// with HISTSTATS: checkpoint histograms in flash at FLASH_HIST
+//#define STATEDUMP			// send outputs and controller state every 1s (LINK_T_STATE)
+//#define RACECHECK			// count retries of lock-free reads, read with CMD_T_RACE
 
 #define SYSCLK (24500000)	// SYSCLK frequency in Hz (internal oscillator)
+//#define CLKSCALE			// SYSCLK/2 outside the 1s loop and moves (see clk_set)
+#define T2_COUNTS ((SYSCLK/12/40+1) & ~1)	// Timer2 counts per 40 Hz tick, even for SYSCLK/2
 
 #define DI_WIND P0_0		// wind sensor, mapped to counter T0
 #define DI_DOWN P0_1		// =0 when any down button is pressed
@@ -25,62 +46,121 @@
 #define RL_DOWN P1_4		// RL_DOWN=1 commands DOWN, otherwise UP
 
 // flash position optimized to avoid large unused areas before (looking .map)
-//#define FLASH_STORE (0x1000)	// user data in flash at 0x1A00-0x1BFF
+#define FLASH_HIST (0x1A00)		// histograms checkpoint (HIST_FLASH), one 512 byte page
 
 // operational constants
 #define WIND_GUST_TIME 60	// seconds for wind gust evaluation
 #define WIND_GUST_EVENTS 5	// number of cycles over threshold in WIND_GUST_TIME to get alarm
+#define WIND_GUST_EVENTS_MAX 8	// max WIND_GUST_EVENTS settable at runtime
 #define WATER_ALM_TIME 4	// seconds of water pre-alarm to get alarm
 #define SOFT_WD_COUNTS 4	// number of 25 ms IRQ cycles before WD resets us
+#define AD_DUTY_AUTO 30		// ADC_DUTY: s between A/D bursts, tents up in automatic mode
+#define AD_DUTY_MANUAL 60	// ADC_DUTY: s between A/D bursts, tents up in manual mode
+#define AD_DUTY_NEAR 600	// ADC_DUTY: continuous A/D in the last s before automatic down
+#define SLEEP_DELAY 600		// SLEEPMODE: s in manual mode with tents up before suspend
 
 // locations
 #ifdef SOGGIORNO
 #define FOUR_HOURS	14400	// seconds without alarm before automatic down is allowed
+#define HOLD_WIND_MIN 3600	// hold after wind alarms, s: min (if calm) and max
+#define HOLD_WIND_MAX 14400
+#define HOLD_RAIN_MIN 2700	// hold after rain alarms, s: min (if dry) and max
+#define HOLD_RAIN_MAX 14400
+#define HOLD_CALM_TIME 1800	// s with wind calm / rain sensor dry before an early down
 #define TENTS_UP_TIME 35	// time (s) to lift tents
 #define TENTS_DOWN_TIME 15	// time (s) to lower tents
+#define LINK_UNIT_ID 1		// id on the serial link between units
 #endif
 
 #ifdef MANSARDA
 #define FOUR_HOURS	14400	// seconds without alarm before automatic down is allowed
+#define HOLD_WIND_MIN 3600	// hold after wind alarms, s: min (if calm) and max
+#define HOLD_WIND_MAX 14400
+#define HOLD_RAIN_MIN 2700	// hold after rain alarms, s: min (if dry) and max
+#define HOLD_RAIN_MAX 14400
+#define HOLD_CALM_TIME 1800	// s with wind calm / rain sensor dry before an early down
 #define TENTS_UP_TIME 40	// time (s) to lift tents
 #define TENTS_DOWN_TIME 30	// time (s) to lower tents
+#define LINK_UNIT_ID 2		// id on the serial link between units
 #endif
 
 // test constants
 #ifdef TESTMODE
 #define FOUR_HOURS	120 	// seconds without alarm before automatic down is allowed
+#define HOLD_WIND_MIN 40	// hold after wind alarms, s: min (if calm) and max
+#define HOLD_WIND_MAX 120
+#define HOLD_RAIN_MIN 30	// hold after rain alarms, s: min (if dry) and max
+#define HOLD_RAIN_MAX 120
+#define HOLD_CALM_TIME 20	// s with wind calm / rain sensor dry before an early down
 #define TENTS_UP_TIME 10 	// time (s) to lift tents
 #define TENTS_DOWN_TIME 6 	// time (s) to lower tents
+#ifndef LINK_UNIT_ID
+#define LINK_UNIT_ID 3		// id on the serial link between units
+#endif
 #endif
 
 //-----------------------------------------------------------------------------
 // Global FUNCTIONS
 //-----------------------------------------------------------------------------
 void init(void);
+#ifdef CLKSCALE
+void clk_set(__bit bSlow);		// SYSCLK/2 if bSlow, otherwise SYSCLK
+#endif
 
 
 //-----------------------------------------------------------------------------
 // Global VARIABLES
 //-----------------------------------------------------------------------------
 
-/*
-struct FLASHDATA
-{
-	short magic_code;		// FLASH ID=0x5432
-	struct STOREDATA store;
-	char filler[510-sizeof(struct STOREDATA)];	// fill a flash block to force linker to skip it
-};
-*/
-//extern __code __at(FLASH_STORE) struct FLASHDATA flash;
+// Data shared between main() and the IRQs, and how it is kept consistent
+//   (main can be interrupted, IRQs never by main, so only main must care):
+//   seconds_cnt, WDcnt: single byte, atomic
+//   bDown, bAutoDown, bHoldFull: bits, atomic; Timer2_ISR only reads them
+//   tm0_cnt, tm0_total, uptime: written with seconds_cnt by Timer2_ISR, main
+//     retries the read if seconds_cnt changed meanwhile
+//   auto_down_timer: main-only, Timer2_ISR sees only bHoldFull
+//     (see set_auto_down_timer)
+//   A/D raw samples: ring from ADC0_ISR to ADC0_Process, each index is
+//     written by one side only; filtering and adSnapValue are main-only
+//   UART0 rings: each index is written by one side only
+// IRQs don't use 32 bit math: the library routines are not reentrant
+
+// Memory: DATA (direct, ~80 bytes after register banks and bits) holds what
+//   IRQs or every main loop touch; controller and detector state of the 1s
+//   loop is __idata (indirect, shared with the stack); counters, statistics
+//   and settings read only on request are __xdata. Externs must repeat the
+//   memory space. Budgets are checked by memcheck.sh in build.sh.
 
 // clock data
-extern volatile unsigned short clock_mins;
 extern volatile unsigned char seconds_cnt;
 extern volatile unsigned short tm0_cnt;
+extern volatile unsigned long tm0_total;	// wind pulses since power on, with tm0_cnt
 extern volatile __bit bDown;		// goes to zero after an alarm
 extern volatile __bit bAutoDown;	// goes to zero after pressing of buttons
+extern __bit bMoving;				// tents moving, relays energized
+#ifdef SLEEPMODE
+extern __bit bSleep;				// acquisition suspended
+#endif
 extern volatile unsigned char WDcnt;// watchdog counter
-extern volatile unsigned short auto_down_timer;	// used for fast flash
+// controller state
+extern __idata unsigned short auto_down_timer;
+extern __idata unsigned short water_threshold;
+extern __idata unsigned short last_wd, last_wd_th;	// last water reading and setpoint
+extern __idata unsigned char last_dc_th;			// last wind threshold
+// runtime overrides of WIND_GUST_TIME, WIND_GUST_EVENTS, WATER_ALM_TIME
+extern __idata unsigned char wind_gust_time, wind_gust_events, water_alm_time;
+
+extern volatile __bit bHoldFull;	// hold just (re)started: alarm still on, for LEDG
+#ifdef SIMWEATHER
+extern volatile unsigned char wd_margin_min;	// min WDcnt seen by Timer2_ISR
+#endif
+#ifdef RACECHECK
+extern __xdata unsigned short race_tm0_retry;	// tm0_cnt read retries
+#endif
+#ifdef T2_JITTER_STATS
+extern volatile unsigned short t2_lat_max;	// max Timer2 IRQ latency in Timer2 counts
+											//   (1/12 of current SYSCLK, see CLKSCALE)
+#endif
 
 
 #endif // _MAIN_H_
@@ -0,0 +1,41 @@
+#!/bin/sh
+# memcheck.sh
+# TENDONI V2
+# rev1 - RV110812
+# check the linker memory report (.mem, written by sdcc next to the .ihx)
+#   against the RAM and flash budgets, exit 1 if one is exceeded
+# usage: memcheck.sh [BATMON.mem]   (run by build.sh after linking)
+#
+# budgets:
+#   STACK_MIN  free bytes for the stack above DATA/IDATA: main call depth
+#              (~10 levels) plus ADC0 or UART0 IRQ preempted by Timer2
+#              (TIMER2_HIPRI), each IRQ saves ~10 bytes (register banks)
+#   XRAM_MAX   on-chip XRAM, 512 bytes
+#   ROM_MAX    application area 0x0400-0x1BFF (boot.c, lock byte page after);
+#              with HIST_FLASH code must end before FLASH_HIST: ROM_MAX=5632
+
+MEM=${1:-BATMON.mem}
+STACK_MIN=${STACK_MIN:-40}
+XRAM_MAX=${XRAM_MAX:-512}
+ROM_MAX=${ROM_MAX:-6144}
+
+[ -f "$MEM" ] || { echo "$MEM not found"; exit 1; }
+
+awk -v stack_min=$STACK_MIN -v xram_max=$XRAM_MAX -v rom_max=$ROM_MAX '
+/Insufficient space|ERROR/	{ print; err = 1 }
+/Stack starts at/ {
+	for (i = 1; i <= NF; i++)
+		if ($i == "with")
+			stack = $(i+1)
+	}
+/EXTERNAL RAM/		{ xram = $(NF-1) }
+/ROM\/EPROM\/FLASH/	{ rom = $(NF-1) }
+END {
+	printf "stack  %5d bytes free  (min %d)\n", stack, stack_min
+	printf "xdata  %5d bytes used  (max %d)\n", xram, xram_max
+	printf "code   %5d bytes used  (max %d)\n", rom, rom_max
+	if (stack < stack_min) { print "stack budget exceeded"; err = 1 }
+	if (xram > xram_max) { print "xdata budget exceeded"; err = 1 }
+	if (rom > rom_max) { print "code budget exceeded"; err = 1 }
+	exit err
+}' "$MEM"
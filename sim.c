@@ -0,0 +1,208 @@
+//-----------------------------------------------------------------------------
+// sim.c
+// TENDONI V2
+// rev1 - RV110710
+// synthetic weather for soak tests, compiled only with SIMWEATHER
+//-----------------------------------------------------------------------------
+// Replaces the sensor readings in the 1s loop with seedable synthetic weather:
+//   - wind: Weibull (k=2) mean speed, renewed every SIM_WIND_PERIOD s, with
+//     random gust bursts of 3-10 s at 1.5-2.5 times the mean
+//   - rain: random events of 10 min - 2 h; wd falls towards SIM_WD_WET while
+//     raining (~30 s time constant) and rises back while drying (~10 min)
+//   - random presses of the down button
+// Alarms are counted as false when there was no gust or rain in the last
+//   WIND_GUST_TIME s; time with tents up is counted, and also the part of it
+//   without such a reason (shade lost). Counters are read with CMD_T_SIMSTATS.
+// Each seed (CMD_SET_SIM_SEED) gives an independent run from zeroed counters,
+//   so many units or simulator instances with their own seed, pots and
+//   location profile can be aggregated into fleet statistics on the host.
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include "C8051F350.h"		// SFR declarations
+#include "main.h"
+#include "link.h"
+#include "cmd.h"
+#include "sim.h"
+
+#ifdef SIMWEATHER
+
+//-----------------------------------------------------------------------------
+// Function PROTOTYPES
+//-----------------------------------------------------------------------------
+unsigned short sim_rand(void);
+
+//-----------------------------------------------------------------------------
+// Global VARIABLES
+//-----------------------------------------------------------------------------
+
+// inverse CDF of Weibull k=2, scale 1, at the centre of 16 quantiles (Q8)
+__code unsigned short sim_weibull[16] = { 46, 80, 106, 127, 147, 166, 185, 204, 223, 243, 265, 288, 316, 349, 394, 477 };
+
+__xdata unsigned short sim_state = SIM_SEED;
+__xdata unsigned short sim_period = 0, sim_rain = 0;
+__xdata unsigned short sim_wd = SIM_WD_DRY;
+__xdata unsigned char sim_mean, sim_gust = 0, sim_gust_mul, sim_pulses, sim_recent = 0;
+__bit bSimBtn = 0;
+#ifdef SIMNOAD
+__xdata unsigned short sim_pot2 = 0x8000, sim_pot3 = 0x8000;	// pots for sim_ad, host/mc.c sets others
+#endif
+
+// statistics
+__xdata unsigned short sim_alarms = 0, sim_false = 0, sim_retract = 0;
+__xdata unsigned long sim_up = 0, sim_up_clear = 0;
+
+
+// xorshift, period 65535
+unsigned short sim_rand(void)
+{
+	sim_state ^= sim_state << 7;
+	sim_state ^= sim_state >> 9;
+	sim_state ^= sim_state << 8;
+	return sim_state;
+}
+
+
+void sim_second(void)
+{
+	unsigned short v;
+
+	// new mean wind
+	if (sim_period == 0)
+	{
+		sim_period = SIM_WIND_PERIOD;
+		sim_mean = (unsigned char)((sim_weibull[sim_rand() & 15] * SIM_WIND_SCALE) >> 8);
+	}
+	sim_period--;
+
+	// gust bursts
+	if (sim_gust)
+		sim_gust--;
+	else if (sim_rand() < SIM_GUST_PROB)
+	{
+		sim_gust = 3 + (sim_rand() & 7);
+		sim_gust_mul = 6 + (sim_rand() & 3);	// 1.5-2.25 in Q2
+	}
+
+	// pulses this second: mean or gust, +-25% noise
+	v = sim_gust ? (sim_mean * sim_gust_mul) >> 2 : sim_mean;
+	v += (short)((v >> 2) * ((sim_rand() & 0xFF) - 128)) >> 7;
+	sim_pulses = v > 255 ? 255 : (unsigned char)v;
+
+	// rain events, then wetting or drying
+	if (sim_rain)
+		sim_rain--;
+	else if (sim_rand() < SIM_RAIN_PROB)
+		sim_rain = 600 + (sim_rand() % 6600);
+
+	if (sim_rain)
+		sim_wd -= (sim_wd - SIM_WD_WET) >> 5;
+	else if (sim_wd < SIM_WD_DRY)
+		sim_wd += ((SIM_WD_DRY - sim_wd) >> 9) + 1;
+
+	// anything that justifies an alarm in the last WIND_GUST_TIME s
+	if (sim_gust || sim_rain)
+		sim_recent = WIND_GUST_TIME;
+	else if (sim_recent)
+		sim_recent--;
+
+	// button
+	if (sim_rand() < SIM_BTN_PROB)
+		bSimBtn = 1;
+
+	// downtime
+	if (!bDown)
+	{
+		sim_up++;
+		if (!sim_recent)
+			sim_up_clear++;
+	}
+}
+
+
+unsigned char sim_wind(void)
+{
+	return sim_pulses;
+}
+
+
+// channel 1 over channel 0 gives wd (see main): with ch 0 at 0.5 in Q16,
+//   ch 1 is wd/2; SIMNOAD: pots too
+void sim_ad(unsigned short *ad)
+{
+	ad[0] = 32768;
+	ad[1] = sim_wd >> 1;
+#ifdef SIMNOAD
+	ad[2] = sim_pot2;
+	ad[3] = sim_pot3;
+#endif
+}
+
+
+__bit sim_button(void)
+{
+	if (!bSimBtn)
+		return 0;
+	bSimBtn = 0;
+	return 1;
+}
+
+
+void sim_alarm(__bit alarm, __bit retracted)
+{
+	if (alarm)
+	{
+		sim_alarms++;
+		if (!sim_recent)
+			sim_false++;
+	}
+	if (retracted)
+		sim_retract++;
+}
+
+
+void sim_stats(void)
+{
+	unsigned char buf[15], i;
+	unsigned long up = sim_up, up_clear = sim_up_clear;
+
+	buf[0] = (unsigned char)sim_alarms;
+	buf[1] = (unsigned char)(sim_alarms >> 8);
+	buf[2] = (unsigned char)sim_false;
+	buf[3] = (unsigned char)(sim_false >> 8);
+	buf[4] = (unsigned char)sim_retract;
+	buf[5] = (unsigned char)(sim_retract >> 8);
+	buf[6] = wd_margin_min;
+	for (i=0; i<4; i++)
+	{
+		buf[7+i] = (unsigned char)up;
+		buf[11+i] = (unsigned char)up_clear;
+		up >>= 8;
+		up_clear >>= 8;
+	}
+	link_send(CMD_REPLY | CMD_T_SIMSTATS, buf, 15);
+}
+
+
+// new weather from <seed> (0 is not valid for xorshift), counters from 0
+unsigned char sim_seed(unsigned short seed)
+{
+	if (seed == 0)
+		return 1;
+	sim_state = seed;
+	sim_period = 0;
+	sim_rain = 0;
+	sim_wd = SIM_WD_DRY;
+	sim_gust = 0;
+	sim_recent = 0;
+	bSimBtn = 0;
+	sim_alarms = 0;
+	sim_false = 0;
+	sim_retract = 0;
+	sim_up = 0;
+	sim_up_clear = 0;
+	return 0;
+}
+
+#endif // SIMWEATHER
@@ -0,0 +1,39 @@
+// sim.h
+// TENDONI V2
+// rev1 - RV110710
+// synthetic weather for soak tests (SIMWEATHER only)
+
+#ifndef _SIM_H_
+#define _SIM_H_
+
+//-----------------------------------------------------------------------------
+// Global CONSTANTS
+//-----------------------------------------------------------------------------
+
+#define SIM_SEED 0x1234		// PRNG seed at power on, CMD_SET_SIM_SEED for other weathers
+#define SIM_WIND_SCALE 12	// Weibull scale of mean wind, in pulses/s
+#define SIM_WIND_PERIOD 600	// s between changes of mean wind
+#define SIM_GUST_PROB 218	// gust start probability per s, /65536 (1/300)
+#define SIM_RAIN_PROB 9		// rain start probability per s, /65536 (1/7200)
+#define SIM_BTN_PROB 1		// button press probability per s, /65536 (~1/18h)
+#define SIM_WD_DRY 36000	// wd with dry sensor
+#define SIM_WD_WET 8000		// wd with wet sensor
+
+// reply to CMD_T_SIMSTATS: alarms, false alarms, retractions (lo, hi),
+//   min watchdog counter seen by Timer2_ISR, seconds with tents up and
+//   seconds up without rain or gusts in the last WIND_GUST_TIME s (32 bit, lo first)
+#define CMD_T_SIMSTATS 'Z'
+
+//-----------------------------------------------------------------------------
+// Global FUNCTIONS
+//-----------------------------------------------------------------------------
+
+void sim_second(void);					// advance weather by 1 s
+unsigned char sim_wind(void);			// wind pulses in the last second
+void sim_ad(unsigned short *ad);		// replace water sensor channels 0, 1 (all with SIMNOAD)
+__bit sim_button(void);					// =1 once for each simulated press
+void sim_alarm(__bit alarm, __bit retracted);	// count alarm outcomes
+void sim_stats(void);					// send CMD_T_SIMSTATS reply
+unsigned char sim_seed(unsigned short seed);	// restart weather and counters, 1 if seed not valid
+
+#endif // _SIM_H_
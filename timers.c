@@ -0,0 +1,124 @@
+//-----------------------------------------------------------------------------
+// timers.c
+// TENDONI V2
+// rev1 - RV110718
+// timeouts with absolute deadlines on a 32 bit seconds count
+//-----------------------------------------------------------------------------
+// Each timer has an absolute deadline on uptime, so it stays accurate no
+//   matter how long the main loop was busy (e.g. in move_updown). Armed
+//   timers are kept sorted by deadline: tmr_poll() only looks at the first
+//   one, so a tick costs O(1); arming costs O(N_TIMERS) (a few bytes moved).
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include "C8051F350.h"		// SFR declarations
+#include "main.h"
+#include "timers.h"
+
+//-----------------------------------------------------------------------------
+// Function PROTOTYPES
+//-----------------------------------------------------------------------------
+void tmr_remove(unsigned char id);
+
+//-----------------------------------------------------------------------------
+// Global VARIABLES
+//-----------------------------------------------------------------------------
+volatile unsigned long uptime = 0;
+
+__xdata unsigned long tmr_deadline[N_TIMERS];
+unsigned char tmr_armed[N_TIMERS];
+unsigned char tmr_order[N_TIMERS];		// ids of armed timers, earliest first
+unsigned char tmr_n = 0;				// number of armed timers
+
+
+// seconds since power on
+// uptime is written by Timer2_ISR together with seconds_cnt, so retry the
+//   read if a new second arrived meanwhile
+unsigned long uptime_get(void)
+{
+	unsigned long t;
+	unsigned char sec;
+
+	do
+	{
+		sec = seconds_cnt;
+		t = uptime;
+	} while (sec != seconds_cnt);
+
+	return t;
+}
+
+
+// disarm expired timers
+void tmr_poll(void)
+{
+	unsigned long now;
+
+	if (tmr_n == 0)
+		return;
+
+	now = uptime_get();
+	while (tmr_n && (long)(now - tmr_deadline[tmr_order[0]]) >= 0)
+		tmr_remove(tmr_order[0]);
+}
+
+
+// (re)start a timer, expiring secs seconds from now
+void tmr_arm(unsigned char id, unsigned short secs)
+{
+	unsigned long deadline;
+	unsigned char i;
+
+	if (tmr_armed[id])
+		tmr_remove(id);
+
+	deadline = uptime_get() + secs;
+	tmr_deadline[id] = deadline;
+
+	// insert keeping order, after timers with the same deadline
+	i = tmr_n;
+	while (i && (long)(tmr_deadline[tmr_order[i-1]] - deadline) > 0)
+	{
+		tmr_order[i] = tmr_order[i-1];
+		i--;
+	}
+	tmr_order[i] = id;
+	tmr_n++;
+	tmr_armed[id] = 1;
+}
+
+
+void tmr_cancel(unsigned char id)
+{
+	if (tmr_armed[id])
+		tmr_remove(id);
+}
+
+
+// seconds to expiry, 0 if not armed
+unsigned short tmr_left(unsigned char id)
+{
+	unsigned long now;
+
+	if (!tmr_armed[id])
+		return 0;
+
+	now = uptime_get();
+	if ((long)(tmr_deadline[id] - now) <= 0)
+		return 0;
+	return (unsigned short)(tmr_deadline[id] - now);
+}
+
+
+// remove an armed timer from the ordered list
+void tmr_remove(unsigned char id)
+{
+	unsigned char i;
+
+	for (i=0; tmr_order[i] != id; i++);
+	tmr_n--;
+	for (; i<tmr_n; i++)
+		tmr_order[i] = tmr_order[i+1];
+	tmr_armed[id] = 0;
+}
@@ -0,0 +1,40 @@
+// timers.h
+// TENDONI V2
+// rev1 - RV110718
+// timeouts with absolute deadlines on a 32 bit seconds count
+
+#ifndef _TIMERS_H_
+#define _TIMERS_H_
+
+//-----------------------------------------------------------------------------
+// Global CONSTANTS
+//-----------------------------------------------------------------------------
+
+// timer ids
+#define TMR_AUTODOWN 0		// hold time before automatic down
+#define TMR_MOVE 1			// waits in move_updown
+#define TMR_SLEEP 2			// SLEEPMODE: delay before suspend
+#define TMR_WIND0 3			// WIND_GUST_EVENTS_MAX-1 wind gust windows
+#define N_TIMERS (TMR_WIND0+WIND_GUST_EVENTS_MAX-1)
+
+//-----------------------------------------------------------------------------
+// Global FUNCTIONS
+//-----------------------------------------------------------------------------
+
+unsigned long uptime_get(void);	// seconds since power on
+void tmr_poll(void);			// disarm expired timers, call on each wakeup
+void tmr_arm(unsigned char id, unsigned short secs);	// (re)start a timer
+void tmr_cancel(unsigned char id);
+unsigned short tmr_left(unsigned char id);	// seconds to expiry, 0 if not armed
+
+// =1 while timer is running
+#define tmr_is_armed(id) (tmr_armed[id])
+
+//-----------------------------------------------------------------------------
+// Global VARIABLES
+//-----------------------------------------------------------------------------
+
+extern volatile unsigned long uptime;		// incremented by Timer2_ISR with seconds_cnt
+extern unsigned char tmr_armed[N_TIMERS];
+
+#endif // _TIMERS_H_
@@ -0,0 +1,138 @@
+//-----------------------------------------------------------------------------
+// trace.c
+// TENDONI V2
+// rev1 - RV110620
+// raw sensor trace streaming, compiled only with TRACEMODE
+//-----------------------------------------------------------------------------
+// see trace.h for the format
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include "C8051F350.h"		// SFR declarations
+#include "main.h"
+#include "F35x_ADC0.h"
+#include "link.h"
+#include "trace.h"
+
+#ifdef TRACEMODE
+
+//-----------------------------------------------------------------------------
+// Function PROTOTYPES
+//-----------------------------------------------------------------------------
+__bit trace_chunk(unsigned char slot);
+void trace_byte(unsigned char b);
+void trace_flush(void);
+
+//-----------------------------------------------------------------------------
+// Global VARIABLES
+//-----------------------------------------------------------------------------
+
+// ring written by ADC0_Process, read by trace_poll
+__xdata unsigned short traceVal[TRACE_RINGSIZE];
+__xdata unsigned char traceSlot[TRACE_RINGSIZE];
+volatile unsigned char traceHead=0, traceTail=0;
+volatile __bit bTraceGap = 1;		// first chunk: no history
+unsigned char traceCycle = 0;		// A/D cycles mod TRACE_EVERY, 0 is traced
+
+// encoder state
+__xdata unsigned short tracePred[DA_PERIOD];	// previous sample in each slot
+__xdata unsigned char traceOut[LINK_MAX_PAYLOAD];
+unsigned char traceOutLen=0, traceSecond;
+__bit bTraceLost = 0;				// a frame was dropped, restart chunk
+
+
+// encode and send buffered samples, starting a new chunk every second and
+//   after any loss
+// bounded by the ring size, so it can run on every main loop wakeup
+void trace_poll(void)
+{
+	unsigned char n;
+
+	for (n=0; n<TRACE_RINGSIZE && traceTail != traceHead; n++)
+	{
+		unsigned char slot;
+		unsigned short z;
+
+		slot = traceSlot[traceTail];
+
+		// new chunk on second boundary or after lost samples/frames
+		// if TX is full, drop the sample: next chunk will be marked as a gap
+		if ((bTraceGap || bTraceLost || seconds_cnt != traceSecond) && !trace_chunk(slot))
+		{
+			traceTail = (traceTail+1) & (TRACE_RINGSIZE-1);
+			continue;
+		}
+
+		// zigzag encode delta from previous sample in the same slot
+		z = traceVal[traceTail]-tracePred[slot];
+		z = (z & 0x8000) ? ~(z<<1) : (z<<1);
+		tracePred[slot] = traceVal[traceTail];
+		traceTail = (traceTail+1) & (TRACE_RINGSIZE-1);
+
+		// varint, at most 3 bytes
+		while (z >= 0x80)
+		{
+			trace_byte((unsigned char)z | 0x80);
+			z >>= 7;
+		}
+		trace_byte((unsigned char)z);
+	}
+}
+
+
+// close current chunk and start a new one with the given first slot
+// return 0 if the header couldn't be sent
+__bit trace_chunk(unsigned char slot)
+{
+	unsigned char hdr[5], sec, i;
+	unsigned short cnt;
+
+	trace_flush();
+
+	// tm0_cnt and seconds_cnt are updated together, retry if a new second arrived
+	do
+	{
+		sec = seconds_cnt;
+		cnt = tm0_cnt;
+	} while (sec != seconds_cnt);
+
+	hdr[0] = sec;
+	hdr[1] = (unsigned char)cnt;
+	hdr[2] = (unsigned char)(cnt >> 8);
+	hdr[3] = slot;
+	hdr[4] = ((bTraceGap || bTraceLost) ? TRACE_F_GAP:0) | ((TRACE_EVERY-1) << 4);
+
+	if (link_send(LINK_T_TRACE_HDR, hdr, 5) != 0)
+	{
+		bTraceLost = 1;
+		return 0;
+	}
+
+	traceSecond = sec;
+	bTraceGap = 0;
+	bTraceLost = 0;
+	for (i=0; i<DA_PERIOD; i++)
+		tracePred[i] = 0;
+	return 1;
+}
+
+
+// append a byte to the current data frame
+void trace_byte(unsigned char b)
+{
+	traceOut[traceOutLen++] = b;
+	if (traceOutLen == LINK_MAX_PAYLOAD)
+		trace_flush();
+}
+
+
+// send current data frame
+void trace_flush(void)
+{
+	if (traceOutLen && link_send(LINK_T_TRACE, traceOut, traceOutLen) != 0)
+		bTraceLost = 1;
+	traceOutLen = 0;
+}
+
+#endif // TRACEMODE
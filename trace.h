@@ -0,0 +1,78 @@
+// trace.h
+// TENDONI V2
+// rev1 - RV110620
+// raw sensor trace streaming (TRACEMODE only)
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+//-----------------------------------------------------------------------------
+// Global CONSTANTS
+//-----------------------------------------------------------------------------
+
+// Raw A/D samples (ADC0FH/FM, in acquisition order, so the da_val/ad_ch_arr
+//   interleave is preserved) are sent in link frames:
+//   LINK_T_TRACE_HDR: sec, tm0_lo, tm0_hi, slot, flags
+//     starts a chunk: seconds_cnt and tm0_cnt at chunk start, da_counter
+//     slot of the first sample, TRACE_F_GAP if samples were lost before it,
+//     TRACE_EVERY-1 in the high nibble of flags.
+//     Sent once per second and after any loss.
+//   LINK_T_TRACE: zigzag varint deltas (7 bits per byte, msb=more), each
+//     sample predicted from the previous one in the same slot of the same
+//     chunk (0 for the first), so every chunk decodes on its own.
+//
+// The link stays at 9600 baud (960 byte/s) so the peer unit keeps working:
+//   only one DA_PERIOD cycle every TRACE_EVERY is traced, whole, so after
+//   slot DA_PERIOD-1 the next sample is TRACE_EVERY-1 cycles later.
+//   Worst case 120 samples/s * 3 bytes + frame overhead is ~460 byte/s.
+//
+// The recorder on the host (host/trc.c) stores chunks as received, each one with a
+//   16 byte header (magic "TRC1", u32 seconds, u16 tm0, u8 slot, u8 flags,
+//   u16 samples, u16 bytes) followed by the delta bytes, and appends an
+//   index (u32 seconds, u32 file offset per chunk, then u32 count, "TIDX"),
+//   so a reader can mmap the file and jump to any second without decoding
+//   what precedes it.
+
+#define LINK_T_TRACE_HDR 'H'
+#define LINK_T_TRACE 'T'
+#define TRACE_F_GAP 0x01
+#define TRACE_EVERY 2		// trace one A/D cycle in TRACE_EVERY (1-16)
+
+#define TRACE_RINGSIZE 32	// raw samples buffered before encoding (power of 2)
+
+//-----------------------------------------------------------------------------
+// Global FUNCTIONS
+//-----------------------------------------------------------------------------
+
+void trace_poll(void);		// encode and send buffered samples
+
+//-----------------------------------------------------------------------------
+// Global VARIABLES
+//-----------------------------------------------------------------------------
+
+extern __xdata unsigned short traceVal[TRACE_RINGSIZE];
+extern __xdata unsigned char traceSlot[TRACE_RINGSIZE];
+extern volatile unsigned char traceHead;
+extern volatile unsigned char traceTail;
+extern volatile __bit bTraceGap;
+extern unsigned char traceCycle;
+
+// store a sample (from ADC0_Process), if its A/D cycle is traced
+#define TRACE_PUT(slot, val) \
+	{ \
+		unsigned char head = (traceHead+1) & (TRACE_RINGSIZE-1); \
+		if (traceCycle != 0) \
+			; \
+		else if (head != traceTail) \
+		{ \
+			traceVal[traceHead] = (val); \
+			traceSlot[traceHead] = (slot); \
+			traceHead = head; \
+		} \
+		else \
+			bTraceGap = 1; \
+		if ((slot) == DA_PERIOD-1 && ++traceCycle == TRACE_EVERY) \
+			traceCycle = 0; \
+	}
+
+#endif // _TRACE_H_